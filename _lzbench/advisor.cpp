@@ -0,0 +1,395 @@
+//
+// advisor.cpp
+// Picking a codec, level, and preprocessor under speed constraints (-aauto)
+//
+
+#include "advisor.h"
+
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include "output.h"
+#include "util.h"
+
+// how much of the input to benchmark, taken from evenly spaced slices so
+// that data that changes along the file is still represented
+static const size_t kSampleSize = 8 << 20;
+static const int kSampleSlices = 16;
+// how many preprocessors (besides none) survive screening
+static const int kKeptPreprocessors = 2;
+
+typedef struct advisor_codec {
+    const compressor_desc_t* desc;
+    std::vector<int> levels;
+} advisor_codec_t;
+
+typedef struct advisor_preproc {
+    std::vector<int64_t> preprocessors;
+    int element_sz;
+    std::string flags; // e.g., "-d1 -e2"; empty for none
+} advisor_preproc_t;
+
+typedef struct advisor_result {
+    const compressor_desc_t* desc;
+    int level;
+    size_t preproc; // index into the preprocessors tried
+    uint64_t ctime, dtime, comprsize, origsize;
+} advisor_result_t;
+
+// the codecs and levels in a -a list, with aliases expanded
+static void _expand_encoder_list(const char* encoder_list,
+    std::vector<advisor_codec_t>& codecs)
+{
+    for (auto& name : split(encoder_list, '/')) {
+        bool is_alias = false;
+        for (int i=0; i<LZBENCH_ALIASES_COUNT; i++) {
+            if (istrcmp(name.c_str(), alias_desc[i].name) == 0) {
+                _expand_encoder_list(alias_desc[i].params, codecs);
+                is_alias = true;
+                break;
+            }
+        }
+        if (is_alias) { continue; }
+
+        auto cparams = split(name, ',');
+        if (cparams.empty()) { continue; }
+        const compressor_desc_t* desc = NULL;
+        for (int i=1; i<LZBENCH_COMPRESSOR_COUNT; i++) {
+            if (comp_desc[i].name &&
+                    istrcmp(comp_desc[i].name, cparams[0].c_str()) == 0) {
+                desc = &comp_desc[i];
+                break;
+            }
+        }
+        if (!desc) {
+            printf("NOT FOUND: %s\n", cparams[0].c_str());
+            continue;
+        }
+        advisor_codec_t codec;
+        codec.desc = desc;
+        for (size_t j = 1; j < cparams.size(); j++) {
+            codec.levels.push_back(atoi(cparams[j].c_str()));
+        }
+        if (codec.levels.empty()) {
+            for (int level = desc->first_level; level <= desc->last_level;
+                    level++) {
+                codec.levels.push_back(level);
+            }
+        }
+        codecs.push_back(codec);
+    }
+}
+
+// no preprocessing, plus delta and double delta coding at every element
+// size and, where Sprintz can do it, FIRE forecasting; the lag is one row
+// in elements of that size, so each value is predicted from the same
+// column. Sizes that don't divide a row evenly are skipped.
+static std::vector<advisor_preproc_t> _candidate_preprocessors(
+    const DataInfo& data_info)
+{
+    std::vector<advisor_preproc_t> preprocs(1);
+    preprocs[0].element_sz = data_info.element_sz;
+    int64_t row_bytes = (int64_t)(data_info.ncols * data_info.element_sz);
+    int element_szs[] = {1, 2, 4, 8};
+    for (int sz : element_szs) {
+        int64_t lag = 1;
+        if (row_bytes > 0) {
+            if (row_bytes % sz != 0) { continue; } // also if row < 1 elem
+            lag = row_bytes / sz;
+        }
+        advisor_preproc_t p;
+        p.element_sz = sz;
+        p.preprocessors.assign(1, lag);
+        format(p.flags, "-d%d -e%d", (int)lag, sz);
+        preprocs.push_back(p);
+        p.preprocessors.assign(1, lag + (1 << 16)); // as for -D
+        format(p.flags, "-D%d -e%d", (int)lag, sz);
+        preprocs.push_back(p);
+#ifndef BENCH_REMOVE_SPRINTZ
+        if (sz <= 2) {
+            p.preprocessors.assign(1, -lag); // as for -f
+            format(p.flags, "-f%d -e%d", (int)lag, sz);
+            preprocs.push_back(p);
+        }
+#endif
+    }
+    return preprocs;
+}
+
+// evenly spaced slices of the input, each a whole number of rows of
+// 8B elements so that no element size or lag gets split
+static size_t _take_sample(const lzbench_params_t *params,
+    const uint8_t *inbuf, size_t insize, uint8_t *sample)
+{
+    size_t row_bytes = 8 * std::max(params->data_info.ncols, (size_t)1);
+    size_t slice = kSampleSize / kSampleSlices / row_bytes * row_bytes;
+    size_t stride = insize / kSampleSlices / row_bytes * row_bytes;
+    size_t sample_size = 0;
+    for (int s = 0; s < kSampleSlices && slice > 0; s++) {
+        memcpy(sample + sample_size, inbuf + s * stride, slice);
+        sample_size += slice;
+    }
+    return sample_size;
+}
+
+// runs one configuration on the sample; returns false if it was skipped
+// for being slower to compress than params->cspeed or failed outright
+static bool _try_config(lzbench_params_t *search,
+    std::vector<size_t> &file_sizes, const compressor_desc_t* desc,
+    int level, size_t preproc, const std::vector<advisor_preproc_t>& preprocs,
+    const std::string& filename, const uint8_t *sample, size_t sample_size,
+    uint8_t *compbuf, size_t comprsize, uint8_t *decomp, bench_rate_t rate,
+    std::vector<advisor_result_t>& results)
+{
+    for (auto& r : results) {
+        if (r.desc == desc && r.level == level && r.preproc == preproc) {
+            return true; // already measured while screening
+        }
+    }
+
+    auto& p = preprocs[preproc];
+    std::string label = filename + " sample";
+    if (!p.flags.empty()) { label += " " + p.flags; }
+    search->in_filename = label.c_str();
+    search->preprocessors = p.preprocessors;
+    search->data_info.element_sz = p.element_sz;
+
+    size_t nresults = search->results.size();
+    lzbench_test(search, file_sizes, desc, level, sample, sample_size,
+        compbuf, comprsize, decomp, rate, level);
+    if (search->results.size() == nresults) { return false; }
+
+    auto& row = search->results.back();
+    if (row.col2_ctime == 0) { return false; }
+    advisor_result_t r;
+    r.desc = desc;
+    r.level = level;
+    r.preproc = preproc;
+    r.ctime = row.col2_ctime;
+    r.dtime = row.col3_dtime;
+    r.comprsize = row.col4_comprsize;
+    r.origsize = row.col5_origsize;
+    results.push_back(r);
+    return true;
+}
+
+static double _speed(uint64_t nanos, uint64_t size) {
+    return nanos ? size * 1000.0 / nanos : 0;
+}
+
+static bool _feasible(const lzbench_params_t *params,
+    const advisor_result_t& r)
+{
+    if (!r.dtime && !params->compress_only) { return false; } // decomp error
+    return _speed(r.ctime, r.origsize) >= params->cspeed &&
+        (params->compress_only || _speed(r.dtime, r.origsize) >= params->dspeed);
+}
+
+// at least as good on ratio and both speeds, and better on one of them
+static bool _dominates(const advisor_result_t& a, const advisor_result_t& b) {
+    bool ge = a.comprsize <= b.comprsize && a.ctime <= b.ctime &&
+        a.dtime <= b.dtime;
+    bool gt = a.comprsize < b.comprsize || a.ctime < b.ctime ||
+        a.dtime < b.dtime;
+    return ge && gt;
+}
+
+static std::string _algname(const compressor_desc_t* desc, int level) {
+    std::string algname;
+    if (desc->first_level == 0 && desc->last_level==0)
+        format(algname, "%s %s", desc->name, desc->version);
+    else
+        format(algname, "%s %s -%d", desc->name, desc->version, level);
+    return algname;
+}
+
+static void _print_frontier(lzbench_params_t *params,
+    const std::vector<advisor_result_t>& results,
+    const std::vector<advisor_preproc_t>& preprocs, size_t sample_size,
+    const char* filename)
+{
+    std::vector<advisor_result_t> frontier;
+    for (auto& r : results) {
+        if (!_feasible(params, r)) { continue; }
+        bool dominated = false;
+        for (auto& o : results) {
+            if (_feasible(params, o) && _dominates(o, r)) {
+                dominated = true;
+                break;
+            }
+        }
+        if (!dominated) { frontier.push_back(r); }
+    }
+    // best ratio first; among equals, fastest to decompress
+    std::sort(frontier.begin(), frontier.end(),
+        [](const advisor_result_t& a, const advisor_result_t& b) {
+            if (a.comprsize != b.comprsize) { return a.comprsize < b.comprsize; }
+            return a.dtime < b.dtime;
+        });
+
+    std::string recommended;
+    if (!frontier.empty()) {
+        auto& best = frontier[0];
+        auto& p = preprocs[best.preproc];
+        if (best.desc->first_level == 0 && best.desc->last_level == 0) {
+            format(recommended, "-a%s", best.desc->name);
+        } else {
+            format(recommended, "-a%s,%d", best.desc->name, best.level);
+        }
+        if (!p.flags.empty()) { recommended += " " + p.flags; }
+    }
+
+    switch (params->textformat)
+    {
+        case CSV:
+            printf("Compressor name,Preprocessing,Compression speed,Decompression speed,Original size,Compressed size,Ratio,Recommended,Filename\n");
+            break;
+        case MARKDOWN:
+        case MARKDOWN2:
+            printf("\n| Compressor name         | Preprocessing | Compression| Decompress.| Ratio |\n");
+            printf("| ---------------         | ------------- | -----------| -----------| ----- |\n");
+            break;
+        case TURBOBENCH:
+        case TEXT:
+        case TEXT_FULL:
+            printf("\nPareto frontier on a %.1f MB sample with compression >= %u MB/s and decompression >= %u MB/s:\n",
+                sample_size / 1e6, params->cspeed, params->dspeed);
+            printf("Compressor name         Preprocessing  Compress. Decompress.  Ratio\n");
+            break;
+        default:
+            return;
+    }
+
+    for (size_t i = 0; i < frontier.size(); i++) {
+        auto& r = frontier[i];
+        std::string algname = _algname(r.desc, r.level);
+        const char* flags = preprocs[r.preproc].flags.empty() ?
+            "none" : preprocs[r.preproc].flags.c_str();
+        double ratio = r.comprsize * 100.0 / r.origsize;
+        int cspeed = (int)_speed(r.ctime, r.origsize);
+        int dspeed = (int)_speed(r.dtime, r.origsize);
+        switch (params->textformat)
+        {
+            case CSV:
+                printf("%s,%s,%.2f,%.2f,%llu,%llu,%.2f,%d,%s\n",
+                    algname.c_str(), flags, _speed(r.ctime, r.origsize),
+                    _speed(r.dtime, r.origsize),
+                    (unsigned long long)r.origsize,
+                    (unsigned long long)r.comprsize, ratio, (int)(i == 0),
+                    filename);
+                break;
+            case MARKDOWN:
+            case MARKDOWN2:
+                printf("| %-23s | %-13s |%6d MB/s |%6d MB/s |%6.2f |\n",
+                    algname.c_str(), flags, cspeed, dspeed, ratio);
+                break;
+            default:
+                printf("%-23s %-13s %6d MB/s %6d MB/s %6.2f\n",
+                    algname.c_str(), flags, cspeed, dspeed, ratio);
+                break;
+        }
+    }
+
+    if (params->textformat == CSV) { return; }
+    if (frontier.empty()) {
+        printf("\nNothing met the speed constraints; try a lower -s\n");
+    } else {
+        printf("\nRecommended: %s\n", recommended.c_str());
+    }
+}
+
+void lzbench_advise(lzbench_params_t *params, std::vector<size_t> &file_sizes,
+    const char* encoder_list, const uint8_t *inbuf, size_t insize,
+    uint8_t *compbuf, size_t comprsize, uint8_t *decomp, bench_rate_t rate)
+{
+    std::vector<advisor_codec_t> codecs;
+    _expand_encoder_list(encoder_list, codecs);
+    if (codecs.empty()) { return; }
+    auto preprocs = _candidate_preprocessors(params->data_info);
+
+    const uint8_t* sample = inbuf;
+    uint8_t* sample_buf = NULL;
+    size_t sample_size = insize;
+    if (insize > kSampleSize) {
+        sample_buf = alloc_data_buffer(kSampleSize + PAD_SIZE);
+        if (!sample_buf) {
+            printf("Not enough memory for the -aauto sample!\n");
+            exit(1);
+        }
+        sample_size = _take_sample(params, inbuf, insize, sample_buf);
+        sample = sample_buf;
+    }
+    std::vector<size_t> sample_sizes(1, sample_size);
+    LZBENCH_PRINT(2, "searching %d codecs x %d preprocessors on %.1f MB\n",
+        (int)codecs.size(), (int)preprocs.size(), sample_size / 1e6);
+
+    // -s already makes lzbench_test give up on codecs that compress too
+    // slowly after trying 100KB; the sweeps would just multiply the runs
+    lzbench_params_t search(*params);
+    search.nthreads_max = 0;
+    search.chunk_size_max = 0;
+    search.results.clear();
+    std::string filename = params->in_filename;
+    std::vector<advisor_result_t> results;
+
+    // screen the preprocessors with one fast codec that's in the list
+    // (preferably zstd -1 or lz4), and only keep the ones that compress
+    // better than no preprocessing and best among the rest
+    size_t screener = 0;
+    const char* screeners[] = {"zstd", "lz4"};
+    for (int s = 1; s >= 0; s--) {
+        for (size_t c = 0; c < codecs.size(); c++) {
+            if (istrcmp(codecs[c].desc->name, screeners[s]) == 0) {
+                screener = c;
+            }
+        }
+    }
+    const compressor_desc_t* sdesc = codecs[screener].desc;
+    int slevel = codecs[screener].levels[0];
+    std::vector<std::pair<uint64_t, size_t> > screened;
+    for (size_t p = 0; p < preprocs.size(); p++) {
+        if (_try_config(&search, sample_sizes, sdesc, slevel, p, preprocs,
+                filename, sample, sample_size, compbuf, comprsize, decomp,
+                rate, results) && !results.empty() &&
+                results.back().preproc == p && results.back().dtime) {
+            screened.push_back(std::make_pair(results.back().comprsize, p));
+        }
+    }
+    std::sort(screened.begin(), screened.end());
+    uint64_t none_size = UINT64_MAX;
+    for (auto& s : screened) {
+        if (s.second == 0) { none_size = s.first; }
+    }
+    std::vector<size_t> kept(1, 0);
+    for (auto& s : screened) {
+        if ((int)kept.size() > kKeptPreprocessors) { break; }
+        if (s.second != 0 && s.first < none_size) { kept.push_back(s.second); }
+    }
+
+    // higher levels of a codec compress more slowly, so once one is too
+    // slow for -s after a faster one wasn't (or the first two both are),
+    // the rest of its levels are skipped
+    for (auto& codec : codecs) {
+        for (size_t p : kept) {
+            bool passed_any = false;
+            int nfailed = 0;
+            for (int level : codec.levels) {
+                if (_try_config(&search, sample_sizes, codec.desc, level, p,
+                        preprocs, filename, sample, sample_size, compbuf,
+                        comprsize, decomp, rate, results)) {
+                    passed_any = true;
+                } else if (passed_any || ++nfailed >= 2) {
+                    LZBENCH_PRINT(3, "skipping the rest of %s's levels\n",
+                        codec.desc->name);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto& row : search.results) { params->results.push_back(row); }
+    if (sample_buf) { free_data_buffer(sample_buf); }
+
+    _print_frontier(params, results, preprocs, sample_size, filename.c_str());
+}
@@ -0,0 +1,24 @@
+//
+// advisor.h
+// Picking a codec, level, and preprocessor under speed constraints (-aauto)
+//
+
+#ifndef _advisor_h
+#define _advisor_h
+
+#include <stdint.h>
+#include <vector>
+
+#include "lzbench.h"
+
+// benchmarks a sample of the input with every codec and level in
+// encoder_list (in the same form as -a), with and without each
+// preprocessor and element size, then prints the configurations on the
+// ratio / compression speed / decompression speed Pareto frontier that are
+// at least as fast as params->cspeed and params->dspeed, and the -a, -d,
+// -D, -f, and -e flags for the one that compresses best
+void lzbench_advise(lzbench_params_t *params, std::vector<size_t> &file_sizes,
+    const char* encoder_list, const uint8_t *inbuf, size_t insize,
+    uint8_t *compbuf, size_t comprsize, uint8_t *decomp, bench_rate_t rate);
+
+#endif
@@ -0,0 +1,392 @@
+//
+// baseline.cpp
+// Comparing results against a previous -o7 run (-B)
+//
+
+#include "baseline.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output.h"
+
+// ------------------------------------------------ minimal JSON reader
+
+// just enough JSON to read back what -o7 writes
+typedef struct JsonValue {
+    enum { NUL, BOOL, NUM, STR, ARR, OBJ } type;
+    double num;
+    std::string str;
+    std::vector<JsonValue> items; // array elements or object values
+    std::vector<std::string> keys; // object keys, parallel to items
+
+    JsonValue() : type(NUL), num(0) {}
+    const JsonValue* get(const char* key) const {
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (keys[i] == key) { return &items[i]; }
+        }
+        return NULL;
+    }
+} JsonValue;
+
+class JsonParser {
+public:
+    explicit JsonParser(const char* text) : p(text) {}
+
+    bool parse(JsonValue& v) {
+        if (!parse_value(v)) { return false; }
+        skip_space();
+        return *p == '\0';
+    }
+
+private:
+    const char* p;
+
+    void skip_space() { while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') { p++; } }
+
+    bool parse_string(std::string& s) {
+        if (*p != '"') { return false; }
+        p++;
+        while (*p && *p != '"') {
+            if (*p != '\\') { s += *p++; continue; }
+            p++;
+            switch (*p) {
+                case 'n': s += '\n'; break;
+                case 't': s += '\t'; break;
+                case 'r': s += '\r'; break;
+                case 'b': s += '\b'; break;
+                case 'f': s += '\f'; break;
+                case 'u': // only ever written for control characters
+                    if (strlen(p) < 5) { return false; }
+                    s += (char)strtol(std::string(p + 1, 4).c_str(), NULL, 16);
+                    p += 4;
+                    break;
+                case '\0': return false;
+                default: s += *p; break;
+            }
+            p++;
+        }
+        if (*p != '"') { return false; }
+        p++;
+        return true;
+    }
+
+    bool parse_value(JsonValue& v) {
+        skip_space();
+        if (*p == '{' || *p == '[') {
+            bool is_obj = *p == '{';
+            char close = is_obj ? '}' : ']';
+            v.type = is_obj ? JsonValue::OBJ : JsonValue::ARR;
+            p++;
+            skip_space();
+            if (*p == close) { p++; return true; }
+            while (true) {
+                skip_space();
+                if (is_obj) {
+                    std::string key;
+                    if (!parse_string(key)) { return false; }
+                    skip_space();
+                    if (*p++ != ':') { return false; }
+                    v.keys.push_back(key);
+                }
+                v.items.push_back(JsonValue());
+                if (!parse_value(v.items.back())) { return false; }
+                skip_space();
+                if (*p == ',') { p++; continue; }
+                if (*p == close) { p++; return true; }
+                return false;
+            }
+        }
+        if (*p == '"') {
+            v.type = JsonValue::STR;
+            return parse_string(v.str);
+        }
+        if (!strncmp(p, "true", 4) || !strncmp(p, "false", 5)) {
+            v.type = JsonValue::BOOL;
+            v.num = *p == 't';
+            p += *p == 't' ? 4 : 5;
+            return true;
+        }
+        if (!strncmp(p, "null", 4)) {
+            v.type = JsonValue::NUL;
+            p += 4;
+            return true;
+        }
+        char* end;
+        v.num = strtod(p, &end);
+        if (end == p) { return false; }
+        v.type = JsonValue::NUM;
+        p = end;
+        return true;
+    }
+};
+
+static std::string _json_str(const JsonValue& obj, const char* key) {
+    const JsonValue* v = obj.get(key);
+    return (v && v->type == JsonValue::STR) ? v->str : std::string();
+}
+
+static double _json_num(const JsonValue& obj, const char* key) {
+    const JsonValue* v = obj.get(key);
+    return (v && v->type == JsonValue::NUM) ? v->num : 0;
+}
+
+static std::vector<uint64_t> _json_ints(const JsonValue& obj, const char* key) {
+    std::vector<uint64_t> ret;
+    const JsonValue* v = obj.get(key);
+    if (!v || v->type != JsonValue::ARR) { return ret; }
+    for (auto& item : v->items) { ret.push_back((uint64_t)item.num); }
+    return ret;
+}
+
+std::vector<baseline_row_t> load_baseline(const char* path) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        printf("ERROR: can't open baseline file %s\n", path);
+        exit(1);
+    }
+
+    std::vector<baseline_row_t> rows;
+    std::string line;
+    int lineno = 0;
+    char buff[4096];
+    while (fgets(buff, sizeof(buff), f)) {
+        line += buff;
+        if (line.back() != '\n' && !feof(f)) { continue; } // long line
+        lineno++;
+        if (line.find_first_not_of(" \t\r\n") == std::string::npos) {
+            line.clear();
+            continue;
+        }
+
+        JsonValue obj;
+        if (!JsonParser(line.c_str()).parse(obj) || obj.type != JsonValue::OBJ) {
+            printf("ERROR: line %d of baseline file %s isn't a JSON object; "
+                "baselines have to come from -o7\n", lineno, path);
+            exit(1);
+        }
+        line.clear();
+        if (!obj.get("compressor")) { continue; } // not a result
+
+        baseline_row_t row;
+        row.compressor = _json_str(obj, "compressor");
+        row.codec = _json_str(obj, "codec");
+        row.version = _json_str(obj, "version");
+        row.filename = _json_str(obj, "filename");
+        row.level = (int)_json_num(obj, "level");
+        row.orig_size = (uint64_t)_json_num(obj, "orig_size");
+        row.compr_size = (uint64_t)_json_num(obj, "compr_size");
+        row.ctimes = _json_ints(obj, "compr_samples_ns");
+        row.dtimes = _json_ints(obj, "decompr_samples_ns");
+        rows.push_back(row);
+    }
+    fclose(f);
+    return rows;
+}
+
+std::string baseline_encoder_list(const std::vector<baseline_row_t>& rows) {
+    // codecs in the order they first appear, each with all of its levels
+    std::vector<std::string> codecs;
+    std::vector<std::vector<int> > levels;
+    for (auto& row : rows) {
+        if (row.codec == "memcpy") { continue; } // always run first anyway
+        size_t c = std::find(codecs.begin(), codecs.end(), row.codec) - codecs.begin();
+        if (c == codecs.size()) {
+            codecs.push_back(row.codec);
+            levels.push_back(std::vector<int>());
+        }
+        // codecs without levels are named without one
+        std::string unleveled = row.codec + " " + row.version;
+        bool has_level = row.compressor.size() > unleveled.size() &&
+            row.compressor.compare(unleveled.size(), 2, " -") == 0 &&
+            isdigit((unsigned char)row.compressor[unleveled.size() + 2]);
+        auto& codec_levels = levels[c];
+        if (has_level && std::find(codec_levels.begin(), codec_levels.end(),
+                row.level) == codec_levels.end()) {
+            codec_levels.push_back(row.level);
+        }
+    }
+
+    std::string list;
+    for (size_t c = 0; c < codecs.size(); c++) {
+        if (c) { list += '/'; }
+        list += codecs[c];
+        for (auto level : levels[c]) {
+            std::string level_str;
+            format(level_str, ",%d", level);
+            list += level_str;
+        }
+    }
+    return list;
+}
+
+// ------------------------------------------------ comparison
+
+static double _median(std::vector<double> vals) {
+    if (vals.empty()) { return 0; }
+    std::sort(vals.begin(), vals.end());
+    size_t n = vals.size();
+    return (vals[(n - 1) / 2] + vals[n / 2]) / 2;
+}
+
+static std::vector<double> _speeds(const std::vector<uint64_t>& nanos,
+    uint64_t nbytes)
+{
+    std::vector<double> speeds;
+    for (auto t : nanos) {
+        if (t > 0) { speeds.push_back(nbytes * 1000.0 / t); }
+    }
+    return speeds;
+}
+
+// relative change in the median from old_vals to new_vals, with a 95%
+// confidence interval from resampling both with replacement; the seed is
+// fixed so that rerunning a comparison gives the same interval
+static void _bootstrap_change(const std::vector<double>& old_vals,
+    const std::vector<double>& new_vals, double* change, double* ci_lo,
+    double* ci_hi)
+{
+    static const int kNumResamples = 2000;
+
+    double old_median = _median(old_vals);
+    *change = old_median > 0 ? _median(new_vals) / old_median - 1 : 0;
+    *ci_lo = *ci_hi = *change;
+    if (old_vals.size() < 2 && new_vals.size() < 2) { return; }
+
+    std::mt19937 rng(12345);
+    std::vector<double> changes, old_sample(old_vals.size()),
+        new_sample(new_vals.size());
+    for (int r = 0; r < kNumResamples; r++) {
+        for (auto& x : old_sample) { x = old_vals[rng() % old_vals.size()]; }
+        for (auto& x : new_sample) { x = new_vals[rng() % new_vals.size()]; }
+        double old_med = _median(old_sample);
+        if (old_med > 0) { changes.push_back(_median(new_sample) / old_med - 1); }
+    }
+    if (changes.empty()) { return; }
+    std::sort(changes.begin(), changes.end());
+    *ci_lo = changes[(size_t)(.025 * (changes.size() - 1))];
+    *ci_hi = changes[(size_t)(.975 * (changes.size() - 1))];
+}
+
+static void _print_comparison(lzbench_params_t *params,
+    const std::string& name, const std::string& filename, const char* metric,
+    double old_val, double new_val, double change, double ci_lo,
+    double ci_hi, const char* verdict)
+{
+    switch (params->textformat)
+    {
+        case CSV:
+            printf("%s,%s,%.3f,%.3f,%.4f,%.4f,%.4f,%s,%s\n", name.c_str(),
+                metric, old_val, new_val, change, ci_lo, ci_hi, verdict,
+                filename.c_str());
+            break;
+        case JSON_LINES:
+            printf("{\"baseline_comparison\":{\"compressor\":\"%s\","
+                "\"metric\":\"%s\",\"baseline\":%.3f,\"current\":%.3f,"
+                "\"change\":%.4f,\"ci_low\":%.4f,\"ci_high\":%.4f,"
+                "\"verdict\":\"%s\",\"filename\":\"%s\"}}\n", name.c_str(),
+                metric, old_val, new_val, change, ci_lo, ci_hi, verdict,
+                filename.c_str());
+            break;
+        case MARKDOWN:
+        case MARKDOWN2:
+            printf("| %-23s | %-11s | %10.2f | %10.2f | %+6.1f%% | %+6.1f%% .. %+6.1f%% | %-10s |\n",
+                name.c_str(), metric, old_val, new_val, 100 * change,
+                100 * ci_lo, 100 * ci_hi, verdict);
+            break;
+        default:
+            printf("%-23s %-11s %10.2f %10.2f %+6.1f%% %+6.1f%% .. %+6.1f%%  %s\n",
+                name.c_str(), metric, old_val, new_val, 100 * change,
+                100 * ci_lo, 100 * ci_hi, verdict);
+            break;
+    }
+}
+
+int print_baseline_comparison(lzbench_params_t *params,
+    const std::vector<baseline_row_t>& baseline)
+{
+    double threshold = params->regression_pct / 100.;
+    switch (params->textformat)
+    {
+        case CSV:
+            printf("Compressor name,Metric,Baseline,Current,Change,CI low,CI high,Verdict,Filename\n");
+            break;
+        case JSON_LINES:
+            break;
+        case MARKDOWN:
+        case MARKDOWN2:
+            printf("\n| Compressor name         | Metric      |   Baseline |    Current |  Change | 95%% CI             | Verdict    |\n");
+            printf("| ---------------         | ----------- | ---------- | ---------- | ------- | ------------------ | ---------- |\n");
+            break;
+        default:
+            printf("\nChanges since baseline (threshold %d%%):\n", params->regression_pct);
+            printf("Compressor name         Metric        Baseline    Current  Change  95%% CI            Verdict\n");
+            break;
+    }
+
+    int nregressions = 0;
+    for (auto& row : params->results) {
+        const baseline_row_t* old_row = NULL;
+        for (auto& b : baseline) {
+            if (b.compressor == row.col1_algname && b.filename == row.col6_filename) {
+                old_row = &b;
+                break;
+            }
+        }
+        if (!old_row) {
+            LZBENCH_PRINT(2, "%s on %s isn't in the baseline\n",
+                row.col1_algname.c_str(), row.col6_filename.c_str());
+            continue;
+        }
+
+        // speeds: worse means significantly slower by more than threshold
+        for (int phase = 0; phase < 2; phase++) {
+            const char* metric = phase == 0 ? "compr. MB/s" : "decomp. MB/s";
+            auto old_speeds = _speeds(phase == 0 ? old_row->ctimes : old_row->dtimes,
+                old_row->orig_size);
+            auto new_speeds = _speeds(phase == 0 ? row.ctimes : row.dtimes,
+                row.col5_origsize);
+            if (old_speeds.empty() || new_speeds.empty()) { continue; }
+
+            double change, ci_lo, ci_hi;
+            _bootstrap_change(old_speeds, new_speeds, &change, &ci_lo, &ci_hi);
+            const char* verdict = "same";
+            if (change < -threshold && ci_hi < 0) {
+                verdict = "REGRESSION";
+                nregressions++;
+            } else if (change > threshold && ci_lo > 0) {
+                verdict = "faster";
+            }
+            _print_comparison(params, row.col1_algname, row.col6_filename,
+                metric, _median(old_speeds), _median(new_speeds), change,
+                ci_lo, ci_hi, verdict);
+        }
+
+        // ratio is deterministic, so any change beyond the threshold counts
+        if (old_row->orig_size && row.col5_origsize) {
+            double old_ratio = 100. * old_row->compr_size / old_row->orig_size;
+            double new_ratio = 100. * row.col4_comprsize / row.col5_origsize;
+            double change = new_ratio / old_ratio - 1;
+            const char* verdict = "same";
+            if (change > threshold) {
+                verdict = "REGRESSION";
+                nregressions++;
+            } else if (change < -threshold) {
+                verdict = "smaller";
+            }
+            _print_comparison(params, row.col1_algname, row.col6_filename,
+                "ratio %", old_ratio, new_ratio, change, change, change,
+                verdict);
+        }
+    }
+
+    if (nregressions > 0) {
+        LZBENCH_PRINT(1, "%d regression(s) beyond %d%% since the baseline\n",
+            nregressions, params->regression_pct);
+    }
+    return nregressions;
+}
@@ -0,0 +1,35 @@
+//
+// baseline.h
+// Comparing results against a previous -o7 run (-B)
+//
+
+#ifndef _baseline_h
+#define _baseline_h
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lzbench.h"
+
+// what we need from one line of a previous JSON lines (-o7) results file
+typedef struct baseline_row {
+    std::string compressor, codec, version, filename;
+    int level;
+    uint64_t orig_size, compr_size;
+    std::vector<uint64_t> ctimes, dtimes;
+} baseline_row_t;
+
+// reads every result in the file; exits if it can't be read or parsed
+std::vector<baseline_row_t> load_baseline(const char* path);
+
+// the codecs and levels in the baseline, in the same form as -a, so the
+// same matrix can be rerun
+std::string baseline_encoder_list(const std::vector<baseline_row_t>& rows);
+
+// prints how each result changed since the baseline and returns how many
+// got significantly worse by more than params->regression_pct percent
+int print_baseline_comparison(lzbench_params_t *params,
+    const std::vector<baseline_row_t>& baseline);
+
+#endif
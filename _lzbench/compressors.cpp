@@ -1792,6 +1792,71 @@ int64_t lzbench_zstd_decompress(char *inbuf, size_t insize, char *outbuf, size_t
     return ZSTD_decompressDCtx(zstd_params->dctx, outbuf, outsize, inbuf, insize);
 }
 
+// the same frame as lzbench_zstd_compress would write, but fed to zstd one
+// tile at a time, each prepared into inbuf just before it's needed; tiles
+// already compressed must stay put, since later ones can refer back to them
+int64_t lzbench_zstd_tiled_compress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t level, size_t windowLog, char* workmem, size_t tile_size, tile_func prepare, void* ctx)
+{
+    size_t res, clen = 0, offset = 0;
+
+    zstd_params_s* zstd_params = (zstd_params_s*) workmem;
+    if (!zstd_params || !zstd_params->cctx) return 0;
+
+    zstd_params->zparams = ZSTD_getParams(level, insize, 0);
+    zstd_params->zparams.fParams.contentSizeFlag = 1;
+    if (windowLog && zstd_params->zparams.cParams.windowLog > windowLog) {
+        zstd_params->zparams.cParams.windowLog = windowLog;
+        zstd_params->zparams.cParams.chainLog = windowLog + ((zstd_params->zparams.cParams.strategy == ZSTD_btlazy2) || (zstd_params->zparams.cParams.strategy == ZSTD_btopt) || (zstd_params->zparams.cParams.strategy == ZSTD_btopt2));
+    }
+    res = ZSTD_compressBegin_advanced(zstd_params->cctx, NULL, 0, zstd_params->zparams, insize);
+    if (ZSTD_isError(res)) return res;
+
+    do {
+        size_t size = insize - offset < tile_size ? insize - offset : tile_size;
+        prepare(inbuf + offset, offset, size, ctx);
+        if (offset + size < insize) {
+            res = ZSTD_compressContinue(zstd_params->cctx, outbuf + clen, outsize - clen, inbuf + offset, size);
+        } else {
+            res = ZSTD_compressEnd(zstd_params->cctx, outbuf + clen, outsize - clen, inbuf + offset, size);
+        }
+        if (ZSTD_isError(res)) return res;
+        clen += res;
+        offset += size;
+    } while (offset < insize);
+
+    return clen;
+}
+
+// decodes any zstd frame straight into outbuf, one block at a time, and
+// hands off each tile as soon as all of it has been decoded; outbuf has to
+// be left alone otherwise, since later blocks can copy from it
+int64_t lzbench_zstd_tiled_decompress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char* workmem, size_t tile_size, tile_func finish, void* ctx)
+{
+    size_t res, n, dlen = 0, finished = 0;
+    const char* inend = inbuf + insize;
+
+    zstd_params_s* zstd_params = (zstd_params_s*) workmem;
+    if (!zstd_params || !zstd_params->dctx) return 0;
+
+    res = ZSTD_decompressBegin(zstd_params->dctx);
+    if (ZSTD_isError(res)) return res;
+
+    while ((n = ZSTD_nextSrcSizeToDecompress(zstd_params->dctx)) != 0) {
+        if (n > (size_t)(inend - inbuf)) return 0;
+        res = ZSTD_decompressContinue(zstd_params->dctx, outbuf + dlen, outsize - dlen, inbuf, n);
+        if (ZSTD_isError(res)) return res;
+        inbuf += n;
+        dlen += res;
+        while (dlen - finished >= tile_size) {
+            finish(outbuf + finished, finished, tile_size, ctx);
+            finished += tile_size;
+        }
+    }
+    if (dlen > finished) finish(outbuf + finished, finished, dlen - finished, ctx);
+
+    return dlen;
+}
+
 int64_t lzbench_fse_compress(char *inbuf, size_t insize, char *outbuf,
     size_t outsize, size_t, size_t, char*)
 {
@@ -2703,6 +2768,45 @@ int64_t lzbench_sprintz_xff_huf_decompress_16b(char *inbuf, size_t insize, char
 
 // ================================ queries
 
+// columns the pushdown queries touch; set once from -C before benchmarking
+static std::vector<uint16_t> sprintz_query_cols;
+
+void lzbench_sprintz_set_query_cols(const uint16_t* which_cols,
+    size_t nwhich_cols)
+{
+    sprintz_query_cols.assign(which_cols, which_cols + nwhich_cols);
+}
+
+// rows per window (or bucket) for the correlation, bounds, bucket, and
+// histogram queries; set from -w; 0 = all rows
+static uint32_t sprintz_query_window_nrows = 0;
+
+void lzbench_sprintz_set_query_window(size_t window_nrows) {
+    sprintz_query_window_nrows = (uint32_t)window_nrows;
+}
+
+// widest interval the bounds queries may report before decoding exactly;
+// set from -E
+static int64_t sprintz_query_max_err = 0;
+
+void lzbench_sprintz_set_query_max_err(int64_t max_err) {
+    sprintz_query_max_err = max_err;
+}
+
+// the queries only parse the rowmajor rle format, so the codecs for the
+// windowed queries compress with these (or their 8b versions above) rather
+// than with sprintz_compress_*, which uses the lowdim format for small ndims
+int64_t lzbench_sprintz_row_delta_rle_compress_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    return compress_rowmajor_delta_rle_16b((uint16_t*)inbuf, insize/2, (int16_t*)outbuf, ndims) * 2;
+}
+int64_t lzbench_sprintz_row_xff_rle_compress_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    return compress_rowmajor_xff_rle_16b((uint16_t*)inbuf, insize/2, (int16_t*)outbuf, ndims) * 2;
+}
+
 int64_t lzbench_sprintz_delta_query0_8b(char *inbuf, size_t insize,
         char *outbuf, size_t outsize, size_t ndims, size_t, char*)
 {
@@ -2714,6 +2818,7 @@ int64_t lzbench_sprintz_delta_query0_8b(char *inbuf, size_t insize,
     // // qp.op = REDUCE_MAX;
     QueryParams qp;
     qp.op = REDUCE_MAX;
+    qp.which_cols = sprintz_query_cols;
     return query_rowmajor_delta_rle_8b((int8_t*)inbuf, (uint8_t*)outbuf, qp);
 }
 
@@ -2726,9 +2831,156 @@ int64_t lzbench_sprintz_xff_query1_16b(char *inbuf, size_t insize,
 
     QueryParams qp;
     qp.op = REDUCE_SUM;
+    qp.which_cols = sprintz_query_cols;
     return query_rowmajor_xff_rle_16b((int16_t*)inbuf, (uint16_t*)outbuf, qp);
 }
 
+int64_t lzbench_sprintz_delta_corr_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<double> corrs;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return corr_query_rowmajor_delta_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, corrs);
+}
+
+int64_t lzbench_sprintz_xff_corr_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<double> corrs;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return corr_query_rowmajor_xff_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, corrs);
+}
+
+int64_t lzbench_sprintz_delta_bounds_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<ColumnBounds> bounds;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    qp.max_err = (double)sprintz_query_max_err;
+    return bounds_query_rowmajor_delta_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, bounds);
+}
+
+int64_t lzbench_sprintz_delta_bounds_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<ColumnBounds> bounds;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    qp.max_err = (double)sprintz_query_max_err;
+    return bounds_query_rowmajor_delta_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, bounds);
+}
+
+int64_t lzbench_sprintz_delta_buckets_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<BucketStats> buckets;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return bucket_query_rowmajor_delta_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, buckets);
+}
+
+int64_t lzbench_sprintz_xff_buckets_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<BucketStats> buckets;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return bucket_query_rowmajor_xff_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, buckets);
+}
+
+int64_t lzbench_sprintz_delta_buckets_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<BucketStats> buckets;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return bucket_query_rowmajor_delta_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, buckets);
+}
+
+int64_t lzbench_sprintz_xff_buckets_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<BucketStats> buckets;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return bucket_query_rowmajor_xff_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, buckets);
+}
+
+int64_t lzbench_sprintz_delta_hist_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<uint32_t> counts;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return histogram_query_rowmajor_delta_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, counts);
+}
+
+int64_t lzbench_sprintz_xff_hist_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<uint32_t> counts;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return histogram_query_rowmajor_xff_rle_8b((int8_t*)inbuf,
+        (uint8_t*)outbuf, qp, counts);
+}
+
+int64_t lzbench_sprintz_delta_hist_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<uint32_t> counts;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return histogram_query_rowmajor_delta_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, counts);
+}
+
+int64_t lzbench_sprintz_xff_hist_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*)
+{
+    static thread_local std::vector<uint32_t> counts;
+    QueryParams qp;
+    qp.materialize = false;
+    qp.which_cols = sprintz_query_cols;
+    qp.window_nrows = sprintz_query_window_nrows;
+    return histogram_query_rowmajor_xff_rle_16b((int16_t*)inbuf,
+        (uint16_t*)outbuf, qp, counts);
+}
+
 #endif
 
 
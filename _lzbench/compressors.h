@@ -7,6 +7,11 @@
 int64_t lzbench_memcpy(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t , size_t, char* );
 int64_t lzbench_return_0(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t , size_t, char* );
 
+// for codecs that can take a chunk a tile at a time (-F); called on each
+// tile, in order, right before it's compressed or right after it's been
+// decompressed, with where the tile starts in the chunk
+typedef void (*tile_func)(char *tile, size_t offset, size_t size, void* ctx);
+
 
 
 // #ifndef BENCH_REMOVE_BLOSCLZ
@@ -462,6 +467,8 @@ int64_t lzbench_return_0(char *inbuf, size_t insize, char *outbuf, size_t outsiz
     void lzbench_zstd_deinit(char* workmem);
 	int64_t lzbench_zstd_compress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char*);
 	int64_t lzbench_zstd_decompress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char*);
+	int64_t lzbench_zstd_tiled_compress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t level, size_t windowLog, char* workmem, size_t tile_size, tile_func prepare, void* ctx);
+	int64_t lzbench_zstd_tiled_decompress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char* workmem, size_t tile_size, tile_func finish, void* ctx);
 
     int64_t lzbench_fse_compress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char*);
     int64_t lzbench_fse_decompress(char *inbuf, size_t insize, char *outbuf, size_t outsize, size_t, size_t, char*);
@@ -475,6 +482,8 @@ int64_t lzbench_return_0(char *inbuf, size_t insize, char *outbuf, size_t outsiz
 	#define lzbench_zstd_deinit NULL
 	#define lzbench_zstd_compress NULL
 	#define lzbench_zstd_decompress NULL
+	#define lzbench_zstd_tiled_compress NULL
+	#define lzbench_zstd_tiled_decompress NULL
 #endif
 
 
@@ -756,13 +765,52 @@ int64_t lzbench_return_0(char *inbuf, size_t insize, char *outbuf, size_t outsiz
 
     // ================================ sprintz query functions
 
+    // rowmajor rle only, since that's the only format the queries parse
+    int64_t lzbench_sprintz_row_delta_rle_compress_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_row_xff_rle_compress_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+
     // ------------------------ 8b
     int64_t lzbench_sprintz_delta_query0_8b(char *inbuf, size_t insize,
         char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_corr_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_bounds_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_buckets_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_xff_buckets_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_hist_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_xff_hist_8b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
 
     // ------------------------ 16b
     int64_t lzbench_sprintz_xff_query1_16b(char *inbuf, size_t insize,
         char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_xff_corr_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_bounds_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_buckets_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_xff_buckets_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_delta_hist_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+    int64_t lzbench_sprintz_xff_hist_16b(char *inbuf, size_t insize,
+        char *outbuf, size_t outsize, size_t ndims, size_t, char*);
+
+    // restrict the query functions to these columns; empty = all columns
+    void lzbench_sprintz_set_query_cols(const uint16_t* which_cols,
+        size_t nwhich_cols);
+    // rows per window (or bucket) for the correlation, bounds, bucket, and
+    // histogram queries; 0 = whole buffer
+    void lzbench_sprintz_set_query_window(size_t window_nrows);
+    // widest min/max/mean interval the bounds queries may report
+    void lzbench_sprintz_set_query_max_err(int64_t max_err);
 
 
 #else
@@ -786,6 +834,9 @@ int64_t lzbench_return_0(char *inbuf, size_t insize, char *outbuf, size_t outsiz
     #define lzbench_sprintz_delta_rle_huf_decompress
     #define lzbench_sprintz_delta_rle_zstd_compress
     #define lzbench_sprintz_delta_rle_zstd_decompress
+    #define lzbench_sprintz_set_query_cols(which_cols, nwhich_cols)
+    #define lzbench_sprintz_set_query_window(window_nrows)
+    #define lzbench_sprintz_set_query_max_err(max_err)
 #endif
 
 #endif // LZBENCH_COMPRESSORS_H
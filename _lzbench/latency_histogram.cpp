@@ -0,0 +1,49 @@
+//
+// latency_histogram.cpp
+// Per-chunk compression and decompression latencies (-L)
+//
+
+#include "latency_histogram.h"
+
+#include <math.h>
+
+void LatencyHistogram::clear() {
+    counts.assign(kNumBins, 0);
+    total = 0;
+    max_nanos = 0;
+}
+
+void LatencyHistogram::add(const LatencyHistogram& other) {
+    if (counts.size() < kNumBins) { counts.resize(kNumBins, 0); }
+    for (uint32_t b = 0; b < other.counts.size(); b++) {
+        counts[b] += other.counts[b];
+    }
+    total += other.total;
+    if (other.max_nanos > max_nanos) { max_nanos = other.max_nanos; }
+}
+
+uint64_t LatencyHistogram::percentile(double frac) const {
+    if (total == 0) { return 0; }
+    uint64_t target = (uint64_t)ceil(frac * total);
+    if (target < 1) { target = 1; }
+    uint64_t cumsum = 0;
+    for (uint32_t b = 0; b < counts.size(); b++) {
+        cumsum += counts[b];
+        if (cumsum >= target) {
+            uint64_t high = bin_high(b);
+            return high < max_nanos ? high : max_nanos;
+        }
+    }
+    return max_nanos;
+}
+
+void LatencyHistogram::dump(FILE* f, const char* algname, const char* phase,
+    const char* filename) const
+{
+    for (uint32_t b = 0; b < counts.size(); b++) {
+        if (!counts[b]) { continue; }
+        fprintf(f, "%s,%s,%llu,%llu,%llu,%s\n", algname, phase,
+            (unsigned long long)bin_low(b), (unsigned long long)bin_high(b),
+            (unsigned long long)counts[b], filename);
+    }
+}
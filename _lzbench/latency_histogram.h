@@ -0,0 +1,80 @@
+//
+// latency_histogram.h
+// Per-chunk compression and decompression latencies (-L)
+//
+
+#ifndef _latency_histogram_h
+#define _latency_histogram_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// log-linear bins of nanoseconds, as in HDR histograms: latencies below 128
+// get their own bin, and each larger power of two is split into 128 equal
+// bins, so any latency is within 1/128 of the bin it's reported as
+class LatencyHistogram {
+public:
+    static const int kSubBucketBits = 7;
+    static const uint32_t kSubBuckets = 1 << kSubBucketBits;
+    static const uint32_t kNumBins = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    LatencyHistogram() { clear(); }
+
+    void clear();
+    void record(uint64_t nanos) {
+        counts[bin(nanos)]++;
+        total++;
+        if (nanos > max_nanos) { max_nanos = nanos; }
+    }
+    void add(const LatencyHistogram& other);
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_nanos; }
+    // largest latency in the bin that the given fraction (0-1) of latencies
+    // are at or below, capped at the true max; 0 if nothing was recorded
+    uint64_t percentile(double frac) const;
+
+    // one "name,phase,low,high,count,filename" CSV line per nonempty bin
+    void dump(FILE* f, const char* algname, const char* phase,
+        const char* filename) const;
+
+    static uint32_t bin(uint64_t nanos) {
+        if (nanos < kSubBuckets) { return (uint32_t)nanos; }
+        int log2_x = 63 - __builtin_clzll(nanos);
+        int shift = log2_x - kSubBucketBits;
+        return ((uint32_t)(shift + 1) << kSubBucketBits) |
+            (uint32_t)((nanos >> shift) & (kSubBuckets - 1));
+    }
+    static uint64_t bin_low(uint32_t b) {
+        if (b < kSubBuckets) { return b; }
+        int shift = (int)(b >> kSubBucketBits) - 1;
+        return (uint64_t)(kSubBuckets | (b & (kSubBuckets - 1))) << shift;
+    }
+    static uint64_t bin_high(uint32_t b) {
+        if (b < kSubBuckets) { return b; }
+        int shift = (int)(b >> kSubBucketBits) - 1;
+        return bin_low(b) + ((uint64_t)1 << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t max_nanos;
+};
+
+// what gets printed for each result; all -1 if nothing was recorded
+typedef struct latency_summary {
+    int64_t p50, p99, p999, max;
+
+    latency_summary() : p50(-1), p99(-1), p999(-1), max(-1) {}
+    explicit latency_summary(const LatencyHistogram& hist) {
+        bool empty = hist.count() == 0;
+        p50 = empty ? -1 : (int64_t)hist.percentile(.5);
+        p99 = empty ? -1 : (int64_t)hist.percentile(.99);
+        p999 = empty ? -1 : (int64_t)hist.percentile(.999);
+        max = empty ? -1 : (int64_t)hist.max();
+    }
+} latency_summary_t;
+
+#endif
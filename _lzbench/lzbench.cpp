@@ -17,23 +17,50 @@
 */
 
 #include "lzbench.h"
+#include "advisor.h"
 #include "util.h"
 #include "output.h"
 #include "parallel.h"
 #include "preprocessing.h"
 #include "query.hpp"
+#include "stopping_rule.h"
 
+#include <algorithm> // max
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h> // _mm_clflush
+#endif
+
+
+// evicts a buffer from every level of cache, so that the next access to it
+// goes to DRAM; without clflush, sweeps a buffer much bigger than any
+// last-level cache instead
+static void evict_from_cache(const void* ptr, size_t size) {
+#if defined(__SSE2__) || defined(_M_X64)
+    uintptr_t p = (uintptr_t)ptr & ~(uintptr_t)63;
+    for (; p < (uintptr_t)ptr + size; p += 64) { _mm_clflush((const void*)p); }
+    _mm_mfence();
+#else
+    static const size_t kScrubSize = 256 << 20;
+    static uint8_t* scrub = NULL;
+    if (!scrub) { scrub = alloc_data_buffer(kScrubSize); }
+    for (size_t i = 0; i < kScrubSize; i += 64) { scrub[i]++; }
+#endif
+}
 
 inline int64_t lzbench_compress(lzbench_params_t *params,
     std::vector<size_t>& chunk_sizes, compress_func compress,
     std::vector<size_t> &compr_sizes, const uint8_t *inbuf, uint8_t *outbuf,
-    uint8_t* tmpbuf, size_t outsize, size_t param1, size_t param2,
-    char* workmem)
+    uint8_t* tmpbuf, size_t outsize, bench_rate_t rate, size_t param1,
+    size_t param2, char* workmem, LatencyHistogram* latencies)
 {
     int64_t clen;
     size_t outpart, part, sum = 0;
@@ -43,17 +70,14 @@ inline int64_t lzbench_compress(lzbench_params_t *params,
     compr_sizes.resize(cscount);
 
     for (int i = 0; i < cscount; i++) {
+        bench_timer_t chunk_start, chunk_end;
+        if (latencies) { GetTime(chunk_start); }
         part = chunk_sizes[i];
         outpart = GET_COMPRESS_BOUND(part);
         if (outpart > outsize) outpart = outsize;
 
-        const uint8_t* inptr = inbuf;
-        if (params->preprocessors.size() > 0) {
-            apply_preprocessors(params->preprocessors, inbuf, part, params->data_info.element_sz, tmpbuf);
-            inptr = (const uint8_t*)tmpbuf;
-        }
-
-        clen = compress((char*)inptr, part, (char*)outbuf, outpart, param1, param2, workmem);
+        clen = compress_preprocessed(params, compress, inbuf, part, tmpbuf,
+            outbuf, outpart, param1, param2, workmem);
         LZBENCH_PRINT(9, "ENC part=%d clen=%d in=%d\n", (int)part, (int)clen, (int)(inbuf-start));
 
         // if (clen <= 0 || clen == part)
@@ -69,6 +93,10 @@ inline int64_t lzbench_compress(lzbench_params_t *params,
         outsize -= clen;
         compr_sizes[i] = clen;
         sum += clen;
+        if (latencies) {
+            GetTime(chunk_end);
+            latencies->record(GetDiffTime(rate, chunk_start, chunk_end));
+        }
     }
     return sum;
 }
@@ -77,7 +105,8 @@ inline int64_t lzbench_compress(lzbench_params_t *params,
 inline int64_t lzbench_decompress(lzbench_params_t *params,
     std::vector<size_t>& chunk_sizes, const compressor_desc_t* desc,
     std::vector<size_t> &compr_sizes, const uint8_t *inbuf, uint8_t *outbuf,
-    uint8_t* tmpbuf, size_t param1, size_t param2, char* workmem)
+    uint8_t* tmpbuf, bench_rate_t rate, size_t param1, size_t param2,
+    char* workmem, LatencyHistogram* latencies)
 {
     int64_t dlen = 0;
     size_t part, sum = 0;
@@ -87,11 +116,19 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
 
     // bool has_preproc = params->preprocessors.size() > 0;
 
-    auto qparams = params->query_params;
     // bool already_materialized = strings_equal(desc->name, "materialized") &&
     //     qparams.type != QUERY_NONE;
     bool already_materialized = strings_equal(desc->name, "materialized");
 
+    // only bother timing each query if there's more than one
+    int nqueries = (int)params->query_batch.size();
+    bool time_queries = nqueries > 1;
+
+    // results get written into the same storage for every chunk, so that
+    // allocating them isn't part of the measured query time
+    static thread_local std::vector<QueryResult> query_results;
+    query_results.resize(nqueries);
+
     LZBENCH_PRINT(9, "---- Decompressing %d chunks\n", (int)chunk_sizes.size());
     for (int i = 0; i < chunk_sizes.size(); i++) {
         LZBENCH_PRINT(9, "Chunk %d: orig size, compressed size = %d, %d\n",
@@ -101,28 +138,32 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
     // printf("already_materialized? %d\n", (int)already_materialized);
 
     for (int i = 0; i < cscount; i++) {
+        // a chunk's latency includes running the queries on it
+        bench_timer_t chunk_start, chunk_end;
+        if (latencies) { GetTime(chunk_start); }
         part = compr_sizes[i];
 
         if (!already_materialized) {
             if (part == chunk_sizes[i]) { // uncompressed
                 memcpy(outbuf, inbuf, part);
                 dlen = part;
+                undo_preprocessors(params->preprocessors, outbuf, dlen,
+                    params->data_info.element_sz);
             } else {
                 LZBENCH_PRINT(9, "chunk %d: about to decompress\n", i);
-                dlen = decompress((char*)inbuf, part, (char*)outbuf,
-                    chunk_sizes[i], param1, param2, workmem);
+                dlen = decompress_preprocessed(params, decompress, inbuf,
+                    part, outbuf, chunk_sizes[i], tmpbuf, param1, param2,
+                    workmem);
             }
-            undo_preprocessors(params->preprocessors, outbuf, dlen,
-                params->data_info.element_sz);
         } else {
             // printf("already_materialized; skipping decomp, etc\n");
             dlen = part;
         }
         // printf("lzbench_decompress: undid preprocs!\n");
 
-        // run query if one is specified
-        if (qparams.type != QUERY_NONE) {
-            // printf("got query type: %d; about to run a query...\n", qparams.type);
+        // run each query while this chunk is still hot in cache, rather
+        // than decompressing it again for every query
+        for (int q = 0; q < nqueries; q++) {
             // auto& dinfo = params->data_info;
             DataInfo dinfo = params->data_info;
             if (dinfo.ncols < 1) {
@@ -134,34 +175,17 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
             // printf("dinfo nrows, ncols, size: %lu, %lu, %lu\n",
             //     dinfo.nrows, dinfo.ncols, dinfo.nrows * dinfo.ncols);
 
-            QueryResult result = run_query(
-                params->query_params, dinfo, outbuf);
+            bench_timer_t start_ticks, end_ticks;
+            if (time_queries) { GetTime(start_ticks); }
+            QueryResult& result = query_results[q];
+            run_query(params->query_batch[q], dinfo, outbuf, result);
+            if (time_queries) {
+                GetTime(end_ticks);
+                params->query_nanos[q] += GetDiffTime(rate, start_ticks, end_ticks);
+            }
             // printf("ran query type: %d\n", qparams.type);
             // printf("number of idxs in result: %lu\n", result.idxs.size());
 
-            // printf("got query type: %d, flattened window data: \n", qparams.type);
-            // for (auto val : qparams.window_data_dbl) {
-            //     printf("%g", (double)val);
-            // }
-            // printf("\nData in window shape:\n");
-            // for (int i = 0; i < qparams.window_nrows; i++) {
-            //     for (int j = 0; i < qparams.window_ncols; j++) {
-            //         auto idx = i * qparams.window_ncols + j;
-            //         printf("%g", qparams.window_data_dbl[idx]);
-            //     }
-            // }
-            // printf("\n");
-            // volatile QueryResult res;
-            // volatile vector<uint8_t> vals_u8;
-            // volatile vector<uint16_t> vals_u16;
-            // for (auto val : result.vals_u8) { vals_u8.push_back(val); }
-            // for (auto val : result.vals_u16) { vals_u16.push_back(val); }
-
-            // for (auto val : result.vals_u8) {
-            //     // volatile uint8_t x = val;
-            //     LZBENCH_PRINT(0, "%d ", (int)val);
-            // }
-
             // prevent compiler from optiming away query
             if (params->verbose > 999) {
                 printf("query u8 result: ");
@@ -170,12 +194,11 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
                 printf("query u16 result: ");
                 for (auto val : result.vals_u16) { printf("%d ", (int)val); }
                 printf("\n");
+                printf("query f64 result: ");
+                for (auto val : result.vals_f64) { printf("%g ", val); }
+                printf("\n");
             }
-            // for (auto val : result.vals_u8) { LZBENCH_PRINT(99, "%d ", (int)val); }
-            // for (auto val : result.vals_u16) { LZBENCH_PRINT(99, "%d ", (int)val); }
 
-            // res.vals_u8 = result.vals_u8;
-            // res.vals_u16 = result.vals_u16;
             LZBENCH_PRINT(4, "number of result values: %lu (u8) %lu (u16)\n",
                 result.vals_u8.size(), result.vals_u16.size());
         }
@@ -183,6 +206,10 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
         LZBENCH_PRINT(9, "chunk %d: DEC part=%d dlen=%d out=%d\n",
             i, (int)part, (int)dlen, (int)(outbuf - outstart));
         if (dlen <= 0) { return dlen; }
+        if (latencies) {
+            GetTime(chunk_end);
+            latencies->record(GetDiffTime(rate, chunk_start, chunk_end));
+        }
 
         inbuf += part;
         outbuf += dlen;
@@ -193,6 +220,66 @@ inline int64_t lzbench_decompress(lzbench_params_t *params,
 }
 
 
+// compresses and decompresses on the worker pool; with a thread sweep
+// (-T1..N), does so once for each number of threads, reusing the same input
+// and output buffers, and records each one's speeds for the scaling table
+static void lzbench_test_parallel(lzbench_params_t *params,
+    std::vector<size_t>& chunk_sizes, const compressor_desc_t* desc,
+    int level, const uint8_t *inbuf, size_t insize, uint8_t *compbuf,
+    size_t comprsize, uint8_t *decomp, uint8_t *tmpbuf, bench_rate_t rate,
+    size_t param1, size_t param2, char* workmem)
+{
+    int nthreads_arg = params->nthreads;
+    std::vector<int> thread_counts;
+    for (int n = nthreads_arg; n < params->nthreads_max; n *= 2) {
+        thread_counts.push_back(n);
+    }
+    thread_counts.push_back(std::max(nthreads_arg, params->nthreads_max));
+
+    std::string algname;
+    if (desc->first_level == 0 && desc->last_level==0)
+        format(algname, "%s %s", desc->name, desc->version);
+    else
+        format(algname, "%s %s -%d", desc->name, desc->version, level);
+
+    for (auto nthreads : thread_counts) {
+        params->nthreads = nthreads;
+        std::vector<uint64_t> ctime, dtime;
+        std::vector<size_t> compr_sizes;
+        ThreadStats comp_thread_stats;
+        params->comp_perf.clear();
+        params->decomp_perf.clear();
+        params->comp_latency.clear();
+        params->decomp_latency.clear();
+        params->comp_ci = params->decomp_ci = -1;
+
+        int64_t complen = parallel_comp(params, chunk_sizes, desc,
+            compr_sizes, inbuf, compbuf, comprsize, rate, ctime,
+            comp_thread_stats, param1, param2);
+        if (complen <= 0) { break; }
+
+        if (params->compress_only) {
+            print_stats(params, desc, level, ctime, dtime, insize, complen,
+                false);
+        } else {
+            params->query_nanos.assign(params->query_batch.size(), 0);
+            parallel_decomp(params, chunk_sizes, desc, compr_sizes, compbuf,
+                decomp, tmpbuf, rate, ctime, param1, param2, workmem);
+        }
+        print_thread_stats(params, "compr.", comp_thread_stats.sizes,
+            comp_thread_stats.nanos, comp_thread_stats.cpus);
+
+        if (params->nthreads_max > 0) {
+            auto& row = params->results.back();
+            params->scaling_results.push_back(scaling_table_t(algname,
+                nthreads, row.col2_ctime, row.col3_dtime, row.col5_origsize,
+                row.col6_filename));
+        }
+    }
+    params->nthreads = nthreads_arg;
+}
+
+
 void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
     const compressor_desc_t* desc, int level, const uint8_t *inbuf,
     size_t insize, uint8_t *compbuf, size_t comprsize, uint8_t *decomp,
@@ -209,6 +296,22 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
     char* workmem = NULL;
     size_t param2 = desc->additional_param;
     size_t chunk_size = (params->chunk_size > insize) ? insize : params->chunk_size;
+    PerfCounters comp_counters(params->perf_counters != 0);
+    PerfCounters decomp_counters(params->perf_counters != 0);
+    params->comp_perf.clear();
+    params->decomp_perf.clear();
+    params->comp_latency.clear();
+    params->decomp_latency.clear();
+    params->comp_ci = params->decomp_ci = -1;
+    bool adaptive = params->stable_pct > 0;
+    StoppingRule comp_rule(params->stable_pct, params->stable_max_secs,
+        params->timetype);
+    StoppingRule decomp_rule(params->stable_pct, params->stable_max_secs,
+        params->timetype);
+    LatencyHistogram* comp_latencies =
+        params->latency ? &params->comp_latency : NULL;
+    LatencyHistogram* decomp_latencies =
+        params->latency ? &params->decomp_latency : NULL;
 
     uint8_t* tmpbuf = alloc_data_buffer(GET_COMPRESS_BOUND(insize));
     // printf("allocated tmpbuf of size: %d\n", (int)GET_COMPRESS_BOUND(insize));
@@ -254,6 +357,13 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
     // printf("%s using %d chunks\n", desc->name, (int)chunk_sizes.size());
     // printf("chunk sizes: "); for (auto sz : chunk_sizes) { printf("%d ", int(sz)); } printf("\n");
 
+    // with -T, compression and decompression both run on the worker pool
+    if (params->nthreads > 0) {
+        lzbench_test_parallel(params, chunk_sizes, desc, level, inbuf, insize,
+            compbuf, comprsize, decomp, tmpbuf, rate, param1, param2, workmem);
+        goto done;
+    }
+
     // compress the data until we hit either the minimum time or the minimum
     // number of iterations
     total_c_iters = 0;
@@ -263,10 +373,13 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
         uni_sleep(1); // give processor to other processes
         GetTime(loop_ticks);
         do {
+            comp_counters.start();
             GetTime(start_ticks);
             complen = lzbench_compress(params, chunk_sizes, desc->compress,
-                compr_sizes, inbuf, compbuf, tmpbuf, comprsize, param1, param2, workmem);
+                compr_sizes, inbuf, compbuf, tmpbuf, comprsize, rate, param1,
+                param2, workmem, comp_latencies);
             GetTime(end_ticks);
+            comp_counters.stop(insize);
             nanosec = GetDiffTime(rate, start_ticks, end_ticks);
             if (nanosec >= 10000) { ctime.push_back(nanosec); }
             i++;
@@ -285,23 +398,28 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
 
         total_nanosec = GetDiffTime(rate, timer_ticks, end_ticks);
         total_c_iters += i;
-        if ((total_c_iters >= params->c_iters) && (total_nanosec > ((uint64_t)params->cmintime*1000000))) break;
+        if (adaptive) {
+            if (comp_rule.add(nanosec/i, total_nanosec) && total_c_iters >= params->c_iters) break;
+        } else if ((total_c_iters >= params->c_iters) && (total_nanosec > ((uint64_t)params->cmintime*1000000))) break;
         LZBENCH_PRINT(2, "%s compr iter=%d time=%.2fs speed=%.2f MB/s     \r", desc->name, total_c_iters, total_nanosec/1000000000.0, speed);
     } while (true);
 
+    // with -A, only what was timed after warming up counts
+    if (adaptive) {
+        LZBENCH_PRINT(3, "%s compr: %d warm-up iters, +-%.2f%% with %d more\n",
+            desc->name, (int)comp_rule.warmup(), 100 * comp_rule.ci(),
+            (int)comp_rule.steady_samples().size());
+        ctime = comp_rule.steady_samples();
+        params->comp_ci = comp_rule.ci();
+    }
+
     // decompress the data until we hit either the minimum time or the minimum
     // number of iterations; we reuse the data in compbuf written by the final
     // iteration of the compression
     total_d_iters = 0;
+    params->query_nanos.assign(params->query_batch.size(), 0);
     GetTime(timer_ticks);
 
-    if (!params->compress_only && params->nthreads > 0) {
-        parallel_decomp(params, chunk_sizes,
-                desc, compr_sizes, compbuf, decomp, tmpbuf, rate, ctime,
-                param1, param2, workmem);
-        return;
-    }
-
     if (!params->compress_only)
     do {
         i = 0;
@@ -344,11 +462,13 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
 
         GetTime(loop_ticks);
         do {
+            decomp_counters.start();
             GetTime(start_ticks);
             decomplen = lzbench_decompress(params, chunk_sizes,
-                desc, compr_sizes, compbuf, decomp, tmpbuf, param1,
-                param2, workmem);
+                desc, compr_sizes, compbuf, decomp, tmpbuf, rate, param1,
+                param2, workmem, decomp_latencies);
             GetTime(end_ticks);
+            decomp_counters.stop(insize);
             nanosec = GetDiffTime(rate, start_ticks, end_ticks);
             if (nanosec >= 10000) dtime.push_back(nanosec);
             i++;
@@ -427,19 +547,114 @@ void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
             desc->name, insize, total_d_iters, time_secs, thruput);
 
         bool done = total_d_iters >= params->d_iters;
-        done = done && (total_nanosec > ((uint64_t)params->dmintime*1000*1000));
+        if (adaptive) {
+            done = decomp_rule.add(nanosec/i, total_nanosec) && done;
+        } else {
+            done = done && (total_nanosec > ((uint64_t)params->dmintime*1000*1000));
+        }
         if (done) { break; }
 
     } while (true);
 
+    // with -K, time (de)compression again with everything it reads or writes
+    // starting out in DRAM, as it would be for a block nobody has touched
+    // lately, instead of in whatever level of cache the last iteration left
+    // it in
+    params->cold_ctime.clear();
+    params->cold_dtime.clear();
+    if (params->cold_cache) {
+        size_t tmpsize = GET_COMPRESS_BOUND(insize);
+        for (uint32_t it = 0; it < std::max(params->c_iters, 5u); it++) {
+            evict_from_cache(inbuf, insize);
+            evict_from_cache(compbuf, comprsize);
+            evict_from_cache(tmpbuf, tmpsize);
+            GetTime(start_ticks);
+            lzbench_compress(params, chunk_sizes, desc->compress,
+                compr_sizes, inbuf, compbuf, tmpbuf, comprsize, rate, param1,
+                param2, workmem, NULL);
+            GetTime(end_ticks);
+            params->cold_ctime.push_back(GetDiffTime(rate, start_ticks, end_ticks));
+        }
+        // the query times get divided by the number of hot iterations, so
+        // the queries run by the cold ones mustn't add to them
+        std::vector<uint64_t> hot_query_nanos = params->query_nanos;
+        for (uint32_t it = 0; !params->compress_only && !decomp_error &&
+                it < std::max(params->d_iters, 5u); it++) {
+            evict_from_cache(compbuf, complen);
+            evict_from_cache(decomp, insize);
+            evict_from_cache(tmpbuf, tmpsize);
+            GetTime(start_ticks);
+            lzbench_decompress(params, chunk_sizes, desc, compr_sizes,
+                compbuf, decomp, tmpbuf, rate, param1, param2, workmem, NULL);
+            GetTime(end_ticks);
+            params->cold_dtime.push_back(GetDiffTime(rate, start_ticks, end_ticks));
+        }
+        params->query_nanos = hot_query_nanos;
+    }
+
+    if (adaptive && !params->compress_only && !decomp_error) {
+        LZBENCH_PRINT(3, "%s decompr: %d warm-up iters, +-%.2f%% with %d more\n",
+            desc->name, (int)decomp_rule.warmup(), 100 * decomp_rule.ci(),
+            (int)decomp_rule.steady_samples().size());
+        dtime = decomp_rule.steady_samples();
+        params->decomp_ci = decomp_rule.ci();
+    }
+    params->comp_perf = comp_counters.counts;
+    params->decomp_perf = decomp_counters.counts;
     print_stats(params, desc, level, ctime, dtime, insize,
         complen, decomp_error);
+    print_query_batch_stats(params, insize, total_d_iters);
 
 done:
     if (desc->deinit) desc->deinit(workmem);
 }
 
 
+// with a block size sweep (-b4..16384), runs lzbench_test once for each
+// power of two block size on the same, already loaded, input and records
+// how each one did for the block size table; block sizes past the size of
+// the input or the codec's max_block_size would just repeat the last run,
+// so the sweep stops there
+static void lzbench_test_block_sizes(lzbench_params_t *params,
+    std::vector<size_t> &file_sizes, const compressor_desc_t* desc, int level,
+    const uint8_t *inbuf, size_t insize, uint8_t *compbuf, size_t comprsize,
+    uint8_t *decomp, bench_rate_t rate, size_t param1)
+{
+    if (params->chunk_size_max == 0) {
+        lzbench_test(params, file_sizes, desc, level, inbuf, insize, compbuf,
+            comprsize, decomp, rate, param1);
+        return;
+    }
+
+    std::string algname;
+    if (desc->first_level == 0 && desc->last_level==0)
+        format(algname, "%s %s", desc->name, desc->version);
+    else
+        format(algname, "%s %s -%d", desc->name, desc->version, level);
+
+    size_t chunk_size_arg = params->chunk_size;
+    for (size_t size = chunk_size_arg; size <= params->chunk_size_max;
+            size *= 2) {
+        size_t chunk_size = MIN(size, insize);
+        if (desc->max_block_size != 0 && chunk_size > desc->max_block_size) {
+            chunk_size = desc->max_block_size;
+        }
+        params->chunk_size = chunk_size;
+        size_t nresults = params->results.size();
+        lzbench_test(params, file_sizes, desc, level, inbuf, insize, compbuf,
+            comprsize, decomp, rate, param1);
+        if (params->results.size() > nresults) {
+            auto& row = params->results.back();
+            params->block_size_results.push_back(block_size_table_t(algname,
+                chunk_size, row.col2_ctime, row.col3_dtime,
+                row.col4_comprsize, row.col5_origsize, row.col6_filename));
+        }
+        if (chunk_size < size) { break; }
+    }
+    params->chunk_size = chunk_size_arg;
+}
+
+
 void lzbench_test_with_params(lzbench_params_t *params,
     std::vector<size_t> &file_sizes, const char *namesWithParams,
     uint8_t *inbuf, size_t insize, uint8_t *compbuf, size_t comprsize,
@@ -449,6 +664,15 @@ void lzbench_test_with_params(lzbench_params_t *params,
 
 	if (!namesWithParams) { return; }
 
+    // -aauto searches every codec, or with -aauto:zstd/lz4 just those
+    if (!strncmp(namesWithParams, "auto", 4)) {
+        const char* candidates = namesWithParams[4] == ':' ?
+            namesWithParams + 5 : "all";
+        lzbench_advise(params, file_sizes, candidates, inbuf, insize,
+            compbuf, comprsize, decomp, rate);
+        return;
+    }
+
     cnames = split(namesWithParams, '/');
 
     for (int k=0; k<cnames.size(); k++) {
@@ -478,13 +702,14 @@ void lzbench_test_with_params(lzbench_params_t *params,
                             for (int level=comp_desc[i].first_level;
                                     level<=comp_desc[i].last_level; level++)
                             {
-                                lzbench_test(params, file_sizes, &comp_desc[i],
-                                    level, inbuf, insize, compbuf, comprsize,
-                                    decomp, rate, level);
+                                lzbench_test_block_sizes(params, file_sizes,
+                                    &comp_desc[i], level, inbuf, insize,
+                                    compbuf, comprsize, decomp, rate, level);
                             }
                         } else {
-                            lzbench_test(params, file_sizes, &comp_desc[i],
-                                atoi(cparams[j].c_str()), inbuf, insize,
+                            lzbench_test_block_sizes(params, file_sizes,
+                                &comp_desc[i], atoi(cparams[j].c_str()),
+                                inbuf, insize,
                                 compbuf, comprsize, decomp, rate,
                                 atoi(cparams[j].c_str()));
                         }
@@ -504,12 +729,199 @@ next_k:
 }
 
 
+// with -M2, the buffers for compressed and decompressed data come from huge
+// pages, so that decoding big inputs doesn't spend its time on TLB misses
+static uint8_t* alloc_output_buffer(lzbench_params_t* params, size_t size) {
+#ifdef UTIL_HAS_MMAP
+    if (params->mmap_mode >= MMAP_HUGE_BUFFERS) {
+        return alloc_huge_data_buffer(size);
+    }
+#endif
+    return alloc_data_buffer(size);
+}
+
+static void free_output_buffer(lzbench_params_t* params, uint8_t* buf,
+    size_t size)
+{
+    if (!buf) { return; }
+#ifdef UTIL_HAS_MMAP
+    if (params->mmap_mode >= MMAP_HUGE_BUFFERS) {
+        unmap_data_buffer(buf, size);
+        return;
+    }
+#endif
+    free_data_buffer(buf);
+}
+
+static uint64_t print_load_time(lzbench_params_t* params,
+    const char* filename, size_t insize, bench_rate_t rate,
+    bench_timer_t start_ticks)
+{
+    bench_timer_t end_ticks;
+    GetTime(end_ticks);
+    uint64_t nanos = GetDiffTime(rate, start_ticks, end_ticks);
+    double secs = nanos / 1e9;
+    LZBENCH_PRINT(3, "loaded %s (%.1f MB) in %.3f s (%.0f MB/s)\n", filename,
+        insize / 1e6, secs, secs > 0 ? insize / 1e6 / secs : -1.);
+    return nanos;
+}
+
+// the -m path with a second value (e.g., -m512,2): while one part gets
+// benchmarked, a reader thread loads up to nbuffers-1 of the parts after
+// it, so reading overlaps with compute the way it would when reprocessing
+// an archive. The first part is already in inbuf, having taken
+// first_load_nanos to load. Prints the end-to-end throughput, I/O
+// included, once every part is done.
+static void lzbench_stream_parts(lzbench_params_t* params, FILE* in,
+    size_t real_insize, uint8_t* inbuf, size_t insize,
+    uint64_t first_load_nanos, bool map_input, size_t data_buf_size,
+    const char* encoder_list, uint8_t* compbuf, size_t comprsize,
+    uint8_t* decomp, bench_rate_t rate)
+{
+    typedef struct Part { uint8_t* buf; size_t size; } Part;
+
+    int nbuffers = params->mem_nbuffers;
+    size_t part_size = insize;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Part> ready;
+    std::vector<uint8_t*> free_bufs, all_bufs;
+    int nmapped = 0; // parts mapped by the reader but not yet benchmarked
+    bool done_reading = false;
+    uint64_t read_nanos = first_load_nanos;
+
+    if (!map_input) {
+        for (int b = 1; b < nbuffers; b++) {
+            uint8_t* buf = alloc_data_buffer(data_buf_size);
+            if (!buf) {
+                printf("Not enough memory; please use a smaller -m!");
+                exit(1);
+            }
+            free_bufs.push_back(buf);
+            all_bufs.push_back(buf);
+        }
+    }
+
+    bench_timer_t start_ticks, end_ticks;
+    GetTime(start_ticks);
+
+    std::thread reader([&] {
+        size_t pos = insize;
+        while (pos < real_insize) {
+            uint8_t* buf = NULL;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&] { return map_input ?
+                    nmapped < nbuffers - 1 : !free_bufs.empty(); });
+                if (map_input) {
+                    nmapped++;
+                } else {
+                    buf = free_bufs.back();
+                    free_bufs.pop_back();
+                }
+            }
+            bench_timer_t t_start, t_end;
+            GetTime(t_start);
+            size_t size = MIN(part_size, real_insize - pos);
+#ifdef UTIL_HAS_MMAP
+            if (map_input) {
+                buf = map_file_data_buffer(in, pos, size,
+                    data_buf_size - size);
+            } else
+#endif
+            size = fread(buf, 1, size, in);
+            GetTime(t_end);
+            read_nanos += GetDiffTime(rate, t_start, t_end);
+            pos += size;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ready.push_back(Part{buf, size});
+            }
+            cv.notify_all();
+            if (!buf || size == 0) { break; }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done_reading = true;
+        }
+        cv.notify_all();
+    });
+
+    std::vector<size_t> file_sizes;
+    std::string partname;
+    const char* filename = params->in_filename;
+    uint64_t wait_nanos = 0;
+    size_t total_insize = 0;
+    Part part = Part{inbuf, insize};
+    int nparts = 0;
+    bool ran_out = false; // every part got benchmarked and released
+    while (part.buf && part.size > 0) {
+        nparts++;
+        format(partname, "%s part %d", filename, nparts);
+        params->in_filename = partname.c_str();
+        file_sizes.push_back(part.size);
+        lzbench_test_with_params(params, file_sizes, encoder_list,
+            part.buf, part.size, compbuf, comprsize, decomp, rate);
+        file_sizes.clear();
+        total_insize += part.size;
+
+        // the caller owns inbuf; everything else goes back to the reader
+        bench_timer_t wait_start, wait_end;
+        GetTime(wait_start);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (map_input && part.buf != inbuf) {
+#ifdef UTIL_HAS_MMAP
+                unmap_data_buffer(part.buf, data_buf_size);
+#endif
+                nmapped--;
+            } else if (!map_input) {
+                free_bufs.push_back(part.buf);
+            }
+            cv.notify_all();
+            cv.wait(lock, [&] { return !ready.empty() || done_reading; });
+            if (ready.empty()) { ran_out = true; break; }
+            part = ready.front();
+            ready.pop_front();
+        }
+        GetTime(wait_end);
+        wait_nanos += GetDiffTime(rate, wait_start, wait_end);
+    }
+    reader.join();
+    GetTime(end_ticks);
+
+    // unless the input ran out, the loop stopped at a part it didn't
+    // benchmark: one that failed to map, or an empty last read, which
+    // still has to be released
+    if (!ran_out && !part.buf) {
+        printf("ERROR: couldn't map part %d of %s\n", nparts + 1, filename);
+        exit(1);
+    }
+#ifdef UTIL_HAS_MMAP
+    if (!ran_out && map_input && part.buf != inbuf) {
+        unmap_data_buffer(part.buf, data_buf_size);
+    }
+#endif
+    for (auto buf : all_bufs) { free_data_buffer(buf); }
+    params->in_filename = filename;
+
+    uint64_t total_nanos = first_load_nanos +
+        GetDiffTime(rate, start_ticks, end_ticks);
+    LZBENCH_PRINT(2, "%s: %d parts, %.1f MB in %.2f s end to end = %.2f MB/s "
+        "including I/O (%.2f s spent reading, %.2f s of it waited for)\n",
+        filename, nparts, total_insize / 1e6, total_nanos / 1e9,
+        total_nanos > 0 ? total_insize * 1000. / total_nanos : -1.,
+        read_nanos / 1e9, (first_load_nanos + wait_nanos) / 1e9);
+}
+
+
 int lzbench_join(lzbench_params_t* params, const char** inFileNames,
     unsigned ifnIdx, char* encoder_list)
 {
     bench_rate_t rate;
-    size_t comprsize, insize, inpos, totalsize;//, aligned_totalsize;
+    size_t comprsize, insize, inpos, totalsize, data_buf_size;
     uint8_t *inbuf, *compbuf, *decomp;
+    bench_timer_t load_ticks;
     std::vector<size_t> file_sizes;
     std::string text;
     FILE* in;
@@ -521,19 +933,28 @@ int lzbench_join(lzbench_params_t* params, const char** inFileNames,
         return 1;
     }
 
-    size_t data_buf_size = totalsize + PAD_SIZE + (ALIGN_BYTES * ifnIdx);
+    InitTimer(rate);
+    GetTime(load_ticks);
+
+    // files can't be mapped back to back at ALIGN_BYTES boundaries, so with
+    // -M they just get read into huge pages
+    data_buf_size = totalsize + PAD_SIZE + (ALIGN_BYTES * ifnIdx);
     comprsize = GET_COMPRESS_BOUND(totalsize) + (ALIGN_BYTES * ifnIdx);
+#ifdef UTIL_HAS_MMAP
+    if (params->mmap_mode != MMAP_NONE) {
+        inbuf = alloc_huge_data_buffer(data_buf_size);
+    } else
+#endif
     inbuf = alloc_data_buffer(data_buf_size);
-    compbuf = alloc_data_buffer(comprsize);
+    compbuf = alloc_output_buffer(params, comprsize);
     // tmpbuf = alloc_data_buffer(data_buf_size);  // for preprocessing
-    decomp = alloc_data_buffer(data_buf_size);
+    decomp = alloc_output_buffer(params, data_buf_size);
 
     if (!inbuf || !compbuf || !decomp) {
         printf("Not enough memory, please use -m option!\n");
         return 1;
     }
 
-    InitTimer(rate);
     inpos = 0;
 
     for (int i=0; i<ifnIdx; i++) {
@@ -572,6 +993,7 @@ int lzbench_join(lzbench_params_t* params, const char** inFileNames,
 
     LZBENCH_PRINT(5, "totalsize=%d inpos=%d\n", (int)totalsize, (int)inpos);
     totalsize = inpos;
+    print_load_time(params, params->in_filename, totalsize, rate, load_ticks);
 
     {
         std::vector<size_t> single_file;
@@ -588,9 +1010,14 @@ int lzbench_join(lzbench_params_t* params, const char** inFileNames,
     lzbench_test_with_params(params, file_sizes, encoder_list?encoder_list:alias_desc[0].params, inbuf, totalsize, compbuf, comprsize, decomp, rate);
 
 _clean:
+#ifdef UTIL_HAS_MMAP
+    if (params->mmap_mode != MMAP_NONE) {
+        unmap_data_buffer(inbuf, data_buf_size);
+    } else
+#endif
     free_data_buffer(inbuf);
-    free_data_buffer(compbuf);
-    free_data_buffer(decomp);
+    free_output_buffer(params, compbuf, comprsize);
+    free_output_buffer(params, decomp, data_buf_size);
 
     return 0;
 }
@@ -630,19 +1057,28 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
             real_insize > params->mem_limit;
         insize = limit_mem ? params->mem_limit : real_insize;
 
+        bench_timer_t load_ticks;
+        GetTime(load_ticks);
+
+        // with -M, the input is mapped straight from the file instead of
+        // being copied into a buffer of its own
+        bool map_input = false;
+#ifdef UTIL_HAS_MMAP
+        map_input = params->mmap_mode != MMAP_NONE;
+#endif
         comprsize = GET_COMPRESS_BOUND(insize) + ALIGN_BYTES;
         size_t data_buf_size = insize + PAD_SIZE + ALIGN_BYTES;
-        inbuf = alloc_data_buffer(data_buf_size);
-        compbuf = alloc_data_buffer(comprsize);
-        decomp = alloc_data_buffer(data_buf_size);
+        inbuf = map_input ? NULL : alloc_data_buffer(data_buf_size);
+        compbuf = alloc_output_buffer(params, comprsize);
+        decomp = alloc_output_buffer(params, data_buf_size);
 
-        if (!inbuf || !compbuf || !decomp) {
+        if ((!inbuf && !map_input) || !compbuf || !decomp) {
             printf("Not enough memory; please use -m option!");
             return 1;
         }
 
+        long long unsigned pos = 0;
         if(params->random_read) {
-          long long unsigned pos = 0;
           if (params->chunk_size < real_insize){
             pos = (rand() % (real_insize / params->chunk_size)) * params->chunk_size;
             insize = params->chunk_size;
@@ -653,7 +1089,19 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
           printf("Seeking to: %llu %ld %ld\n", pos, (long)params->chunk_size, (long)insize);
         }
 
+#ifdef UTIL_HAS_MMAP
+        if (map_input) {
+            insize = MIN(insize, real_insize - pos);
+            inbuf = map_file_data_buffer(in, pos, insize, data_buf_size - insize);
+            if (!inbuf) {
+                perror(inFileNames[i]);
+                return 1;
+            }
+        } else
+#endif
         insize = fread(inbuf, 1, insize, in);
+        uint64_t load_nanos = print_load_time(params, params->in_filename,
+            insize, rate, load_ticks);
 
         // always run a memcpy first as a baseline
         if (i == 0) {
@@ -669,7 +1117,13 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
         }
 
         // if memory limit is set, split input into chunks
-        if (params->mem_limit && real_insize > params->mem_limit) {
+        if (params->mem_limit && real_insize > params->mem_limit &&
+                params->mem_nbuffers > 1) {
+            lzbench_stream_parts(params, in, real_insize, inbuf, insize,
+                load_nanos, map_input, data_buf_size,
+                encoder_list ? encoder_list : alias_desc[0].params,
+                compbuf, comprsize, decomp, rate);
+        } else if (params->mem_limit && real_insize > params->mem_limit) {
             int i;
             std::string partname;
             const char* filename = params->in_filename;
@@ -681,6 +1135,20 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
                     encoder_list ? encoder_list : alias_desc[0].params,
                     inbuf, insize, compbuf, comprsize, decomp, rate);
                 file_sizes.clear();
+#ifdef UTIL_HAS_MMAP
+                if (map_input) {
+                    unmap_data_buffer(inbuf, data_buf_size);
+                    pos += insize;
+                    insize = MIN(insize, real_insize - pos);
+                    inbuf = map_file_data_buffer(in, pos, insize,
+                        data_buf_size - insize);
+                    if (!inbuf) {
+                        perror(filename);
+                        return 1;
+                    }
+                    continue;
+                }
+#endif
                 insize = fread(inbuf, 1, insize, in);
             }
         } else {
@@ -692,9 +1160,14 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
         }
 
         fclose(in);
+#ifdef UTIL_HAS_MMAP
+        if (map_input) {
+            unmap_data_buffer(inbuf, data_buf_size);
+        } else
+#endif
         free_data_buffer(inbuf);
-        free_data_buffer(compbuf);
-        free_data_buffer(decomp);
+        free_output_buffer(params, compbuf, comprsize);
+        free_output_buffer(params, decomp, data_buf_size);
     }
 
     return 0;
@@ -5,11 +5,14 @@
 #define _FILE_OFFSET_BITS 64  // turn off_t into a 64-bit type for ftello() and fseeko()
 
 #include <stdint.h>
+#include <stdio.h>
 #include <string>
 #include <vector>
 
 #include "compressors.h"
 #include "lizard/lizard_compress.h"    // LIZARD_MAX_CLEVEL
+#include "latency_histogram.h"
+#include "perf_counters.h"
 #include "query_common.h"
 
 #define PROGNAME "lzbench"
@@ -90,12 +93,41 @@ typedef struct string_table
     std::string col1_algname;
     uint64_t col2_ctime, col3_dtime, col4_comprsize, col5_origsize;
     std::string col6_filename;
+    perf_counts_t cperf, dperf; // only filled in with -P
+    latency_summary_t clat, dlat; // only filled in with -L
+    std::string json; // the whole result as one JSON object, for -o7
+    std::vector<uint64_t> ctimes, dtimes; // every timing sample
+    double cci = -1, dci = -1; // relative confidence intervals, with -A
+    uint64_t cold_ctime = 0, cold_dtime = 0; // with caches flushed, with -K
     string_table(std::string c1, uint64_t c2, uint64_t c3, uint64_t c4, uint64_t c5, std::string filename) : col1_algname(c1), col2_ctime(c2), col3_dtime(c3), col4_comprsize(c4), col5_origsize(c5), col6_filename(filename) {}
 } string_table_t;
 
-enum textformat_e { MARKDOWN=1, TEXT, TEXT_FULL, CSV, TURBOBENCH, MARKDOWN2 };
+// speeds of one codec and level at one point in a thread sweep (-T1..N)
+typedef struct scaling_table
+{
+    std::string col1_algname;
+    int nthreads;
+    uint64_t ctime, dtime, origsize;
+    std::string filename;
+    scaling_table(std::string algname, int nthreads, uint64_t ctime, uint64_t dtime, uint64_t origsize, std::string filename) : col1_algname(algname), nthreads(nthreads), ctime(ctime), dtime(dtime), origsize(origsize), filename(filename) {}
+} scaling_table_t;
+
+// one codec and level at one point in a block size sweep (-b4..16384)
+typedef struct block_size_table
+{
+    std::string col1_algname;
+    size_t chunk_size;
+    uint64_t ctime, dtime, comprsize, origsize;
+    std::string filename;
+    block_size_table(std::string algname, size_t chunk_size, uint64_t ctime, uint64_t dtime, uint64_t comprsize, uint64_t origsize, std::string filename) : col1_algname(algname), chunk_size(chunk_size), ctime(ctime), dtime(dtime), comprsize(comprsize), origsize(origsize), filename(filename) {}
+} block_size_table_t;
+
+enum textformat_e { MARKDOWN=1, TEXT, TEXT_FULL, CSV, TURBOBENCH, MARKDOWN2, JSON_LINES };
 enum timetype_e { FASTEST=1, AVERAGE, MEDIAN };
-enum preprocessor_e { DELTA = 1, DELTA2 = 2, DELTA3 = 3, DELTA4 = 4};
+enum preprocessor_e { DELTA = 1, DELTA2 = 2, DELTA3 = 3, DELTA4 = 4,
+    BYTESHUFFLE = 1 << 30, BITSHUFFLE = (1 << 30) + 1 };
+enum pin_mode_e { PIN_NONE = 0, PIN_COMPACT = 1, PIN_SPREAD = 2 };
+enum mmap_mode_e { MMAP_NONE = 0, MMAP_INPUT = 1, MMAP_HUGE_BUFFERS = 2 };
 
 
 class lzbench_params_t {
@@ -104,16 +136,39 @@ public:
     timetype_e timetype;
     textformat_e textformat;
     size_t chunk_size;
+    size_t chunk_size_max; // > 0 to sweep from chunk_size up to this (-b#..#)
     uint32_t c_iters, d_iters, cspeed, verbose, cmintime, dmintime, cloop_time, dloop_time;
+    uint32_t dspeed; // min decompression speed for -aauto to recommend (-s#,#)
     size_t mem_limit;
+    int mem_nbuffers; // > 1 to read parts ahead while benchmarking (-m#,#)
     int random_read;
     std::vector<string_table_t> results;
     std::vector<int64_t> preprocessors;
     const char* in_filename;
     // int element_sz;
     QueryParams query_params;
+    // every query to run on each decompressed chunk (-q given several
+    // times), and the total time spent in each one
+    std::vector<QueryParams> query_batch;
+    std::vector<uint64_t> query_nanos;
     DataInfo data_info;
     int nthreads;
+    int nthreads_max; // > 0 to sweep from nthreads up to this many threads
+    int pin_threads; // a pin_mode_e; where to run each of the nthreads
+    int mmap_mode; // a mmap_mode_e; how to load the input and allocate buffers
+    int perf_counters; // nonzero to count cycles, cache misses, etc (-P)
+    perf_counts_t comp_perf, decomp_perf; // of the run being printed
+    int latency; // nonzero to time each chunk (-L)
+    FILE* latency_dump; // where to write the raw histograms, if anywhere (-H)
+    LatencyHistogram comp_latency, decomp_latency; // of the run being printed
+    int regression_pct; // how much worse than the baseline is a regression (-G)
+    int stable_pct, stable_max_secs; // run until stable to within this (-A)
+    double comp_ci, decomp_ci; // of the run being printed, with -A
+    int cold_cache; // nonzero to also time with the data evicted from cache (-K)
+    size_t tile_size; // > 0 to preprocess and (de)compress in tiles this big (-F)
+    std::vector<uint64_t> cold_ctime, cold_dtime; // of the run being printed
+    std::vector<scaling_table_t> scaling_results;
+    std::vector<block_size_table_t> block_size_results;
     bool unverified;
 
     lzbench_params_t(const lzbench_params_t &) = default;
@@ -155,7 +210,7 @@ typedef struct
     {NAME, "2017-9", 0, 0, 0, 0, lzbench_ ## FUNCNAME ## _compress, lzbench_ ## FUNCNAME ## _decompress, NULL, NULL}
 
 
-#define LZBENCH_COMPRESSOR_COUNT 116
+#define LZBENCH_COMPRESSOR_COUNT 128
 
 static const compressor_desc_t comp_desc[LZBENCH_COMPRESSOR_COUNT] =
 {
@@ -280,6 +335,18 @@ static const compressor_desc_t comp_desc[LZBENCH_COMPRESSOR_COUNT] =
     // pushed-down query functions; must be run with -U since they don't write out decompressed data
     { "sprintzDeltaQuery0_8b", "0.0", 1,128,0,80<<10, lzbench_sprintz_delta_compress,  lzbench_sprintz_delta_query0_8b,      NULL,       NULL },
     { "sprintzXffQuery0_16b",  "0.0", 1,128,0,80<<10, lzbench_sprintz_xff_compress_16b,  lzbench_sprintz_xff_query1_16b,    NULL,       NULL },
+    { "sprintzDeltaCorr_8b",   "0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress, lzbench_sprintz_delta_corr_8b,        NULL,       NULL },
+    { "sprintzXffCorr_16b",    "0.0", 1,128,0,80<<10, lzbench_sprintz_row_xff_rle_compress_16b, lzbench_sprintz_xff_corr_16b,      NULL,       NULL },
+    { "sprintzDeltaBounds_8b", "0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress, lzbench_sprintz_delta_bounds_8b,      NULL,       NULL },
+    { "sprintzDeltaBounds_16b","0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress_16b, lzbench_sprintz_delta_bounds_16b, NULL,       NULL },
+    { "sprintzDeltaBuckets_8b", "0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress, lzbench_sprintz_delta_buckets_8b,    NULL,       NULL },
+    { "sprintzXffBuckets_8b",   "0.0", 1,128,0,80<<10, lzbench_sprintz_row_xff_rle_compress, lzbench_sprintz_xff_buckets_8b,        NULL,       NULL },
+    { "sprintzDeltaBuckets_16b","0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress_16b, lzbench_sprintz_delta_buckets_16b, NULL,      NULL },
+    { "sprintzXffBuckets_16b",  "0.0", 1,128,0,80<<10, lzbench_sprintz_row_xff_rle_compress_16b, lzbench_sprintz_xff_buckets_16b,     NULL,       NULL },
+    { "sprintzDeltaHist_8b",   "0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress, lzbench_sprintz_delta_hist_8b,        NULL,       NULL },
+    { "sprintzXffHist_8b",     "0.0", 1,128,0,80<<10, lzbench_sprintz_row_xff_rle_compress, lzbench_sprintz_xff_hist_8b,            NULL,       NULL },
+    { "sprintzDeltaHist_16b",  "0.0", 1,128,0,80<<10, lzbench_sprintz_row_delta_rle_compress_16b, lzbench_sprintz_delta_hist_16b,   NULL,       NULL },
+    { "sprintzXffHist_16b",    "0.0", 1,128,0,80<<10, lzbench_sprintz_row_xff_rle_compress_16b, lzbench_sprintz_xff_hist_16b,       NULL,       NULL },
     // NOTE: the following 2 codecs are unsafe and should only be used for speed profiling
     { "sprFixedBitpack", "0.0", 1, 8,   0,       0, lzbench_fixed_bitpack_compress,  lzbench_fixed_bitpack_decompress,              NULL,       NULL }, // input bytes must all be <= 1
     { "sprJustBitpack",  "0.0", 0, 0,   0,       0, lzbench_just_bitpack_compress,   lzbench_just_bitpack_decompress,               NULL,       NULL }, // input bytes must all be <= 15
@@ -328,5 +395,11 @@ int lzbench_main(lzbench_params_t* params, const char** inFileNames,
 int lzbench_join(lzbench_params_t* params, const char** inFileNames,
     unsigned ifnIdx, char* encoder_list);
 
+// used by advisor.cpp
+void lzbench_test(lzbench_params_t *params, std::vector<size_t> &file_sizes,
+    const compressor_desc_t* desc, int level, const uint8_t *inbuf,
+    size_t insize, uint8_t *compbuf, size_t comprsize, uint8_t *decomp,
+    bench_rate_t rate, size_t param1);
+
 
 #endif
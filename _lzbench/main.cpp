@@ -1,8 +1,10 @@
 
 
 #include "lzbench.h"
+#include "baseline.h"
 #include "output.h"
 #include "util.h"
+#include <thread> // hardware_concurrency
 
 void usage(lzbench_params_t* params) {
     // fprintf(stderr, "usage: " PROGNAME " [options] input [input2] [input3]\n\nwhere [input] is a file or a directory and [options] are:\n");
@@ -51,6 +53,11 @@ int main(int argc, char** argv) {
     const char** inFileNames = (const char**) calloc(argc, sizeof(char*));
     unsigned ifnIdx=0;
     bool join = false;
+    bool cols_inherited = false;
+    int64_t query_max_err = 0;
+    const char* baseline_file = NULL;
+    bool iters_given = false;
+    std::vector<baseline_row_t> baseline;
 #ifdef UTIL_HAS_CREATEFILELIST
     const char** extendedFileList = NULL;
     char* fileNamesBuf = NULL;
@@ -75,6 +82,7 @@ int main(int argc, char** argv) {
     params->cmintime = 0;
     params->dmintime = 0;
     params->cloop_time = params->dloop_time = DEFAULT_LOOP_TIME;
+    params->regression_pct = 5;
 
     // convenient abbreviations
     auto& qparams = params->query_params;
@@ -116,13 +124,45 @@ int main(int argc, char** argv) {
             encoder_list = strdup(argument + 1);
             numPtr += strlen(numPtr);
             break;
+        case 'A':
+            // -A2,30 runs each loop until it's within 2% or 30s go by
+            params->stable_pct = number;
+            params->stable_max_secs = 10;
+            if (*numPtr == ',')
+            {
+                numPtr++;
+                number = 0;
+                while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                params->stable_max_secs = number;
+            }
+            break;
         case 'b':
             params->chunk_size = number << 10;
+            // -b4..16384 sweeps 4KB, 8KB, 16KB, ..., 16MB blocks
+            if (numPtr[0] == '.' && numPtr[1] == '.') {
+                numPtr += 2;
+                number = 0;
+                while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                if (params->chunk_size < 1 || (size_t)(number << 10) < params->chunk_size) {
+                    printf("ERROR: block size sweep must go from at least 1KB up, got -b%d..%d\n",
+                        (int)(params->chunk_size >> 10), (int)number);
+                    exit(1);
+                }
+                params->chunk_size_max = number << 10;
+            }
+            break;
+        case 'B':
+            baseline_file = argument + 1;
+            numPtr += strlen(numPtr);
             break;
         case 'c':
             dinfo.ncols = number;
             break;
         case 'C':
+            if (cols_inherited) { // replace, don't add to, previous query's
+                qparams.which_cols.clear();
+                cols_inherited = false;
+            }
             qparams.which_cols.push_back(number);
             while (*numPtr == ',') { // parse whole list of numbers
                 numPtr++;
@@ -145,6 +185,12 @@ int main(int argc, char** argv) {
         case 'e':
             dinfo.element_sz = number;
             break;
+        case 'y':
+            params->preprocessors.push_back(BYTESHUFFLE);
+            break;
+        case 'Y':
+            params->preprocessors.push_back(BITSHUFFLE);
+            break;
         // case 'g':
         //     params->time_preproc = true;
         //     break;
@@ -152,12 +198,34 @@ int main(int argc, char** argv) {
         //     encoder_list = strdup(argument + 1);
         //     numPtr += strlen(numPtr);
         //     break;
+        case 'E':
+            query_max_err = number;
+            break;
+        case 'F':
+            params->tile_size = number << 10;
+            break;
         case 'f':
             // XXX: for sprintz forecasting, pass in negative of the
             // dimensionality; this is a total hack
             params->preprocessors.push_back(-number);
             break;
+        case 'G':
+            params->regression_pct = number;
+            break;
+        case 'H':
+            // raw latency histograms for plotting; implies -L
+            if (params->latency_dump) { fclose(params->latency_dump); }
+            params->latency_dump = fopen(argument + 1, "w");
+            if (!params->latency_dump) {
+                printf("ERROR: can't open latency histogram file %s\n", argument + 1);
+                exit(1);
+            }
+            fprintf(params->latency_dump, "Compressor name,Phase,Latency low ns,Latency high ns,Count,Filename\n");
+            params->latency = 1;
+            numPtr += strlen(numPtr);
+            break;
         case 'i':
+            iters_given = true;
             params->c_iters = number;
             if (*numPtr == ',')
             {
@@ -173,17 +241,47 @@ int main(int argc, char** argv) {
         case 'm':
             params->mem_limit = number << 18; /*  total memory usage = mem_limit * 4  */
             if (params->textformat == TEXT) params->textformat = TEXT_FULL;
+            if (*numPtr == ',')
+            {
+                numPtr++;
+                number = 0;
+                while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                params->mem_nbuffers = number;
+            }
+            break;
+        case 'K':
+            params->cold_cache = number;
+            break;
+        case 'L':
+            params->latency = number;
+            break;
+        case 'M':
+#ifndef UTIL_HAS_MMAP
+            printf("ERROR: -M needs mmap, which isn't available here\n");
+            exit(1);
+#endif
+            params->mmap_mode = number;
             break;
         case 'o':
             params->textformat = (textformat_e)number;
-            if (params->textformat == CSV) params->verbose = 0;
+            if (params->textformat == CSV || params->textformat == JSON_LINES) params->verbose = 0;
             break;
         case 'p':
             params->timetype = (timetype_e)number;
             break;
+        case 'P':
+            params->perf_counters = number;
+            break;
         case 'q':
+            // each -q after the first starts another query in the batch; it
+            // keeps the previous query's columns and window unless -C or -w
+            // come after it
+            if (qparams.type != QUERY_NONE) {
+                params->query_batch.push_back(qparams);
+                cols_inherited = true;
+            }
             qparams.type = (query_type_e)number;
-            printf("set query type to %d\n", (int)qparams.type);
+            LZBENCH_PRINT(2, "set query type to %d\n", (int)qparams.type);
             break;
         case 'Q':
             qparams.window_data_dbl.push_back(number);
@@ -203,6 +301,14 @@ int main(int argc, char** argv) {
             break;
         case 's':
             params->cspeed = number;
+            // -s300,2000 also wants decompression of at least 2000 MB/s
+            if (*numPtr == ',')
+            {
+                numPtr++;
+                number = 0;
+                while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                params->dspeed = number;
+            }
             break;
         case 'S':
             dinfo.storage_order = (storage_order_e)number;
@@ -220,6 +326,30 @@ int main(int argc, char** argv) {
             break;
         case 'T':
             params->nthreads = number;
+            // -T1..16 or -T1..max sweeps 1, 2, 4, 8, and 16 threads
+            if (numPtr[0] == '.' && numPtr[1] == '.') {
+                numPtr += 2;
+                if (!strncmp(numPtr, "max", 3)) {
+                    numPtr += 3;
+                    number = std::thread::hardware_concurrency();
+                } else {
+                    number = 0;
+                    while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                }
+                if (params->nthreads < 1 || number < params->nthreads) {
+                    printf("ERROR: thread sweep must go from at least 1 thread up, got -T%d..%d\n",
+                        params->nthreads, (int)number);
+                    exit(1);
+                }
+                params->nthreads_max = number;
+            }
+            if (*numPtr == ',')
+            {
+                numPtr++;
+                number = 0;
+                while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+                params->pin_threads = number;
+            }
             break;
         case 'u':
             params->dmintime = 1000*number;
@@ -241,6 +371,7 @@ int main(int argc, char** argv) {
             numPtr++;
             number = 0;
             while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+            qparams.window_ncols = number;
             // parse next number after the comma (stride) or default it
             if (*numPtr != ',') {
                 qparams.window_stride = -1;
@@ -249,6 +380,7 @@ int main(int argc, char** argv) {
             numPtr++;
             number = 0;
             while ((*numPtr >='0') && (*numPtr <='9')) { number *= 10;  number += *numPtr - '0'; numPtr++; }
+            qparams.window_stride = number;
             break;
         case 'x':
             real_time = 0;
@@ -345,6 +477,26 @@ int main(int argc, char** argv) {
         }
     }
 
+    if (qparams.type != QUERY_NONE) {
+        params->query_batch.push_back(qparams);
+    }
+
+    // rerun whatever the baseline ran unless told otherwise, with enough
+    // iterations for the comparison to tell noise from real changes
+    if (baseline_file) {
+        baseline = load_baseline(baseline_file);
+        if (!encoder_list) {
+            encoder_list = strdup(baseline_encoder_list(baseline).c_str());
+        }
+        if (!iters_given) { params->c_iters = params->d_iters = 10; }
+    }
+
+    // let sprintz query codecs skip decoding columns we won't look at
+    lzbench_sprintz_set_query_cols(qparams.which_cols.data(),
+        qparams.which_cols.size());
+    lzbench_sprintz_set_query_window(qparams.window_nrows);
+    lzbench_sprintz_set_query_max_err(query_max_err);
+
     LZBENCH_PRINT(2, PROGNAME " " PROGVERSION " (%d-bit " PROGOS ")   Assembled by P.Skibinski\n", (uint32_t)(8 * sizeof(uint8_t*)));
     LZBENCH_PRINT(5, "params: chunk_size=%d c_iters=%d d_iters=%d cspeed=%d cmintime=%d dmintime=%d encoder_list=%s\n", (int)params->chunk_size, params->c_iters, params->d_iters, params->cspeed, params->cmintime, params->dmintime, encoder_list);
 
@@ -383,6 +535,13 @@ int main(int argc, char** argv) {
         LZBENCH_PRINT(2, "done... (cIters=%d dIters=%d cTime=%.1f dTime=%.1f chunkSize=%dKB cSpeed=%dMB)\n", params->c_iters, params->d_iters, params->cmintime/1000.0, params->dmintime/1000.0, (int)(params->chunk_size >> 10), params->cspeed);
     }
 
+    print_scaling_table(params);
+    print_block_size_table(params);
+
+    if (baseline_file && print_baseline_comparison(params, baseline) > 0) {
+        if (result == 0) { result = 2; }
+    }
+
     if (sort_col <= 0) goto _clean;
 
     printf("\nThe results sorted by column number %d:\n", sort_col);
@@ -408,6 +567,7 @@ int main(int argc, char** argv) {
 
 _clean:
     if (encoder_list) free(encoder_list);
+    if (params->latency_dump) fclose(params->latency_dump);
 #ifdef UTIL_HAS_CREATEFILELIST
     if (extendedFileList)
         UTIL_freeFileList(extendedFileList, fileNamesBuf);
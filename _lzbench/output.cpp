@@ -3,6 +3,13 @@
 
 #include <algorithm> // sort
 #include <numeric>
+#include <string.h>
+#include <time.h>
+
+#ifndef WINDOWS
+#include <sys/utsname.h>
+#include <unistd.h>
+#endif
 
 int istrcmp(const char *str1, const char *str2) {
     int c1, c2;
@@ -42,25 +49,264 @@ std::vector<std::string> split(const std::string &text, char sep) {
   return tokens;
 }
 
+// with -P, each row gets cycles per byte, instructions per cycle, and L1D,
+// LLC, branch, and dTLB misses per KB for compression and then for
+// decompression; rates that couldn't be measured are negative
+static const int kNumPerfRates = 6;
+static const char* kPerfRateNames[kNumPerfRates] = {
+    "cyc/B", "IPC", "L1/KB", "LLC/KB", "br/KB", "TLB/KB" };
+
+static void _perf_rates(const perf_counts_t& p, double* rates) {
+    const int64_t* c = p.counts;
+    double kbytes = p.nbytes / 1024.;
+    rates[0] = (c[PERF_CYCLES] < 0 || !p.nbytes) ? -1 :
+        (double)c[PERF_CYCLES] / p.nbytes;
+    rates[1] = (c[PERF_INSTRUCTIONS] < 0 || c[PERF_CYCLES] <= 0) ? -1 :
+        (double)c[PERF_INSTRUCTIONS] / c[PERF_CYCLES];
+    const int miss_events[4] = {
+        PERF_L1D_MISSES, PERF_LLC_MISSES, PERF_BRANCH_MISSES, PERF_DTLB_MISSES };
+    for (int i = 0; i < 4; i++) {
+        int64_t count = c[miss_events[i]];
+        rates[2 + i] = (count < 0 || !p.nbytes) ? -1 : count / kbytes;
+    }
+}
+
+static void print_perf_header(lzbench_params_t *params) {
+    if (!params->perf_counters) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        const char* prefix = phase == 0 ? "c." : "d.";
+        const char* csv_prefix = phase == 0 ? "Compression" : "Decompression";
+        for (int i = 0; i < kNumPerfRates; i++) {
+            std::string name = std::string(prefix) + kPerfRateNames[i];
+            switch (params->textformat) {
+                case CSV: printf("%s %s,", csv_prefix, kPerfRateNames[i]); break;
+                case TEXT:
+                case TEXT_FULL: printf("%8s ", name.c_str()); break;
+                case MARKDOWN: printf("|%8s ", name.c_str()); break;
+                default: break;
+            }
+        }
+    }
+}
+
+static void print_perf_header_rule(lzbench_params_t *params) {
+    if (!params->perf_counters) { return; }
+    for (int i = 0; i < 2 * kNumPerfRates; i++) { printf("| ------- "); }
+}
+
+static void print_perf_columns(lzbench_params_t *params, string_table_t& row) {
+    if (!params->perf_counters) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        double rates[kNumPerfRates];
+        _perf_rates(phase == 0 ? row.cperf : row.dperf, rates);
+        for (int i = 0; i < kNumPerfRates; i++) {
+            bool ok = rates[i] >= 0;
+            switch (params->textformat) {
+                case CSV:
+                    if (ok) { printf("%.3f,", rates[i]); } else { printf(","); }
+                    break;
+                case TEXT:
+                case TEXT_FULL:
+                    if (ok) { printf("%8.2f ", rates[i]); } else { printf("%8s ", "-"); }
+                    break;
+                case MARKDOWN:
+                    if (ok) { printf("|%8.2f ", rates[i]); } else { printf("|%8s ", "-"); }
+                    break;
+                default: break;
+            }
+        }
+    }
+}
+
+
+// with -L, each row gets the median, 99th, and 99.9th percentile, and
+// maximum time to compress one chunk, and then to decompress one, in us
+static const int kNumLatencyStats = 4;
+static const char* kLatencyStatNames[kNumLatencyStats] = {
+    "p50", "p99", "p99.9", "max" };
+
+static void print_latency_header(lzbench_params_t *params) {
+    if (!params->latency) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        const char* prefix = phase == 0 ? "c." : "d.";
+        const char* csv_prefix = phase == 0 ? "Compression" : "Decompression";
+        for (int i = 0; i < kNumLatencyStats; i++) {
+            std::string name = std::string(prefix) + kLatencyStatNames[i];
+            switch (params->textformat) {
+                case CSV: printf("%s %s in us,", csv_prefix, kLatencyStatNames[i]); break;
+                case TEXT:
+                case TEXT_FULL: printf("%9s ", name.c_str()); break;
+                case MARKDOWN: printf("|%9s ", name.c_str()); break;
+                default: break;
+            }
+        }
+    }
+}
+
+static void print_latency_header_rule(lzbench_params_t *params) {
+    if (!params->latency) { return; }
+    for (int i = 0; i < 2 * kNumLatencyStats; i++) { printf("| -------- "); }
+}
+
+static void print_latency_columns(lzbench_params_t *params, string_table_t& row) {
+    if (!params->latency) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        const latency_summary_t& lat = phase == 0 ? row.clat : row.dlat;
+        const int64_t stats[kNumLatencyStats] = {
+            lat.p50, lat.p99, lat.p999, lat.max };
+        for (int i = 0; i < kNumLatencyStats; i++) {
+            bool ok = stats[i] >= 0;
+            double usecs = stats[i] / 1000.;
+            switch (params->textformat) {
+                case CSV:
+                    if (ok) { printf("%.3f,", usecs); } else { printf(","); }
+                    break;
+                case TEXT:
+                case TEXT_FULL:
+                    if (ok) { printf("%9.2f ", usecs); } else { printf("%9s ", "-"); }
+                    break;
+                case MARKDOWN:
+                    if (ok) { printf("|%9.2f ", usecs); } else { printf("|%9s ", "-"); }
+                    break;
+                default: break;
+            }
+        }
+    }
+}
+
+// with -K, each row also gets the compression and decompression speed (or
+// time) with the data starting out in DRAM instead of cache
+static void print_cold_header(lzbench_params_t *params) {
+    if (!params->cold_cache) { return; }
+    switch (params->textformat) {
+        case CSV:
+            if (params->show_speed)
+                printf("Cold compression speed,Cold decompression speed,");
+            else
+                printf("Cold compression time in us,Cold decompression time in us,");
+            break;
+        case TEXT:
+        case TEXT_FULL: printf("%11s %11s ", "c.cold", "d.cold"); break;
+        case MARKDOWN: printf("|%11s |%11s ", "c.cold", "d.cold"); break;
+        default: break;
+    }
+}
+
+static void print_cold_header_rule(lzbench_params_t *params) {
+    if (!params->cold_cache) { return; }
+    printf("| ---------- | ---------- ");
+}
+
+static void print_cold_columns(lzbench_params_t *params, string_table_t& row) {
+    if (!params->cold_cache) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        uint64_t nanos = phase == 0 ? row.cold_ctime : row.cold_dtime;
+        double speed = nanos ? row.col5_origsize * 1000.0 / nanos : 0;
+        const char* sep = params->textformat == MARKDOWN ? "|" : "";
+        switch (params->textformat) {
+            case CSV:
+                if (!nanos) { printf(","); }
+                else if (params->show_speed) { printf("%.2f,", speed); }
+                else { printf("%llu,", (unsigned long long)(nanos / 1000)); }
+                break;
+            case TEXT:
+            case TEXT_FULL:
+            case MARKDOWN:
+                if (!nanos) { printf("%s%11s ", sep, "-"); }
+                else if (!params->show_speed) { printf("%s%8llu us ", sep, (unsigned long long)(nanos / 1000)); }
+                else if (speed < 10) { printf("%s%6.2f MB/s ", sep, speed); }
+                else { printf("%s%6d MB/s ", sep, (int)speed); }
+                break;
+            default: break;
+        }
+    }
+}
+
+// with -A, each row gets how close the reported compression and
+// decompression times are to the truth: half the width of their 95%
+// confidence interval, as a percentage of them
+static void print_ci_header(lzbench_params_t *params) {
+    if (!params->stable_pct) { return; }
+    switch (params->textformat) {
+        case CSV: printf("Compression CI %%,Decompression CI %%,"); break;
+        case TEXT:
+        case TEXT_FULL: printf("   c.CI    d.CI "); break;
+        case MARKDOWN: printf("|   c.CI |   d.CI "); break;
+        default: break;
+    }
+}
+
+static void print_ci_header_rule(lzbench_params_t *params) {
+    if (!params->stable_pct) { return; }
+    printf("| ------ | ------ ");
+}
+
+static void print_ci_columns(lzbench_params_t *params, string_table_t& row) {
+    if (!params->stable_pct) { return; }
+    for (int phase = 0; phase < 2; phase++) {
+        double ci = phase == 0 ? row.cci : row.dci;
+        bool ok = ci >= 0;
+        switch (params->textformat) {
+            case CSV:
+                if (ok) { printf("%.3f,", 100 * ci); } else { printf(","); }
+                break;
+            case TEXT:
+            case TEXT_FULL:
+                if (ok) { printf("%6.2f%% ", 100 * ci); } else { printf("%7s ", "-"); }
+                break;
+            case MARKDOWN:
+                if (ok) { printf("|%6.2f%% ", 100 * ci); } else { printf("|%7s ", "-"); }
+                break;
+            default: break;
+        }
+    }
+}
 
 void print_header(lzbench_params_t *params) {
     switch (params->textformat)
     {
         case CSV:
             if (params->show_speed)
-                printf("Compressor name,Compression speed,Decompression speed,Original size,Compressed size,Ratio,Filename\n");
+                printf("Compressor name,Compression speed,Decompression speed,Original size,Compressed size,Ratio,");
             else
-                printf("Compressor name,Compression time in us,Decompression time in us,Original size,Compressed size,Ratio,Filename\n"); break;
+                printf("Compressor name,Compression time in us,Decompression time in us,Original size,Compressed size,Ratio,");
+            print_cold_header(params);
+            print_ci_header(params);
+            print_perf_header(params);
+            print_latency_header(params);
+            printf("Filename\n");
             break;
         case TURBOBENCH:
             printf("  Compressed  Ratio   Cspeed   Dspeed         Compressor name Filename\n"); break;
         case TEXT:
-            printf("Compressor name         Compress. Decompress. Compr. size  Ratio Filename\n"); break;
+            printf("Compressor name         Compress. Decompress. Compr. size  Ratio ");
+            print_cold_header(params);
+            print_ci_header(params);
+            print_perf_header(params);
+            print_latency_header(params);
+            printf("Filename\n");
+            break;
         case TEXT_FULL:
-            printf("Compressor name         Compress. Decompress.  Orig. size  Compr. size  Ratio Filename\n"); break;
+            printf("Compressor name         Compress. Decompress.  Orig. size  Compr. size  Ratio ");
+            print_cold_header(params);
+            print_ci_header(params);
+            print_perf_header(params);
+            print_latency_header(params);
+            printf("Filename\n");
+            break;
         case MARKDOWN:
-            printf("| Compressor name         | Compression| Decompress.| Compr. size | Ratio | Filename |\n");
-            printf("| ---------------         | -----------| -----------| ----------- | ----- | -------- |\n");
+            printf("| Compressor name         | Compression| Decompress.| Compr. size | Ratio ");
+            print_cold_header(params);
+            print_ci_header(params);
+            print_perf_header(params);
+            print_latency_header(params);
+            printf("| Filename |\n");
+            printf("| ---------------         | -----------| -----------| ----------- | ----- ");
+            print_cold_header_rule(params);
+            print_ci_header_rule(params);
+            print_perf_header_rule(params);
+            print_latency_header_rule(params);
+            printf("| -------- |\n");
             break;
         case MARKDOWN2:
             printf("| Compressor name         | Ratio | Compression| Decompress.|\n");
@@ -79,7 +325,13 @@ void print_speed(lzbench_params_t *params, string_table_t& row) {
     switch (params->textformat)
     {
         case CSV:
-            printf("%s,%.2f,%.2f,%llu,%llu,%.2f,%s\n", row.col1_algname.c_str(), cspeed, dspeed, (unsigned long long)row.col5_origsize, (unsigned long long)row.col4_comprsize, ratio, row.col6_filename.c_str()); break;
+            printf("%s,%.2f,%.2f,%llu,%llu,%.2f,", row.col1_algname.c_str(), cspeed, dspeed, (unsigned long long)row.col5_origsize, (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("%s\n", row.col6_filename.c_str());
+            break;
         case TURBOBENCH:
             printf("%12llu %6.1f%9.2f%9.2f  %22s %s\n", (unsigned long long)row.col4_comprsize, ratio, cspeed, dspeed, row.col1_algname.c_str(), row.col6_filename.c_str()); break;
         case TEXT:
@@ -98,9 +350,14 @@ void print_speed(lzbench_params_t *params, string_table_t& row) {
                 printf("%6d MB/s", (int)dspeed);
             }
             if (params->textformat == TEXT_FULL)
-                printf("%12llu %12llu %6.2f %s\n", (unsigned long long) row.col5_origsize, (unsigned long long)row.col4_comprsize, ratio, row.col6_filename.c_str());
+                printf("%12llu %12llu %6.2f ", (unsigned long long) row.col5_origsize, (unsigned long long)row.col4_comprsize, ratio);
             else
-                printf("%12llu %6.2f %s\n", (unsigned long long)row.col4_comprsize, ratio, row.col6_filename.c_str());
+                printf("%12llu %6.2f ", (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("%s\n", row.col6_filename.c_str());
             break;
         case MARKDOWN:
             printf("| %-23s ", row.col1_algname.c_str());
@@ -116,7 +373,15 @@ void print_speed(lzbench_params_t *params, string_table_t& row) {
             } else {
                 printf("|%6d MB/s ", (int)dspeed);
             }
-            printf("|%12llu |%6.2f | %-s|\n", (unsigned long long)row.col4_comprsize, ratio, row.col6_filename.c_str());
+            printf("|%12llu |%6.2f ", (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("| %-s|\n", row.col6_filename.c_str());
+            break;
+        case JSON_LINES:
+            printf("%s\n", row.json.c_str());
             break;
         case MARKDOWN2:
             ratio = 1.0*row.col5_origsize / row.col4_comprsize;
@@ -147,11 +412,15 @@ void print_time(lzbench_params_t *params, string_table_t& row) {
     switch (params->textformat)
     {
         case CSV:
-            printf("%s,%llu,%llu,%llu,%llu,%.2f,%s\n", row.col1_algname.c_str(),
+            printf("%s,%llu,%llu,%llu,%llu,%.2f,", row.col1_algname.c_str(),
                 (unsigned long long)ctime, (unsigned long long)dtime,
                 (unsigned long long) row.col5_origsize,
-                (unsigned long long)row.col4_comprsize, ratio,
-                row.col6_filename.c_str());
+                (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("%s\n", row.col6_filename.c_str());
             break;
         case TURBOBENCH:
             printf("%12llu %6.1f%9llu%9llu  %22s %s\n",
@@ -168,14 +437,17 @@ void print_time(lzbench_params_t *params, string_table_t& row) {
             else
                 printf("%8llu us", (unsigned long long)dtime);
             if (params->textformat == TEXT_FULL)
-                printf("%12llu %12llu %6.2f %s\n",
+                printf("%12llu %12llu %6.2f ",
                     (unsigned long long) row.col5_origsize,
-                    (unsigned long long)row.col4_comprsize, ratio,
-                    row.col6_filename.c_str());
+                    (unsigned long long)row.col4_comprsize, ratio);
             else
-                printf("%12llu %6.2f %s\n",
-                    (unsigned long long)row.col4_comprsize, ratio,
-                    row.col6_filename.c_str());
+                printf("%12llu %6.2f ",
+                    (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("%s\n", row.col6_filename.c_str());
             break;
         case MARKDOWN:
             printf("| %-23s ", row.col1_algname.c_str());
@@ -184,49 +456,354 @@ void print_time(lzbench_params_t *params, string_table_t& row) {
                 printf("|      ERROR ");
             else
                 printf("|%8llu us ", (unsigned long long)dtime);
-            printf("|%12llu |%6.2f | %-s|\n",
-                (unsigned long long)row.col4_comprsize, ratio,
-                row.col6_filename.c_str());
+            printf("|%12llu |%6.2f ",
+                (unsigned long long)row.col4_comprsize, ratio);
+            print_cold_columns(params, row);
+            print_ci_columns(params, row);
+            print_perf_columns(params, row);
+            print_latency_columns(params, row);
+            printf("| %-s|\n", row.col6_filename.c_str());
             break;
         case MARKDOWN2:
             printf("MARKDOWN2 not supported!\n");
             break;
+        case JSON_LINES:
+            printf("%s\n", row.json.c_str());
+            break;
     }
 }
 
 
-void print_stats(lzbench_params_t *params, const compressor_desc_t* desc,
-    int level, std::vector<uint64_t> &ctime, std::vector<uint64_t> &dtime,
-    size_t insize, size_t outsize, bool decomp_error)
+// ------------------------------------------------ JSON lines output (-o7)
+
+static void _appendf(std::string& s, const char* formatstring, ...) {
+    char buff[1024];
+    va_list args;
+    va_start(args, formatstring);
+    vsnprintf(buff, sizeof(buff), formatstring, args);
+    va_end(args);
+    s += buff;
+}
+
+static void _append_json_str(std::string& s, const char* str) {
+    s += '"';
+    for (const char* c = str; *c; c++) {
+        switch (*c) {
+            case '"': s += "\\\""; break;
+            case '\\': s += "\\\\"; break;
+            case '\n': s += "\\n"; break;
+            case '\t': s += "\\t"; break;
+            default:
+                if ((unsigned char)*c < 0x20) {
+                    _appendf(s, "\\u%04x", (int)(unsigned char)*c);
+                } else {
+                    s += *c;
+                }
+        }
+    }
+    s += '"';
+}
+
+template<class T>
+static void _append_json_ints(std::string& s, const std::vector<T>& vals) {
+    s += '[';
+    for (size_t i = 0; i < vals.size(); i++) {
+        _appendf(s, i ? ",%lld" : "%lld", (long long)vals[i]);
+    }
+    s += ']';
+}
+
+static std::string _cpu_model() {
+    std::string model = "unknown";
+#ifndef WINDOWS
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) { return model; }
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "model name", 10) != 0) { continue; }
+        const char* colon = strchr(line, ':');
+        if (!colon) { continue; }
+        model = colon + 1 + (colon[1] == ' ');
+        while (!model.empty() && (model.back() == '\n' || model.back() == ' ')) {
+            model.pop_back();
+        }
+        break;
+    }
+    fclose(f);
+#endif
+    return model;
+}
+
+// the machine and build the results came from; the same for every result,
+// so it's only put together once
+static const std::string& _json_host_info() {
+    static std::string host;
+    if (!host.empty()) { return host; }
+
+    host = "{\"program\":";
+    _append_json_str(host, PROGNAME " " PROGVERSION);
+    host += ",\"os\":";
+    _append_json_str(host, PROGOS);
+#ifndef WINDOWS
+    char hostname[256] = "unknown";
+    gethostname(hostname, sizeof(hostname) - 1);
+    host += ",\"hostname\":";
+    _append_json_str(host, hostname);
+    struct utsname uts;
+    if (uname(&uts) == 0) {
+        std::string kernel = std::string(uts.sysname) + " " + uts.release +
+            " " + uts.machine;
+        host += ",\"kernel\":";
+        _append_json_str(host, kernel.c_str());
+    }
+    _appendf(host, ",\"ncpus\":%ld", sysconf(_SC_NPROCESSORS_ONLN));
+#endif
+    host += ",\"cpu\":";
+    _append_json_str(host, _cpu_model().c_str());
+    host += ",\"compiler\":";
+#if defined(__VERSION__)
+    _append_json_str(host, __VERSION__);
+#elif defined(_MSC_VER)
+    _appendf(host, "\"MSVC %d\"", _MSC_VER);
+#else
+    _append_json_str(host, "unknown");
+#endif
+    // what the compiler was allowed to assume and generate
+    host += ",\"build_flags\":[";
+    const char* flags[] = {
+#ifdef __OPTIMIZE__
+        "optimize",
+#endif
+#ifdef NDEBUG
+        "NDEBUG",
+#endif
+#ifdef __SSE4_1__
+        "sse4.1",
+#endif
+#ifdef __AVX__
+        "avx",
+#endif
+#ifdef __AVX2__
+        "avx2",
+#endif
+#ifdef __BMI2__
+        "bmi2",
+#endif
+#ifdef __AVX512F__
+        "avx512f",
+#endif
+        NULL };
+    for (int i = 0; flags[i]; i++) {
+        if (i) { host += ','; }
+        _append_json_str(host, flags[i]);
+    }
+    _appendf(host, "],\"pointer_bits\":%d}", (int)(8 * sizeof(void*)));
+    return host;
+}
+
+// everything that affects what got measured
+static void _append_json_params(std::string& s, lzbench_params_t *params) {
+    _appendf(s, "{\"chunk_size\":%llu,\"c_iters\":%u,\"d_iters\":%u,"
+        "\"cmintime_ms\":%u,\"dmintime_ms\":%u,\"cspeed\":%u,\"dspeed\":%u,"
+        "\"timetype\":%d,"
+        "\"nthreads\":%d,\"nthreads_max\":%d,\"pin_threads\":%d,"
+        "\"mmap_mode\":%d,\"mem_limit\":%llu,\"mem_nbuffers\":%d,"
+        "\"random_read\":%d,\"unverified\":%s,\"perf_counters\":%d,"
+        "\"latency\":%d,\"stable_pct\":%d,\"stable_max_secs\":%d,"
+        "\"cold_cache\":%d,\"chunk_size_max\":%llu,\"tile_size\":%llu,",
+        (unsigned long long)params->chunk_size, params->c_iters,
+        params->d_iters, params->cmintime, params->dmintime, params->cspeed,
+        params->dspeed, (int)params->timetype, params->nthreads, params->nthreads_max,
+        params->pin_threads, params->mmap_mode,
+        (unsigned long long)params->mem_limit, params->mem_nbuffers,
+        params->random_read, params->unverified ? "true" : "false",
+        params->perf_counters, params->latency, params->stable_pct,
+        params->stable_max_secs, params->cold_cache,
+        (unsigned long long)params->chunk_size_max,
+        (unsigned long long)params->tile_size);
+    s += "\"preprocessors\":";
+    _append_json_ints(s, params->preprocessors);
+    const DataInfo& di = params->data_info;
+    _appendf(s, ",\"data_info\":{\"element_sz\":%llu,\"ncols\":%llu,"
+        "\"is_signed\":%s,\"storage_order\":%d}",
+        (unsigned long long)di.element_sz, (unsigned long long)di.ncols,
+        di.is_signed ? "true" : "false", (int)di.storage_order);
+    s += ",\"queries\":[";
+    for (size_t q = 0; q < params->query_batch.size(); q++) {
+        const QueryParams& qp = params->query_batch[q];
+        _appendf(s, "%s{\"type\":%d,\"reduction\":%d,\"window_nrows\":%lld,"
+            "\"window_ncols\":%lld,\"window_stride\":%lld,\"k\":%d,"
+            "\"which_cols\":", q ? "," : "", (int)qp.type, (int)qp.reduction,
+            (long long)qp.window_nrows, (long long)qp.window_ncols,
+            (long long)qp.window_stride, (int)qp.k);
+        _append_json_ints(s, qp.which_cols);
+        s += '}';
+    }
+    s += "]}";
+}
+
+static void _append_json_perf(std::string& s, const perf_counts_t& p) {
+    static const char* names[PERF_NUM_EVENTS] = { "cycles", "instructions",
+        "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses" };
+    _appendf(s, "{\"bytes\":%llu", (unsigned long long)p.nbytes);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (p.counts[e] < 0) {
+            _appendf(s, ",\"%s\":null", names[e]);
+        } else {
+            _appendf(s, ",\"%s\":%lld", names[e], (long long)p.counts[e]);
+        }
+    }
+    s += '}';
+}
+
+static void _append_json_latency(std::string& s, const LatencyHistogram& h) {
+    latency_summary_t lat(h);
+    _appendf(s, "{\"count\":%llu,\"p50_ns\":%lld,\"p99_ns\":%lld,"
+        "\"p999_ns\":%lld,\"max_ns\":%lld}", (unsigned long long)h.count(),
+        (long long)lat.p50, (long long)lat.p99, (long long)lat.p999,
+        (long long)lat.max);
+}
+
+// one self-contained JSON object per result, so each line can be ingested
+// on its own
+static std::string _json_result(lzbench_params_t *params,
+    const compressor_desc_t* desc, int level, const string_table_t& row,
+    const std::vector<uint64_t>& ctime, const std::vector<uint64_t>& dtime,
+    bool decomp_error)
 {
-    std::string col1_algname;
-    std::sort(ctime.begin(), ctime.end());
-    std::sort(dtime.begin(), dtime.end());
-    uint64_t best_ctime, best_dtime;
+    std::string s = "{\"compressor\":";
+    _append_json_str(s, row.col1_algname.c_str());
+    s += ",\"codec\":";
+    _append_json_str(s, desc->name);
+    s += ",\"version\":";
+    _append_json_str(s, desc->version);
+    _appendf(s, ",\"level\":%d,\"filename\":", level);
+    _append_json_str(s, row.col6_filename.c_str());
+
+    double cspeed = row.col2_ctime ? row.col5_origsize * 1000.0 / row.col2_ctime : 0;
+    double dspeed = row.col3_dtime ? row.col5_origsize * 1000.0 / row.col3_dtime : 0;
+    double ratio = row.col5_origsize ? (double)row.col4_comprsize / row.col5_origsize : 0;
+    _appendf(s, ",\"orig_size\":%llu,\"compr_size\":%llu,\"ratio\":%.6f,"
+        "\"compr_ns\":%llu,\"decompr_ns\":%llu,\"compr_mbs\":%.3f,"
+        "\"decompr_mbs\":%.3f,\"decomp_error\":%s,",
+        (unsigned long long)row.col5_origsize,
+        (unsigned long long)row.col4_comprsize, ratio,
+        (unsigned long long)row.col2_ctime, (unsigned long long)row.col3_dtime,
+        cspeed, dspeed, decomp_error ? "true" : "false");
+    s += "\"compr_samples_ns\":";
+    _append_json_ints(s, ctime);
+    s += ",\"decompr_samples_ns\":";
+    _append_json_ints(s, dtime);
+    s += ",\"query_ns\":";
+    _append_json_ints(s, params->query_nanos);
+    if (params->cold_cache) {
+        _appendf(s, ",\"cold_compr_ns\":%llu,\"cold_decompr_ns\":%llu,"
+            "\"cold_compr_samples_ns\":", (unsigned long long)row.cold_ctime,
+            (unsigned long long)row.cold_dtime);
+        _append_json_ints(s, params->cold_ctime);
+        s += ",\"cold_decompr_samples_ns\":";
+        _append_json_ints(s, params->cold_dtime);
+    }
+    if (params->stable_pct) {
+        _appendf(s, ",\"compr_ci\":%.5f,\"decompr_ci\":%.5f", row.cci, row.dci);
+    }
+    if (params->perf_counters) {
+        s += ",\"compr_perf\":";
+        _append_json_perf(s, params->comp_perf);
+        s += ",\"decompr_perf\":";
+        _append_json_perf(s, params->decomp_perf);
+    }
+    if (params->latency) {
+        s += ",\"compr_latency\":";
+        _append_json_latency(s, params->comp_latency);
+        s += ",\"decompr_latency\":";
+        _append_json_latency(s, params->decomp_latency);
+    }
+    char timestamp[32] = "";
+    time_t now = time(NULL);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    s += ",\"timestamp\":";
+    _append_json_str(s, timestamp);
+    s += ",\"params\":";
+    _append_json_params(s, params);
+    s += ",\"host\":";
+    s += _json_host_info();
+    s += '}';
+    return s;
+}
 
+
+// the fastest, average, or median time (-p); sorts the times
+static uint64_t _best_time(lzbench_params_t *params, std::vector<uint64_t> &times)
+{
+    std::sort(times.begin(), times.end());
+    if (times.empty()) { return 0; }
     switch (params->timetype)
     {
         default:
         case FASTEST:
-            best_ctime = ctime.empty()?0:ctime[0];
-            best_dtime = dtime.empty()?0:dtime[0];
-            break;
+            return times[0];
         case AVERAGE:
-            best_ctime = ctime.empty()?0:std::accumulate(ctime.begin(),ctime.end(),(uint64_t)0) / ctime.size();
-            best_dtime = dtime.empty()?0:std::accumulate(dtime.begin(),dtime.end(),(uint64_t)0) / dtime.size();
-            break;
+            return std::accumulate(times.begin(),times.end(),(uint64_t)0) / times.size();
         case MEDIAN:
-            best_ctime = ctime.empty()?0:(ctime[(ctime.size()-1)/2] + ctime[ctime.size()/2]) / 2;
-            best_dtime = dtime.empty()?0:(dtime[(dtime.size()-1)/2] + dtime[dtime.size()/2]) / 2;
-            break;
+            return (times[(times.size()-1)/2] + times[times.size()/2]) / 2;
     }
+}
+
+void print_stats(lzbench_params_t *params, const compressor_desc_t* desc,
+    int level, std::vector<uint64_t> &ctime, std::vector<uint64_t> &dtime,
+    size_t insize, size_t outsize, bool decomp_error)
+{
+    std::string col1_algname;
+    uint64_t best_ctime = _best_time(params, ctime);
+    uint64_t best_dtime = _best_time(params, dtime);
 
     if (desc->first_level == 0 && desc->last_level==0)
         format(col1_algname, "%s %s", desc->name, desc->version);
     else
         format(col1_algname, "%s %s -%d", desc->name, desc->version, level);
 
+    // with a thread sweep, each number of threads gets its own row
+    if (params->nthreads_max > 0) {
+        std::string nthreads_str;
+        format(nthreads_str, " -T%d", params->nthreads);
+        col1_algname += nthreads_str;
+    }
+    // likewise for each block size in a block size sweep
+    if (params->chunk_size_max > 0) {
+        std::string chunk_size_str;
+        format(chunk_size_str, " -b%d", (int)(params->chunk_size >> 10));
+        col1_algname += chunk_size_str;
+    }
+
     params->results.push_back(string_table_t(col1_algname, best_ctime, (decomp_error)?0:best_dtime, outsize, insize, params->in_filename));
+    params->results.back().ctimes = ctime;
+    if (params->cold_cache) {
+        params->results.back().cold_ctime = _best_time(params, params->cold_ctime);
+        params->results.back().cold_dtime = decomp_error ? 0 :
+            _best_time(params, params->cold_dtime);
+    }
+    params->results.back().dtimes = dtime;
+    if (params->stable_pct) {
+        params->results.back().cci = params->comp_ci;
+        params->results.back().dci = params->decomp_ci;
+    }
+    params->results.back().cperf = params->comp_perf;
+    params->results.back().dperf = params->decomp_perf;
+    if (params->latency) {
+        params->results.back().clat = latency_summary_t(params->comp_latency);
+        params->results.back().dlat = latency_summary_t(params->decomp_latency);
+    }
+    if (params->latency_dump) {
+        params->comp_latency.dump(params->latency_dump, col1_algname.c_str(),
+            "compression", params->in_filename);
+        params->decomp_latency.dump(params->latency_dump,
+            col1_algname.c_str(), "decompression", params->in_filename);
+    }
+    if (params->textformat == JSON_LINES) {
+        params->results.back().json = _json_result(params, desc, level,
+            params->results.back(), ctime, dtime, decomp_error);
+    }
     if (params->show_speed)
         print_speed(params, params->results[params->results.size()-1]);
     else
@@ -235,3 +812,239 @@ void print_stats(lzbench_params_t *params, const compressor_desc_t* desc,
     ctime.clear();
     dtime.clear();
 }
+
+// throughput of each query in a batch, counting only the time spent in
+// that query; the decompression speed printed by print_stats includes
+// decompressing once plus running every query
+void print_query_batch_stats(lzbench_params_t *params, size_t insize,
+    int niters)
+{
+    auto nqueries = params->query_batch.size();
+    if (nqueries < 2 || niters < 1) { return; }
+
+    uint64_t total_nanos = 0;
+    for (size_t q = 0; q < nqueries; q++) {
+        auto nanos = params->query_nanos[q];
+        total_nanos += nanos;
+        LZBENCH_PRINT(2, "    query %d (type %d): %.2f MB/s\n", (int)q,
+            (int)params->query_batch[q].type,
+            nanos > 0 ? (double)insize * niters * 1000 / nanos : -1.);
+    }
+    LZBENCH_PRINT(2, "    all %d queries: %.2f MB/s\n", (int)nqueries,
+        total_nanos > 0 ? (double)insize * niters * 1000 / total_nanos : -1.);
+}
+
+// throughput of each thread in a multithreaded (de)compression run; the
+// speed printed by print_stats is the aggregate over all of them
+void print_thread_stats(lzbench_params_t *params, const char* label,
+    const std::vector<int64_t>& thread_sizes,
+    const std::vector<uint64_t>& thread_nanos, const std::vector<int>& cpus)
+{
+    auto nthreads = thread_sizes.size();
+    if (nthreads < 2) { return; }
+
+    for (size_t i = 0; i < nthreads; i++) {
+        auto nanos = thread_nanos[i];
+        double speed = nanos > 0 ? (double)thread_sizes[i] * 1000 / nanos : -1.;
+        if (cpus[i] >= 0) {
+            LZBENCH_PRINT(2, "    thread %d (cpu %d) %s: %.2f MB/s\n", (int)i,
+                cpus[i], label, speed);
+        } else {
+            LZBENCH_PRINT(2, "    thread %d %s: %.2f MB/s\n", (int)i, label,
+                speed);
+        }
+    }
+}
+
+// how each codec and level scaled in a thread sweep. Efficiency is the speed
+// per thread relative to the speed per thread with the fewest threads, and
+// the knee is the last number of threads before adding more stopped paying
+// off: the next step in the sweep gained less than half the ideal speedup
+static int _scaling_knee(const std::vector<float>& speeds,
+    const std::vector<int>& nthreads)
+{
+    for (size_t i = 0; i + 1 < speeds.size(); i++) {
+        double ideal_gain = speeds[i] * (nthreads[i + 1] - nthreads[i]) /
+            nthreads[i];
+        if (speeds[i + 1] - speeds[i] < .5 * ideal_gain) {
+            return nthreads[i];
+        }
+    }
+    return nthreads.back();
+}
+
+void print_scaling_table(lzbench_params_t *params) {
+    auto& rows = params->scaling_results;
+    if (rows.empty()) { return; }
+
+    switch (params->textformat)
+    {
+        case CSV:
+            printf("Compressor name,Threads,Compression speed,Compression efficiency,Decompression speed,Decompression efficiency,Compression knee,Decompression knee,Filename\n");
+            break;
+        case MARKDOWN:
+        case MARKDOWN2:
+            printf("\n| Compressor name         | Threads | Compression| C. eff. | Decompress.| D. eff. | C. knee | D. knee |\n");
+            printf("| ---------------         | ------- | -----------| ------- | -----------| ------- | ------- | ------- |\n");
+            break;
+        case TURBOBENCH:
+        case TEXT:
+        case TEXT_FULL:
+            printf("\nThread scaling:\n");
+            printf("Compressor name         Threads  Compress.  Eff. Decompress.  Eff.  Knees (c/d)\n");
+            break;
+    }
+
+    // rows for the same codec, level, and file are next to one another
+    size_t start = 0;
+    while (start < rows.size()) {
+        size_t end = start + 1;
+        while (end < rows.size() &&
+                rows[end].col1_algname == rows[start].col1_algname &&
+                rows[end].filename == rows[start].filename) {
+            end++;
+        }
+
+        std::vector<float> cspeeds, dspeeds;
+        std::vector<int> nthreads;
+        for (size_t r = start; r < end; r++) {
+            auto& row = rows[r];
+            cspeeds.push_back(row.ctime ? row.origsize * 1000.0 / row.ctime : 0);
+            dspeeds.push_back(row.dtime ? row.origsize * 1000.0 / row.dtime : 0);
+            nthreads.push_back(row.nthreads);
+        }
+        int cknee = _scaling_knee(cspeeds, nthreads);
+        int dknee = _scaling_knee(dspeeds, nthreads);
+
+        for (size_t r = start; r < end; r++) {
+            size_t i = r - start;
+            auto& row = rows[r];
+            double ceff = cspeeds[0] > 0 ?
+                cspeeds[i] * nthreads[0] / (cspeeds[0] * nthreads[i]) : 0;
+            double deff = dspeeds[0] > 0 ?
+                dspeeds[i] * nthreads[0] / (dspeeds[0] * nthreads[i]) : 0;
+            switch (params->textformat)
+            {
+                case CSV:
+                    printf("%s,%d,%.2f,%.3f,%.2f,%.3f,%d,%d,%s\n",
+                        row.col1_algname.c_str(), row.nthreads, cspeeds[i],
+                        ceff, dspeeds[i], deff, cknee, dknee,
+                        row.filename.c_str());
+                    break;
+                case MARKDOWN:
+                case MARKDOWN2:
+                    printf("| %-23s | %7d |%6d MB/s | %6.1f%% |%6d MB/s | %6.1f%% | %7d | %7d |\n",
+                        row.col1_algname.c_str(), row.nthreads,
+                        (int)cspeeds[i], 100 * ceff, (int)dspeeds[i],
+                        100 * deff, cknee, dknee);
+                    break;
+                case TURBOBENCH:
+                case TEXT:
+                case TEXT_FULL:
+                    printf("%-23s %7d %6d MB/s %4.0f%% %6d MB/s %4.0f%% %6d/%d\n",
+                        row.col1_algname.c_str(), row.nthreads,
+                        (int)cspeeds[i], 100 * ceff, (int)dspeeds[i],
+                        100 * deff, cknee, dknee);
+                    break;
+            }
+        }
+        start = end;
+    }
+}
+
+// whether another block size did at least as well on ratio, compression
+// speed, and decompression speed, and strictly better on one of them;
+// block sizes that failed to decompress don't count
+static bool _block_size_dominated(const std::vector<block_size_table_t>& rows,
+    size_t start, size_t end, size_t r, bool compress_only)
+{
+    auto& a = rows[r];
+    for (size_t o = start; o < end; o++) {
+        auto& b = rows[o];
+        if (o == r || (!b.dtime && !compress_only)) { continue; }
+        // faster means less time, but 0 means the time is unknown
+        bool c_ge = !a.ctime || (b.ctime && b.ctime <= a.ctime);
+        bool d_ge = !a.dtime || (b.dtime && b.dtime <= a.dtime);
+        bool c_gt = b.ctime && (!a.ctime || b.ctime < a.ctime);
+        bool d_gt = b.dtime && (!a.dtime || b.dtime < a.dtime);
+        if (b.comprsize <= a.comprsize && c_ge && d_ge &&
+                (b.comprsize < a.comprsize || c_gt || d_gt)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// for each codec and level in a block size sweep (-b4..16384), how its
+// ratio and speeds changed with the block size, with the block sizes that
+// no other block size beats on all three marked as Pareto optimal
+void print_block_size_table(lzbench_params_t *params) {
+    auto& rows = params->block_size_results;
+    if (rows.empty()) { return; }
+
+    switch (params->textformat)
+    {
+        case CSV:
+            printf("Compressor name,Block size,Compression speed,Decompression speed,Original size,Compressed size,Ratio,Pareto optimal,Filename\n");
+            break;
+        case MARKDOWN:
+        case MARKDOWN2:
+            printf("\n| Compressor name         | Block size | Compression| Decompress.| Ratio | Pareto |\n");
+            printf("| ---------------         | ---------- | -----------| -----------| ----- | ------ |\n");
+            break;
+        case TURBOBENCH:
+        case TEXT:
+        case TEXT_FULL:
+            printf("\nBlock sizes (* = Pareto optimal):\n");
+            printf("Compressor name         Block size  Compress. Decompress.  Ratio\n");
+            break;
+        default:
+            return;
+    }
+
+    // rows for the same codec, level, and file are next to one another
+    size_t start = 0;
+    while (start < rows.size()) {
+        size_t end = start + 1;
+        while (end < rows.size() &&
+                rows[end].col1_algname == rows[start].col1_algname &&
+                rows[end].filename == rows[start].filename) {
+            end++;
+        }
+
+        for (size_t r = start; r < end; r++) {
+            auto& row = rows[r];
+            double cspeed = row.ctime ? row.origsize * 1000.0 / row.ctime : 0;
+            double dspeed = row.dtime ? row.origsize * 1000.0 / row.dtime : 0;
+            double ratio = row.origsize ?
+                row.comprsize * 100.0 / row.origsize : 0;
+            bool failed = !row.dtime && !params->compress_only;
+            bool pareto = !failed && !_block_size_dominated(rows, start, end,
+                r, params->compress_only);
+            int kb = (int)(row.chunk_size >> 10);
+            switch (params->textformat)
+            {
+                case CSV:
+                    printf("%s,%llu,%.2f,%.2f,%llu,%llu,%.2f,%d,%s\n",
+                        row.col1_algname.c_str(),
+                        (unsigned long long)row.chunk_size, cspeed, dspeed,
+                        (unsigned long long)row.origsize,
+                        (unsigned long long)row.comprsize, ratio, (int)pareto,
+                        row.filename.c_str());
+                    break;
+                case MARKDOWN:
+                case MARKDOWN2:
+                    printf("| %-23s | %7d KB |%6d MB/s |%6d MB/s |%6.2f | %6s |\n",
+                        row.col1_algname.c_str(), kb, (int)cspeed,
+                        (int)dspeed, ratio, pareto ? "yes" : "");
+                    break;
+                default:
+                    printf("%-23s %7d KB %6d MB/s %6d MB/s %6.2f %s\n",
+                        row.col1_algname.c_str(), kb, (int)cspeed,
+                        (int)dspeed, ratio, pareto ? "*" : "");
+                    break;
+            }
+        }
+        start = end;
+    }
+}
@@ -18,5 +18,12 @@ void print_time(lzbench_params_t *params, string_table_t& row);
 void print_stats(lzbench_params_t *params, const compressor_desc_t* desc,
     int level, std::vector<uint64_t> &ctime, std::vector<uint64_t> &dtime,
     size_t insize, size_t outsize, bool decomp_error);
+void print_query_batch_stats(lzbench_params_t *params, size_t insize,
+    int niters);
+void print_thread_stats(lzbench_params_t *params, const char* label,
+    const std::vector<int64_t>& thread_sizes,
+    const std::vector<uint64_t>& thread_nanos, const std::vector<int>& cpus);
+void print_scaling_table(lzbench_params_t *params);
+void print_block_size_table(lzbench_params_t *params);
 
 #endif
@@ -5,20 +5,229 @@
 
 #include "parallel.h"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>  // TODO rm
+#include <condition_variable>
+#include <functional>
 #include <iostream>  // TODO rm
-#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <thread>
 
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 #include "output.h"
 #include "preprocessing.h"
 #include "query.hpp"
+#include "stopping_rule.h"
 #include "util.h"
 
 
+// ------------------------------------------------ cpu pinning
+
+// parses sysfs cpu lists like "0-3,8-11"
+static std::vector<int> _parse_cpulist(const char* str) {
+    std::vector<int> cpus;
+    while (*str >= '0' && *str <= '9') {
+        int first = (int)strtol(str, (char**)&str, 10);
+        int last = first;
+        if (*str == '-') { last = (int)strtol(str + 1, (char**)&str, 10); }
+        for (int cpu = first; cpu <= last; cpu++) { cpus.push_back(cpu); }
+        if (*str == ',') { str++; }
+    }
+    return cpus;
+}
+
+// which cpu each worker should run on, or -1 to let the OS decide. With
+// PIN_COMPACT, workers fill up the cpus we're allowed to run on in order;
+// with PIN_SPREAD, they go round-robin across NUMA nodes, so that each
+// node's memory bandwidth gets shared by as few workers as possible
+static std::vector<int> _worker_cpus(int nthreads, int pin_mode) {
+    std::vector<int> worker_cpus(nthreads, -1);
+#ifdef __linux__
+    if (pin_mode == PIN_NONE) { return worker_cpus; }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return worker_cpus;
+    }
+    std::vector<std::vector<int>> node_cpus;
+    if (pin_mode == PIN_SPREAD) {
+        for (int node = 0; ; node++) {
+            char path[64];
+            snprintf(path, sizeof(path),
+                "/sys/devices/system/node/node%d/cpulist", node);
+            FILE* f = fopen(path, "r");
+            if (!f) { break; }
+            char buff[4096] = {0};
+            size_t len = fread(buff, 1, sizeof(buff) - 1, f);
+            fclose(f);
+            buff[len] = '\0';
+            node_cpus.push_back(_parse_cpulist(buff));
+        }
+    }
+    if (node_cpus.empty()) { // not spreading, or no NUMA info
+        node_cpus.resize(1);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            node_cpus[0].push_back(cpu);
+        }
+    }
+    for (auto& cpus : node_cpus) {
+        std::vector<int> usable;
+        for (auto cpu : cpus) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) {
+                usable.push_back(cpu);
+            }
+        }
+        cpus.swap(usable);
+    }
+
+    // interleave the nodes' cpus; wraps around if there are more workers
+    // than cpus
+    std::vector<int> order;
+    for (size_t i = 0; ; i++) {
+        bool any_left = false;
+        for (auto& cpus : node_cpus) {
+            if (i < cpus.size()) { order.push_back(cpus[i]); any_left = true; }
+        }
+        if (!any_left) { break; }
+    }
+    if (order.empty()) { return worker_cpus; }
+    for (int i = 0; i < nthreads; i++) {
+        worker_cpus[i] = order[i % order.size()];
+    }
+#endif
+    return worker_cpus;
+}
+
+static void _pin_this_thread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0) { return; }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+}
+
+// ------------------------------------------------ worker pool
+
+// lets a fixed number of threads all start (or stop) at the same moment;
+// spins rather than sleeping so that nobody gets a head start waiting for
+// the scheduler to wake them up
+class SpinBarrier {
+public:
+    explicit SpinBarrier(int nthreads):
+        nthreads(nthreads), nwaiting(0), generation(0) {}
+
+    void wait() {
+        int gen = generation.load(std::memory_order_acquire);
+        if (nwaiting.fetch_add(1, std::memory_order_acq_rel) == nthreads - 1) {
+            nwaiting.store(0, std::memory_order_relaxed);
+            generation.store(gen + 1, std::memory_order_release);
+            return;
+        }
+        while (generation.load(std::memory_order_acquire) == gen) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    const int nthreads;
+    std::atomic<int> nwaiting;
+    std::atomic<int> generation;
+};
+
+// threads that stick around between codecs and levels, so that we don't
+// pay to create them (and cold caches and thread_locals) for every
+// measurement; each one is optionally pinned to a cpu when it starts
+class WorkerPool {
+public:
+    WorkerPool(int nthreads, int pin_mode):
+        pin_mode(pin_mode), cpus(_worker_cpus(nthreads, pin_mode)),
+        generation(0), nrunning(0), stopping(false)
+    {
+        for (int i = 0; i < nthreads; i++) {
+            threads.emplace_back(&WorkerPool::_worker_loop, this, i);
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        work_available.notify_all();
+        for (auto& t : threads) { t.join(); }
+    }
+
+    // runs f(i) in worker i, for every worker; returns once they're all done
+    void run(const std::function<void(int)>& f) {
+        std::unique_lock<std::mutex> lock(mutex);
+        task = f;
+        nrunning = (int)threads.size();
+        generation++;
+        work_available.notify_all();
+        work_done.wait(lock, [this] { return nrunning == 0; });
+    }
+
+    int size() const { return (int)threads.size(); }
+    int cpu(int i) const { return cpus[i]; }
+
+    const int pin_mode;
+
+private:
+    void _worker_loop(int i) {
+        _pin_this_thread(cpus[i]);
+        uint64_t seen_generation = 0;
+        while (true) {
+            std::function<void(int)> f;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                work_available.wait(lock, [this, seen_generation] {
+                    return stopping || generation != seen_generation; });
+                if (stopping) { return; }
+                seen_generation = generation;
+                f = task;
+            }
+            f(i);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--nrunning == 0) { work_done.notify_one(); }
+            }
+        }
+    }
+
+    std::vector<int> cpus;
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable work_available, work_done;
+    std::function<void(int)> task;
+    uint64_t generation;
+    int nrunning;
+    bool stopping;
+};
+
+// the pool is only rebuilt if the number of threads or pinning changes
+static WorkerPool& _get_worker_pool(int nthreads, int pin_mode) {
+    static std::unique_ptr<WorkerPool> pool;
+    if (!pool || pool->size() != nthreads || pool->pin_mode != pin_mode) {
+        pool.reset(); // join the old threads before pinning new ones
+        pool.reset(new WorkerPool(nthreads, pin_mode));
+    }
+    return *pool;
+}
+
+
 size_t _decomp_and_query(lzbench_params_t *params, const compressor_desc_t* desc,
     const uint8_t* comprbuff, size_t comprsize, uint8_t* outbuf, size_t outsize,
-    bool already_materialized,
+    uint8_t* tmpbuf, bool already_materialized,
     size_t param1, size_t param2, char* workmem)
 {
     // printf("decomp_and_query: running '%s' with insize %lu, outsize %u!\n", desc->name, comprsize, outsize);
@@ -32,13 +241,13 @@ size_t _decomp_and_query(lzbench_params_t *params, const compressor_desc_t* desc
         if (comprsize == outsize) { // uncompressed
             memcpy(outbuf, comprbuff, comprsize);
             dlen = comprsize;
+            undo_preprocessors(params->preprocessors, outbuf, dlen,
+                params->data_info.element_sz);
         } else {
             // printf("about to decomp using compressor: %s\n", desc->name);
-            dlen = decompress((char*)comprbuff, comprsize, (char*)outbuf,
-                              outsize, param1, param2, workmem);
+            dlen = decompress_preprocessed(params, decompress, comprbuff,
+                comprsize, outbuf, outsize, tmpbuf, param1, param2, workmem);
         }
-        undo_preprocessors(params->preprocessors, outbuf, dlen,
-            params->data_info.element_sz);
 
         // prevent compiler from not running above command (hopefully...)
         if (params->verbose >= 999 || dlen >= ((int64_t)1) << 31) {
@@ -50,9 +259,14 @@ size_t _decomp_and_query(lzbench_params_t *params, const compressor_desc_t* desc
         dlen = outsize;
     }
 
-    // run query if one is specified
-    auto qparams = params->query_params;
-    if (qparams.type != QUERY_NONE) {
+    // results get written into the same storage for every chunk, so that
+    // allocating them isn't part of the measured query time
+    static thread_local std::vector<QueryResult> query_results;
+    query_results.resize(params->query_batch.size());
+
+    // run each query while this chunk is still hot in cache
+    for (size_t q = 0; q < params->query_batch.size(); q++) {
+        auto& qparams = params->query_batch[q];
         // printf("got query type: %d; about to run a query...\n", qparams.type);
         // auto& dinfo = params->data_info;
         DataInfo dinfo = params->data_info;
@@ -64,8 +278,8 @@ size_t _decomp_and_query(lzbench_params_t *params, const compressor_desc_t* desc
         // printf("dlen: %lld\n", (int64_t)dlen);
         // printf("dinfo nrows, ncols, size: %lu, %lu, %lu\n",
         //     dinfo.nrows, dinfo.ncols, dinfo.nrows * dinfo.ncols);
-        QueryResult result = run_query(
-            params->query_params, dinfo, outbuf);
+        QueryResult& result = query_results[q];
+        run_query(qparams, dinfo, outbuf, result);
         // QueryResult result = frobnicate(                         // TODO rm
         //     params->query_params, dinfo, outbuf);
         // printf("ran query type: %d\n", qparams.type);
@@ -74,14 +288,17 @@ size_t _decomp_and_query(lzbench_params_t *params, const compressor_desc_t* desc
 
         // hack so it can't pull the above check out of the loop; dummy
         // can be any u8 but next line will always add 0, although compiler
-        // doesn't know this (it's 0 because element_sz is in {1,2})
+        // doesn't know this (it's 0 because element_sz is in {1,2}); this
+        // used to add to params->verbose, but every thread storing to that
+        // one cache line after every chunk throttled multithreaded runs
+        static thread_local int64_t query_sink = 0;
         auto dummy = result.vals_u8.size() > 0 ? result.vals_u8[0] : 0;
-        params->verbose += result.idxs.size() > ((int64_t)1e9) ? dummy : 0;
+        query_sink += result.idxs.size() > ((int64_t)1e9) ? dummy : 0;
 
         // prevent compiler from optiming away query
         // XXX does it actually have this effect? could pull this check
         // out of the loop and do nothing if condition is false
-        if (params->verbose > 999) {
+        if (params->verbose > 999 || query_sink > 0) {
             printf("query u8 result: ");
             for (auto val : result.vals_u8) { printf("%d ", (int)val); }
             printf("\n");
@@ -102,44 +319,25 @@ void parallel_decomp(lzbench_params_t *params,
     uint8_t* tmpbuf, bench_rate_t rate, std::vector<uint64_t> comp_times,
     size_t param1, size_t param2, char* workmem)
 {
-    // printf("calling parallel decomp for algorithm (T=%d): %s!\n", params->nthreads, desc->name);
-    // printf("calling parallel decomp for algorithm %s!\n", desc->name);
-    // if (params) {
-    //     printf("using nthreads: %d\n", params->nthreads);
-    // }
-
     std::vector<uint64_t> compressed_chunk_starts;
     compressed_chunk_starts.push_back(0);
     for (auto sz : compr_sizes) {
         compressed_chunk_starts.push_back(compressed_chunk_starts.back() + sz);
     }
     compressed_chunk_starts.pop_back(); // last one is just an end idx
-
-    // printf("compr start idxs: ");
-    // for (auto start_idx : compressed_chunk_starts) {
-    //     printf("%lld, ", start_idx);
-    // }
-    // printf("\n");
-
-    // printf("param1, param2 = %lu, %lu\n", param1, param2);
-    // if (param1 != 80) {
-    //     printf("param1 is %lu, not 80!\n", param1);
-    // }
+    auto num_chunks = compressed_chunk_starts.size();
 
     uint64_t run_for_nanosecs = (uint64_t)params->dmintime*1000*1000;
 
-    using result_t = std::tuple<int64_t, int64_t>;
-
     int nthreads = params->nthreads;
-    // std::vector<int64_t> total_scanned_sizes(nthreads);
-    // std::vector<std::future<int64_t>> total_scanned_sizes(nthreads);
-    std::vector<std::future<result_t>> thread_results_futures;
-    std::vector<result_t> thread_results(nthreads);
-    // std::vector<result_t> total_scanned_sizes(nthreads);
-    // std::vector<std::thread> threads(nthreads);
+    std::vector<int64_t> thread_decomp_sizes(nthreads);
+    std::vector<uint64_t> thread_nanos(nthreads);
+    std::vector<perf_counts_t> thread_perf(nthreads);
+    std::vector<LatencyHistogram> thread_latencies(
+        params->latency ? nthreads : 0);
 
     auto max_chunk_sz = chunk_sizes[0];
-    auto total_raw_sz = 0;
+    size_t total_raw_sz = 0;
     for (auto sz : chunk_sizes) {
         if (sz > max_chunk_sz) { max_chunk_sz = sz; }
         total_raw_sz += sz;
@@ -147,171 +345,269 @@ void parallel_decomp(lzbench_params_t *params,
 
     bool already_materialized = strings_equal(desc->name, "materialized");
 
-    // for (int i = 0; i < nthreads; i++) {
-        // auto& this_total = total_scanned_sizes[i];
-        // size_t* this_total = total_scanned_sizes[i];
-        // threads[i] = std::thread([&total_scanned_sizes[i]] {
-        auto run_in_thread =
-            // [i, run_for_nanosecs, max_chunk_sz, total_raw_sz, inbuf, nthreads,
-            [run_for_nanosecs, max_chunk_sz, total_raw_sz, inbuf, nthreads,
-                params, desc, compr_sizes, chunk_sizes, rate,
-                compressed_chunk_starts,
-                already_materialized,
-                // &total_scanned_sizes,
-                param1, param2, workmem](int i) {
-
-            // std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(100));
-            // std::this_thread::sleep_for(std::chrono::duration<double>(1));
-            // std::this_thread::sleep_for(std::chrono::duration<double>(2));
-            // return (int64_t)total_raw_sz;
-
-            //
-            // TODO uncomment below here
-            // EDIT: this scales linearly, so issue is something below here...
-            //
-
-            int64_t decomp_sz = 0;
-
-            bench_timer_t t_end;
-            int64_t max_iters = run_for_nanosecs > 0 ? 1000*1000*1000 : -1;
-            int64_t niters = 0;
-            auto num_chunks = compressed_chunk_starts.size();
-            // XXX this is an ugly way to check this
-
-            // printf("using num_chunks: %lld\n", (int64_t)num_chunks);
-            // printf("using chunk sizes:"); for (auto sz : chunk_sizes) { printf("%lld, ", (int64_t)sz); } printf("\n");
-
-            // printf("max chunk sz: %lu\n", max_chunk_sz);
-            uint8_t* decomp_buff = alloc_data_buffer(max_chunk_sz + 4096);
-
-            int64_t elapsed_nanos = 0;
-
-            bench_timer_t t_start;
-            GetTime(t_start);
-
-            do {
-                // run multiple iters betwen rtsc calls to avoid sync overhead
-                // use nthreads iters as a heuristic so syncs/sec is constant
-                // for (int it = 0; it < num_chunks*nthreads; it++) {
-                for (int it = 0; it < nthreads; it++) {
-                // for (int it = 0; it < 1; it++) { // TODO uncomment above
-                    auto chunk_idx = rand() % num_chunks;
-                    // auto chunk_idx = it % num_chunks;
-                    auto inptr = inbuf + compressed_chunk_starts[chunk_idx];
-                    // auto inptr = inbuf; // TODO uncomment above after debug
-                    auto insize = compr_sizes[chunk_idx];
-                    auto rawsize = chunk_sizes[chunk_idx];
-
-                    _decomp_and_query(params, desc, inptr, insize,
-                        decomp_buff, rawsize, already_materialized,
-                        param1, param2, workmem);
-
-                    // std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(100));
-                    // std::this_thread::sleep_for(std::chrono::duration<double>(1));
-
-                    // this_total += rawsize;
-                    decomp_sz += rawsize;
-                    // total_scanned_sizes[i] += rawsize;
-                    // *(this_total) = *(this_total) + rawsize;
-                    niters++;
-                }
-
-                // check whether we're done
-                GetTime(t_end);
-                elapsed_nanos = GetDiffTime(rate, t_start, t_end);
-
-                bool done = elapsed_nanos >= run_for_nanosecs;
-                done = done || ((max_iters >= 0) && (niters >= max_iters));
-                if (done) {
-                // if (true) {
-                    LZBENCH_PRINT(8, "%d) elapsed iters, time: %lld, %lld/%lldns\n",
-                        i, niters, elapsed_nanos, run_for_nanosecs);
-                }
-                if (done) { break; }
-            } while (true);
-
-            // auto total_comp_size = 0;
-            // for (auto sz: compr_sizes) {
-            //     total_comp_size += sz;
-            // }
-            // size_t cmn = common(inbuf, decomp_buff, total_raw_sz);
-            // if (cmn < insize) {
-            // printf("about to check whether decomp is correct...\n");
-            // size_t cmn = common(inbuf, decomp_buff, max_chunk_sz);
-            // if (cmn < max_chunk_sz) {
-            //     LZBENCH_PRINT(999, "ERROR in %s: only first %d / %d decompressed bytes were correct\n",
-            //     desc->name, (int32_t)cmn, (int32_t)max_chunk_sz);
-            // }
-
-            free_data_buffer(decomp_buff);
-
-            // return decomp_sz;
-            return std::make_tuple(decomp_sz, elapsed_nanos);
-        // });
-        };
-    // }
-
-    // TODO uncomment below
-    //
-    // auto debug_lambda = [](int64_t i) { std::cout << i << "\n"; return i; };
-    for (int i = 0; i < nthreads; i++) {
-        thread_results_futures.push_back(std::async(run_in_thread, i));
-        // thread_results_futures.push_back(std::async(debug_lambda, i));
-    }
-    // printf("about to try get()ing all the futures...\n");
-    for (int i = 0; i < nthreads; i++) {
-        thread_results[i] = thread_results_futures[i].get();
-        // thread_results_futures[i].get();
-    }
-
-
-    // // Single threaded version (for debugging)
-    // for (int i = 0; i < nthreads; i++) {
-    //     thread_results[i] = run_in_thread(i);
-    // }
-
-    // for (auto& t : threads) {
-    //     t.join();
-    // }
-
-    // printf("total sizes: ");
-    // for (auto res : thread_results) {
-    //     printf("(%lldB, %lldns), ", std::get<0>(res), std::get<1>(res));
-    // }
-    // printf("\n");
-
-    // compute total amount of data all the threads got through
+    WorkerPool& pool = _get_worker_pool(nthreads, params->pin_threads);
+
+    // everyone starts the clock together once they've set up, and stops as
+    // soon as the first thread runs out of time, so that all the threads
+    // are measured while competing with one another
+    SpinBarrier start_barrier(nthreads);
+    std::atomic<bool> stop(false);
+
+    auto run_in_thread = [&](int i) {
+        // each thread picks chunks with its own generator, since rand()
+        // takes a global lock; seeding with the thread index makes the
+        // sequence of chunks the same in every run
+        std::minstd_rand rng(i + 1);
+
+        // allocated after pinning, so it's on this thread's NUMA node
+        uint8_t* decomp_buff = alloc_data_buffer(max_chunk_sz + 4096);
+        uint8_t* tile_buff = params->tile_size ?
+            alloc_data_buffer(max_chunk_sz + 4096) : NULL;
+        // codecs like zstd keep their decompression context in workmem, so
+        // sharing one between threads corrupts it
+        char* thread_workmem = desc->init ?
+            desc->init(max_chunk_sz, param1, param2) : workmem;
+        PerfCounters perf(params->perf_counters != 0);
+
+        int64_t decomp_sz = 0;
+        int64_t niters = 0;
+        uint64_t elapsed_nanos = 0;
+
+        start_barrier.wait();
+        perf.start();
+        bench_timer_t t_start, t_end, t_prev;
+        GetTime(t_start);
+        t_prev = t_start;
+        do {
+            auto chunk_idx = rng() % num_chunks;
+            auto inptr = inbuf + compressed_chunk_starts[chunk_idx];
+            auto insize = compr_sizes[chunk_idx];
+            auto rawsize = chunk_sizes[chunk_idx];
+
+            _decomp_and_query(params, desc, inptr, insize,
+                decomp_buff, rawsize, tile_buff, already_materialized,
+                param1, param2, thread_workmem);
+
+            decomp_sz += rawsize;
+            niters++;
+
+            GetTime(t_end);
+            elapsed_nanos = GetDiffTime(rate, t_start, t_end);
+            if (params->latency) {
+                thread_latencies[i].record(GetDiffTime(rate, t_prev, t_end));
+                t_prev = t_end;
+            }
+            if (elapsed_nanos >= run_for_nanosecs) {
+                stop.store(true, std::memory_order_relaxed);
+            }
+        } while (!stop.load(std::memory_order_relaxed));
+        perf.stop(decomp_sz);
+
+        LZBENCH_PRINT(8, "%d) elapsed iters, time: %lld, %lld/%lldns\n",
+            i, (long long)niters, (long long)elapsed_nanos,
+            (long long)run_for_nanosecs);
+
+        free_data_buffer(decomp_buff);
+        if (tile_buff) { free_data_buffer(tile_buff); }
+        if (desc->init && desc->deinit) { desc->deinit(thread_workmem); }
+        thread_decomp_sizes[i] = decomp_sz;
+        thread_nanos[i] = elapsed_nanos;
+        thread_perf[i] = perf.counts;
+    };
+    pool.run(run_in_thread);
+
+    // aggregate throughput is everything the threads got through over the
+    // time they were all running
     int64_t total_scanned_bytes = 0;
-    int64_t total_cpu_time = 0;
-    for (auto res : thread_results) {
-        total_scanned_bytes += std::get<0>(res);
-        total_cpu_time += std::get<1>(res);
+    uint64_t wall_nanos = 0;
+    for (int i = 0; i < nthreads; i++) {
+        total_scanned_bytes += thread_decomp_sizes[i];
+        wall_nanos = std::max(wall_nanos, thread_nanos[i]);
+        params->decomp_perf.add(thread_perf[i]);
+        if (params->latency) {
+            params->decomp_latency.add(thread_latencies[i]);
+        }
     }
-    double thruput_bytes_per_cpu_ns = total_scanned_bytes / (double)total_cpu_time;
-    int64_t thruput_MB_per_sec = (int64_t)((thruput_bytes_per_cpu_ns * 1000) * nthreads);
-
-    // if (!run_for_nanosecs) { // this case shouldn't be used for real results
-    //     bench_timer_t t_end;
-    //     GetTime(t_end);
-    //     // printf("WARNING: minimum run time not specified\n");
-    //     run_for_nanosecs = GetDiffTime(rate, t_start, t_end);
-    // }
-    // auto run_for_usecs = run_for_nanosecs / 1000;
-    // auto thruput_MB_per_sec = total_scanned_bytes / run_for_usecs;
-    // printf(">> \1%s avg thruput: %lld(MB/s)\n", desc->name, thruput_MB_per_sec);
-    // printf(">> \1%s avg thruput: %lld(MB/s)\n", desc->name, thruput_MB_per_sec);
 
     size_t complen = 0;
     for (auto sz : compr_sizes) { complen += sz; }
 
+    // print_stats uses one input size for the compression speed, ratio, and
+    // decompression speed, so report the time it would have taken to get
+    // through the input once at the aggregate speed
     bool decomp_error = false;
-    std::vector<uint64_t> decomp_times {total_cpu_time};
-    size_t insize = total_scanned_bytes;
+    uint64_t nanos_per_pass = total_scanned_bytes > 0 ?
+        (uint64_t)((double)wall_nanos * total_raw_sz / total_scanned_bytes) : 0;
+    std::vector<uint64_t> decomp_times {nanos_per_pass};
+    size_t insize = total_raw_sz;
     print_stats(params, desc, param1, comp_times, decomp_times, insize,
         complen, decomp_error);
 
-    // printf("------------------------");
+    std::vector<int> cpus;
+    for (int i = 0; i < nthreads; i++) { cpus.push_back(pool.cpu(i)); }
+    print_thread_stats(params, "decompr.", thread_decomp_sizes, thread_nanos,
+        cpus);
 }
 
 
+int64_t parallel_comp(lzbench_params_t *params,
+    std::vector<size_t>& chunk_sizes, const compressor_desc_t* desc,
+    std::vector<size_t> &compr_sizes, const uint8_t *inbuf, uint8_t *outbuf,
+    size_t outsize, bench_rate_t rate, std::vector<uint64_t>& comp_times,
+    ThreadStats& thread_stats, size_t param1, size_t param2)
+{
+    int nthreads = params->nthreads;
+    WorkerPool& pool = _get_worker_pool(nthreads, params->pin_threads);
+
+    // every chunk gets its own output slot, big enough for any compressed
+    // size, so workers never have to know how big the chunks before theirs
+    // compressed to
+    auto num_chunks = chunk_sizes.size();
+    std::vector<size_t> chunk_starts, slot_starts;
+    size_t max_chunk_sz = 0, slots_sz = 0, total_raw_sz = 0;
+    for (auto sz : chunk_sizes) {
+        chunk_starts.push_back(total_raw_sz);
+        slot_starts.push_back(slots_sz);
+        total_raw_sz += sz;
+        slots_sz += GET_COMPRESS_BOUND(sz);
+        max_chunk_sz = std::max(max_chunk_sz, sz);
+    }
+    uint8_t* slots = alloc_data_buffer(slots_sz);
+    std::vector<int64_t> slot_sizes(num_chunks);
+
+    // each worker gets its own workmem and preprocessing buffer, allocated
+    // in the worker itself so they're on its NUMA node when pinned
+    std::vector<char*> workmems(nthreads, NULL);
+    std::vector<uint8_t*> tmpbufs(nthreads, NULL);
+    std::vector<std::unique_ptr<PerfCounters> > perfs(nthreads);
+    std::vector<LatencyHistogram> latencies(params->latency ? nthreads : 0);
+    pool.run([&](int i) {
+        if (desc->init) {
+            workmems[i] = desc->init(max_chunk_sz, param1, param2);
+        }
+        tmpbufs[i] = alloc_data_buffer(GET_COMPRESS_BOUND(max_chunk_sz));
+        perfs[i].reset(new PerfCounters(params->perf_counters != 0));
+    });
+
+    thread_stats.sizes.assign(nthreads, 0);
+    thread_stats.nanos.assign(nthreads, 0);
+    thread_stats.cpus.clear();
+    for (int i = 0; i < nthreads; i++) {
+        thread_stats.cpus.push_back(pool.cpu(i));
+    }
+
+    // each pass compresses every chunk once, with workers taking the next
+    // chunk nobody has started yet until there are none left; the workers
+    // all start together, so a pass takes as long as the slowest one
+    SpinBarrier start_barrier(nthreads);
+    std::atomic<size_t> next_chunk(0);
+    std::vector<uint64_t> pass_nanos(nthreads);
+
+    auto run_in_thread = [&](int i) {
+        auto compress = desc->compress;
+        uint8_t* tmpbuf = tmpbufs[i];
+        char* workmem = workmems[i];
+
+        start_barrier.wait();
+        perfs[i]->start();
+        bench_timer_t t_start, t_end;
+        GetTime(t_start);
+
+        int64_t nbytes = 0;
+        size_t chunk_idx;
+        bench_timer_t t_chunk;
+        while ((chunk_idx = next_chunk.fetch_add(1)) < num_chunks) {
+            if (params->latency) { GetTime(t_chunk); }
+            auto part = chunk_sizes[chunk_idx];
+            slot_sizes[chunk_idx] = compress_preprocessed(params, compress,
+                inbuf + chunk_starts[chunk_idx], part, tmpbuf,
+                slots + slot_starts[chunk_idx], GET_COMPRESS_BOUND(part),
+                param1, param2, workmem);
+            nbytes += part;
+            if (params->latency) {
+                GetTime(t_end);
+                latencies[i].record(GetDiffTime(rate, t_chunk, t_end));
+            }
+        }
+
+        GetTime(t_end);
+        perfs[i]->stop(nbytes);
+        pass_nanos[i] = GetDiffTime(rate, t_start, t_end);
+        thread_stats.sizes[i] += nbytes;
+        thread_stats.nanos[i] += pass_nanos[i];
+    };
+
+    // compress the data until we hit either the minimum time or the minimum
+    // number of iterations, like the single-threaded loop
+    uint64_t total_nanos = 0;
+    uint32_t niters = 0;
+    bool too_slow = false;
+    bool enough = false;
+    StoppingRule stopping_rule(params->stable_pct, params->stable_max_secs,
+        params->timetype);
+    do {
+        next_chunk.store(0);
+        pool.run(run_in_thread);
+
+        uint64_t nanos = *std::max_element(pass_nanos.begin(),
+            pass_nanos.end());
+        comp_times.push_back(nanos);
+        total_nanos += nanos;
+        niters++;
+
+        float speed = nanos > 0 ? (float)total_raw_sz * 1000 / nanos : -1;
+        if ((uint32_t)speed < params->cspeed) {
+            LZBENCH_PRINT(7, "%s slower than %d MB/s\n",
+                desc->name, (uint32_t)speed);
+            too_slow = true;
+            break;
+        }
+        LZBENCH_PRINT(2, "%s compr iter=%d time=%.2fs speed=%.2f MB/s     \r",
+            desc->name, niters, total_nanos/1000000000.0, speed);
+        if (params->stable_pct > 0) {
+            enough = stopping_rule.add(nanos, total_nanos) &&
+                niters >= params->c_iters;
+        } else {
+            enough = niters >= params->c_iters &&
+                total_nanos > (uint64_t)params->cmintime*1000000;
+        }
+    } while (!enough);
+    if (params->stable_pct > 0 && !too_slow) {
+        comp_times = stopping_rule.steady_samples();
+        params->comp_ci = stopping_rule.ci();
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+        params->comp_perf.add(perfs[i]->counts);
+        if (params->latency) { params->comp_latency.add(latencies[i]); }
+    }
+    pool.run([&](int i) {
+        if (desc->deinit) { desc->deinit(workmems[i]); }
+        free_data_buffer(tmpbufs[i]);
+        perfs[i].reset(); // counters belong to the thread that opened them
+    });
+
+    // gather the chunks into one contiguous buffer for decompression; like
+    // the single-threaded version, chunks that failed to compress are
+    // stored raw
+    int64_t complen = 0;
+    compr_sizes.resize(num_chunks);
+    for (size_t c = 0; c < num_chunks && !too_slow; c++) {
+        auto part = chunk_sizes[c];
+        int64_t clen = slot_sizes[c];
+        const uint8_t* src = slots + slot_starts[c];
+        if (clen <= 0) {
+            LZBENCH_PRINT(3, "WARNING: got compressed data length of %lld!\n",
+                (long long)clen);
+            src = inbuf + chunk_starts[c];
+            clen = part;
+        }
+        if (complen + clen > (int64_t)outsize) { complen = 0; break; }
+        memcpy(outbuf + complen, src, clen);
+        compr_sizes[c] = clen;
+        complen += clen;
+    }
+    free_data_buffer(slots);
 
+    return complen;
+}
@@ -15,10 +15,27 @@
 //     int level, uint8_t *compbuf, uint8_t *decomp, uint8_t *tmp,  bench_rate_t rate,
 //     size_t param1, std::vector<size_t> compr_sizes, char* workmem=NULL);
 
+// bytes each worker got through, the time it spent on them, and which cpu
+// it's pinned to (or -1)
+typedef struct ThreadStats {
+    std::vector<int64_t> sizes;
+    std::vector<uint64_t> nanos;
+    std::vector<int> cpus;
+} ThreadStats;
+
 void parallel_decomp(lzbench_params_t *params,
     std::vector<size_t>& chunk_sizes, const compressor_desc_t* desc,
     std::vector<size_t> &compr_sizes, const uint8_t *inbuf, uint8_t *outbuf,
     uint8_t* tmpbuf, bench_rate_t rate, std::vector<uint64_t> comp_times,
     size_t param1, size_t param2, char* workmem);
 
+// compresses the chunks on the worker pool, writing them contiguously into
+// outbuf and their sizes into compr_sizes; returns the total compressed
+// size, or 0 if the codec was slower than -s or the output didn't fit
+int64_t parallel_comp(lzbench_params_t *params,
+    std::vector<size_t>& chunk_sizes, const compressor_desc_t* desc,
+    std::vector<size_t> &compr_sizes, const uint8_t *inbuf, uint8_t *outbuf,
+    size_t outsize, bench_rate_t rate, std::vector<uint64_t>& comp_times,
+    ThreadStats& thread_stats, size_t param1, size_t param2);
+
 #endif
@@ -0,0 +1,126 @@
+//
+// perf_counters.cpp
+// Hardware performance counters around the timed loops (-P)
+//
+
+#include "perf_counters.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+void perf_counts::add(const perf_counts& other) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (other.counts[e] < 0) { continue; }
+        counts[e] = (counts[e] < 0 ? 0 : counts[e]) + other.counts[e];
+    }
+    nbytes += other.nbytes;
+}
+
+#ifdef __linux__
+
+static int _open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1; // works with perf_event_paranoid = 2
+    attr.exclude_hv = 1;
+    // with more events than hardware counters, the kernel time-slices them;
+    // these let us scale the counts back up
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t _cache_miss_config(uint64_t cache) {
+    return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+}
+
+PerfCounters::PerfCounters(bool enabled) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) { fds[e] = -1; }
+    if (!enabled) { return; }
+
+    fds[PERF_CYCLES] = _open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_CPU_CYCLES);
+    fds[PERF_INSTRUCTIONS] = _open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_INSTRUCTIONS);
+    fds[PERF_L1D_MISSES] = _open_counter(PERF_TYPE_HW_CACHE,
+        _cache_miss_config(PERF_COUNT_HW_CACHE_L1D));
+    fds[PERF_LLC_MISSES] = _open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_CACHE_MISSES);
+    fds[PERF_BRANCH_MISSES] = _open_counter(PERF_TYPE_HARDWARE,
+        PERF_COUNT_HW_BRANCH_MISSES);
+    fds[PERF_DTLB_MISSES] = _open_counter(PERF_TYPE_HW_CACHE,
+        _cache_miss_config(PERF_COUNT_HW_CACHE_DTLB));
+
+    bool any_open = false;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) { any_open |= fds[e] >= 0; }
+    static bool warned = false;
+    if (!any_open && !warned) {
+        warned = true;
+        fprintf(stderr, "WARNING: couldn't open any hardware performance "
+            "counters; check /proc/sys/kernel/perf_event_paranoid\n");
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (fds[e] >= 0) { close(fds[e]); }
+    }
+}
+
+void PerfCounters::start() {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (fds[e] < 0) { continue; }
+        ioctl(fds[e], PERF_EVENT_IOC_ENABLE, 0);
+        if (read(fds[e], start_vals[e], sizeof(start_vals[e])) !=
+                sizeof(start_vals[e])) {
+            memset(start_vals[e], 0, sizeof(start_vals[e]));
+        }
+    }
+}
+
+void PerfCounters::stop(uint64_t nbytes) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (fds[e] < 0) { continue; }
+        uint64_t vals[3];
+        bool ok = read(fds[e], vals, sizeof(vals)) == sizeof(vals);
+        ioctl(fds[e], PERF_EVENT_IOC_DISABLE, 0);
+        if (!ok) { continue; }
+        double count = (double)(vals[0] - start_vals[e][0]);
+        uint64_t enabled = vals[1] - start_vals[e][1];
+        uint64_t running = vals[2] - start_vals[e][2];
+        if (running == 0) { continue; } // never got a hardware counter
+        if (running < enabled) { count *= (double)enabled / running; }
+        counts.counts[e] = (counts.counts[e] < 0 ? 0 : counts.counts[e]) +
+            (int64_t)count;
+    }
+    counts.nbytes += nbytes;
+}
+
+#else // no perf_event_open
+
+PerfCounters::PerfCounters(bool enabled) {
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) { fds[e] = -1; }
+    static bool warned = false;
+    if (enabled && !warned) {
+        warned = true;
+        fprintf(stderr, "WARNING: hardware performance counters are only "
+            "supported on Linux\n");
+    }
+}
+PerfCounters::~PerfCounters() {}
+void PerfCounters::start() {}
+void PerfCounters::stop(uint64_t nbytes) { counts.nbytes += nbytes; }
+
+#endif
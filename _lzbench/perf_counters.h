@@ -0,0 +1,57 @@
+//
+// perf_counters.h
+// Hardware performance counters around the timed loops (-P)
+//
+
+#ifndef _perf_counters_h
+#define _perf_counters_h
+
+#include <stdint.h>
+
+enum perf_event_e {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_NUM_EVENTS
+};
+
+// how many times each event happened while some number of bytes got
+// (de)compressed; counts are -1 for events that couldn't be counted
+typedef struct perf_counts {
+    int64_t counts[PERF_NUM_EVENTS];
+    uint64_t nbytes;
+
+    perf_counts() { clear(); }
+    void clear() {
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) { counts[e] = -1; }
+        nbytes = 0;
+    }
+    void add(const perf_counts& other);
+} perf_counts_t;
+
+// counters for the calling thread only, so each thread has to open its
+// own; if counters aren't available (not Linux, no PMU, or
+// perf_event_paranoid too high), start and stop do nothing and every count
+// stays -1
+class PerfCounters {
+public:
+    explicit PerfCounters(bool enabled);
+    ~PerfCounters();
+
+    void start();
+    void stop(uint64_t nbytes); // adds what happened since start to counts
+
+    perf_counts_t counts;
+
+private:
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    int fds[PERF_NUM_EVENTS];
+    uint64_t start_vals[PERF_NUM_EVENTS][3]; // value, time enabled, running
+};
+
+#endif
@@ -12,9 +12,274 @@
     #include "sprintz/predict.h"  // for simd xff preproc
     #include "sprintz/format.h"  // for simd delta preproc?
 #endif
+#ifndef BENCH_REMOVE_BLOSC
+    #include "blosc/shuffle.h"  // for simd byte and bit shuffling
+#endif
+
+#include <string.h>
+#include <algorithm>
+#ifdef __SSE2__
+    #include <emmintrin.h>
+#endif
 
 static const int64_t kDoubleDeltaThreshold = 1 << 16;
 
+// ------------------------------------------------ generic delta coding
+//
+// Delta and double delta coding for any element size and lag that Sprintz
+// doesn't already cover (notably 4 and 8 byte elements, and lags of 1 and 2).
+// The first lag elements are left as is. Encoding is a vertical subtract
+// of the input from itself lag elements back. Decoding is a prefix sum with
+// a stride of lag; when a vector holds no more than lag elements, each one
+// only depends on outputs from before the vector, so it's just a vertical
+// add, and otherwise each vector gets an in-register scan (log2 of the
+// vector length / lag shift-and-adds) plus the last lag outputs before it,
+// repeated across the vector.
+
+template<int ElemSz> struct delta_ops {};
+template<> struct delta_ops<1> { typedef uint8_t T;
+#ifdef __SSE2__
+    static __m128i add(__m128i a, __m128i b) { return _mm_add_epi8(a, b); }
+    static __m128i sub(__m128i a, __m128i b) { return _mm_sub_epi8(a, b); }
+#endif
+};
+template<> struct delta_ops<2> { typedef uint16_t T;
+#ifdef __SSE2__
+    static __m128i add(__m128i a, __m128i b) { return _mm_add_epi16(a, b); }
+    static __m128i sub(__m128i a, __m128i b) { return _mm_sub_epi16(a, b); }
+#endif
+};
+template<> struct delta_ops<4> { typedef uint32_t T;
+#ifdef __SSE2__
+    static __m128i add(__m128i a, __m128i b) { return _mm_add_epi32(a, b); }
+    static __m128i sub(__m128i a, __m128i b) { return _mm_sub_epi32(a, b); }
+#endif
+};
+template<> struct delta_ops<8> { typedef uint64_t T;
+#ifdef __SSE2__
+    static __m128i add(__m128i a, __m128i b) { return _mm_add_epi64(a, b); }
+    static __m128i sub(__m128i a, __m128i b) { return _mm_sub_epi64(a, b); }
+#endif
+};
+
+#ifdef __SSE2__
+#define LOADU(ptr) _mm_loadu_si128((const __m128i*)(ptr))
+#define STOREU(ptr, x) _mm_storeu_si128((__m128i*)(ptr), x)
+
+// x[j] += x[j - Shift] + x[j - 2*Shift] + ..., within one vector; the
+// shifts have to be compile-time constants, hence the recursion
+template<int ElemSz, int Shift, bool Done = (Shift * ElemSz >= 16)>
+struct delta_scan {
+    static __m128i run(__m128i x) {
+        x = delta_ops<ElemSz>::add(x, _mm_slli_si128(x, Shift * ElemSz));
+        return delta_scan<ElemSz, 2 * Shift>::run(x);
+    }
+};
+template<int ElemSz, int Shift> struct delta_scan<ElemSz, Shift, true> {
+    static __m128i run(__m128i x) { return x; }
+};
+
+// the lowest Lag elements of x, repeated to fill the vector
+template<int ElemSz, int Shift, bool Done = (Shift * ElemSz >= 16)>
+struct delta_repeat {
+    static __m128i run(__m128i x) {
+        x = _mm_or_si128(x, _mm_slli_si128(x, Shift * ElemSz));
+        return delta_repeat<ElemSz, 2 * Shift>::run(x);
+    }
+};
+template<int ElemSz, int Shift> struct delta_repeat<ElemSz, Shift, true> {
+    static __m128i run(__m128i x) { return x; }
+};
+
+// prefix sum with a stride of Lag < the vector length, from element i on;
+// everything before i must already be decoded
+template<int ElemSz, int Lag>
+static int64_t _decode_delta_scan(const uint8_t* inbuf, int64_t i,
+    int64_t nelements, uint8_t* outbuf)
+{
+    typedef typename delta_ops<ElemSz>::T T;
+    static const int kVecLen = 16 / ElemSz;
+    auto in = (const T*)inbuf;
+    auto out = (T*)outbuf;
+    __m128i prev = LOADU(out + i - kVecLen);
+    for (; i + kVecLen <= nelements; i += kVecLen) {
+        __m128i x = delta_scan<ElemSz, Lag>::run(LOADU(in + i));
+        __m128i carry = _mm_srli_si128(prev, (kVecLen - Lag) * ElemSz);
+        carry = delta_repeat<ElemSz, Lag>::run(carry);
+        prev = delta_ops<ElemSz>::add(x, carry);
+        STOREU(out + i, prev);
+    }
+    return i;
+}
+#endif // __SSE2__
+
+template<int ElemSz>
+static void _encode_delta(const uint8_t* inbuf, int64_t nelements,
+    uint8_t* outbuf, int64_t lag, bool double_delta)
+{
+    typedef typename delta_ops<ElemSz>::T T;
+    auto in = (const T*)inbuf;
+    auto out = (T*)outbuf;
+    int64_t head = std::min(lag, nelements);
+    memcpy(out, in, head * ElemSz);
+    int64_t i = lag;
+    if (double_delta) {
+        // the deltas of the deltas: x[i] - 2x[i-lag] + x[i-2*lag], except
+        // that the first lag deltas are relative to 0
+        for (; i < std::min(2 * lag, nelements); i++) {
+            out[i] = in[i] - 2 * in[i - lag];
+        }
+#ifdef __SSE2__
+        static const int kVecLen = 16 / ElemSz;
+        for (; i + kVecLen <= nelements; i += kVecLen) {
+            __m128i x = LOADU(in + i);
+            __m128i x1 = LOADU(in + i - lag);
+            __m128i x2 = LOADU(in + i - 2 * lag);
+            x = delta_ops<ElemSz>::sub(x, x1);
+            x = delta_ops<ElemSz>::sub(x, x1);
+            STOREU(out + i, delta_ops<ElemSz>::add(x, x2));
+        }
+#endif
+        for (; i < nelements; i++) {
+            out[i] = in[i] - 2 * in[i - lag] + in[i - 2 * lag];
+        }
+        return;
+    }
+#ifdef __SSE2__
+    static const int kVecLen = 16 / ElemSz;
+    for (; i + kVecLen <= nelements; i += kVecLen) {
+        STOREU(out + i, delta_ops<ElemSz>::sub(LOADU(in + i),
+            LOADU(in + i - lag)));
+    }
+#endif
+    for (; i < nelements; i++) {
+        out[i] = in[i] - in[i - lag];
+    }
+}
+
+// inbuf and outbuf can be the same
+template<int ElemSz>
+static void _decode_delta(const uint8_t* inbuf, int64_t nelements,
+    uint8_t* outbuf, int64_t lag, bool double_delta)
+{
+    typedef typename delta_ops<ElemSz>::T T;
+    auto in = (const T*)inbuf;
+    auto out = (T*)outbuf;
+    if (double_delta) { // undo the outer delta, then the inner one in place
+        _decode_delta<ElemSz>(inbuf, nelements, outbuf, lag, false);
+        _decode_delta<ElemSz>(outbuf, nelements, outbuf, lag, false);
+        return;
+    }
+    int64_t head = std::min(lag, nelements);
+    if (in != out) { memcpy(out, in, head * ElemSz); }
+    int64_t i = lag;
+#ifdef __SSE2__
+    static const int kVecLen = 16 / ElemSz;
+    if (lag >= kVecLen) {
+        for (; i + kVecLen <= nelements; i += kVecLen) {
+            STOREU(out + i, delta_ops<ElemSz>::add(LOADU(in + i),
+                LOADU(out + i - lag)));
+        }
+    } else {
+        // decode until there's a whole vector of output before i
+        for (; i < std::min((int64_t)kVecLen, nelements); i++) {
+            out[i] = in[i] + out[i - lag];
+        }
+        // lags that are too big for this element size never get here, so
+        // just instantiate them as lag 1
+        #define DELTA_SCAN_CASE(LAG) case LAG: \
+            i = _decode_delta_scan<ElemSz, (LAG < 16 / ElemSz ? LAG : 1)>( \
+                inbuf, i, nelements, outbuf); break;
+        if (i >= kVecLen) switch (lag) {
+            DELTA_SCAN_CASE(1) DELTA_SCAN_CASE(2) DELTA_SCAN_CASE(3)
+            DELTA_SCAN_CASE(4) DELTA_SCAN_CASE(5) DELTA_SCAN_CASE(6)
+            DELTA_SCAN_CASE(7) DELTA_SCAN_CASE(8) DELTA_SCAN_CASE(9)
+            DELTA_SCAN_CASE(10) DELTA_SCAN_CASE(11) DELTA_SCAN_CASE(12)
+            DELTA_SCAN_CASE(13) DELTA_SCAN_CASE(14) DELTA_SCAN_CASE(15)
+        }
+        #undef DELTA_SCAN_CASE
+    }
+#endif
+    for (; i < nelements; i++) {
+        out[i] = in[i] + out[i - lag];
+    }
+}
+
+#ifdef __SSE2__
+#undef LOADU
+#undef STOREU
+#endif
+
+static void _encode_delta(const uint8_t* inbuf, int64_t nelements,
+    uint8_t* outbuf, int64_t lag, bool double_delta, int element_sz)
+{
+    switch (element_sz) {
+    case 1: _encode_delta<1>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 2: _encode_delta<2>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 4: _encode_delta<4>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 8: _encode_delta<8>(inbuf, nelements, outbuf, lag, double_delta); break;
+    default:
+        printf("WARNING: ignoring invalid element size '%d'; must be in {1,2,4,8}\n", element_sz);
+    }
+}
+
+static void _decode_delta(const uint8_t* inbuf, int64_t nelements,
+    uint8_t* outbuf, int64_t lag, bool double_delta, int element_sz)
+{
+    switch (element_sz) {
+    case 1: _decode_delta<1>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 2: _decode_delta<2>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 4: _decode_delta<4>(inbuf, nelements, outbuf, lag, double_delta); break;
+    case 8: _decode_delta<8>(inbuf, nelements, outbuf, lag, double_delta); break;
+    default: break; // we warned about this when applying it
+    }
+}
+
+// ------------------------------------------------ shuffling
+//
+// Byte shuffling (-y) and bit shuffling (-Y) always run after the other
+// preprocessors, whatever order they were passed in, and get undone before
+// them, so that, e.g., -d4 -Y bitshuffles the deltas. They can't work in
+// place, so the deltas go to a per-thread scratch buffer first; its second
+// half is the temporary space bitshuffle needs.
+
+static bool _is_shuffle(int64_t preproc) {
+    return preproc == BYTESHUFFLE || preproc == BITSHUFFLE;
+}
+
+static uint8_t* _shuffle_scratch(size_t size) {
+    static thread_local std::vector<uint8_t> buff;
+    if (buff.size() < 2 * size) { buff.resize(2 * size); }
+    return buff.data();
+}
+
+// bitshuffle only takes a multiple of 8 elements, so any elements past
+// that, like any bytes past the last whole element, are copied as is
+static void _shuffle(int64_t preproc, const uint8_t* src, size_t size,
+    int element_sz, uint8_t* dest, uint8_t* tmp, bool undo)
+{
+    size_t len = 0;
+#ifndef BENCH_REMOVE_BLOSC
+    size_t nelements = size / element_sz;
+    if (preproc == BITSHUFFLE) { nelements -= nelements % 8; }
+    len = nelements * element_sz;
+    if (len > 0 && preproc == BYTESHUFFLE) {
+        if (undo) {
+            unshuffle(element_sz, len, src, dest);
+        } else {
+            shuffle(element_sz, len, src, dest);
+        }
+    } else if (len > 0) {
+        if (undo) {
+            bitunshuffle(element_sz, len, src, dest, tmp);
+        } else {
+            bitshuffle(element_sz, len, src, dest, tmp);
+        }
+    }
+#endif
+    memcpy(dest + len, src + len, size - len);
+}
+
 void apply_preprocessors(const std::vector<int64_t>& preprocessors,
     const uint8_t* inbuf, size_t size, int element_sz, uint8_t* outbuf)
 {
@@ -29,6 +294,17 @@ void apply_preprocessors(const std::vector<int64_t>& preprocessors,
     // printf("size=%lu, sz=%lu, element_sz=%d\n", size, sz, element_sz);
     // printf("size=%lu, element_sz=%lu, nelements=%lld\n", size, sz, element_sz, nelements);
 
+    int64_t shuf = 0;
+    size_t nshuffles = 0;
+    for (auto preproc : preprocessors) {
+        if (_is_shuffle(preproc)) { shuf = preproc; nshuffles++; }
+    }
+#ifdef BENCH_REMOVE_BLOSC
+    if (shuf) { printf("WARNING: shuffling needs blosc; ignoring it\n"); }
+#endif
+    uint8_t* shuf_out = outbuf;
+    uint8_t* scratch = shuf ? _shuffle_scratch(size) : NULL;
+    if (shuf && nshuffles < preprocessors.size()) { outbuf = scratch; }
 
     for (auto preproc : preprocessors) {
         // printf("applying preproc: %lld with nelements=%lld, element_sz=%d\n", preproc, nelements, sz);
@@ -36,6 +312,7 @@ void apply_preprocessors(const std::vector<int64_t>& preprocessors,
 
         // if ((preproc < 1) || (preproc > 4)) {
 
+        if (_is_shuffle(preproc)) { continue; }
         if (preproc == 0) {
             printf("WARNING: ignoring unrecognized preprocessor number '0'\n");
             continue;
@@ -109,69 +386,29 @@ void apply_preprocessors(const std::vector<int64_t>& preprocessors,
 
         // printf("didn't apply any preproc for offset %lld...\n", offset);
 
-#else
-        if ((preproc > 4)) { // TODO better err message saying need sprintz
-            printf("WARNING: ignoring unrecognized preprocessor number '%lld'\n", preproc);
-            continue;
-        }
 #endif
 
-        memcpy(outbuf, inbuf, offset * sz);
-
-
-#define DELTAS_FOR_OFFSET(OFFSET) \
-        switch(sz) { \
-        case 1: \
-            { \
-                auto in = (uint8_t*)inbuf; \
-                auto out = (uint8_t*)outbuf; \
-                for (int i = OFFSET; i < nelements; i++) { \
-                    out[i] = in[i] - in[i-OFFSET]; \
-                } \
-            } break; \
-        case 2: \
-            { \
-                auto in = (uint16_t*)inbuf; \
-                auto out = (uint16_t*)outbuf; \
-                for (int i = OFFSET; i < nelements; i++) { \
-                    out[i] = in[i] - in[i-OFFSET]; \
-                } \
-            } break; \
-        case 4: \
-            { \
-                auto in = (uint32_t*)inbuf; \
-                auto out = (uint32_t*)outbuf; \
-                for (int i = OFFSET; i < nelements; i++) { \
-                    out[i] = in[i] - in[i-OFFSET]; \
-                } \
-            } break; \
-        case 8: \
-            { \
-                auto in = (uint64_t*)inbuf; \
-                auto out = (uint64_t*)outbuf; \
-                for (int i = OFFSET; i < nelements; i++) { \
-                    out[i] = in[i] - in[i-OFFSET]; \
-                } \
-            } break; \
-        default: \
-            printf("WARNING: ignoring invalid element size '%d'; must be in {1,2,4,8}\n", element_sz); \
+        // everything else, including element sizes of 4 and 8 bytes and
+        // lags of 1 and 2
+        if (offset < 0) {
+            printf("WARNING: FIRE forecasting needs an element size of 1 or 2; ignoring it\n");
+            memcpy(outbuf, inbuf, size);
+            continue;
         }
+        _encode_delta(inbuf, nelements, outbuf, offset % kDoubleDeltaThreshold,
+            offset >= kDoubleDeltaThreshold, sz);
+    }
 
-        // tell compiler that offset is only going to be one of these 4
-        // values (2x speedup or more)
-        switch (offset) {
-        case 1:
-            DELTAS_FOR_OFFSET(1); break;
-        case 2:
-            DELTAS_FOR_OFFSET(2); break;
-        case 3:
-            DELTAS_FOR_OFFSET(3); break;
-        case 4:
-            DELTAS_FOR_OFFSET(4); break;
-        default:
-            printf("WARNING: ignoring invalid element size '%d'; must be in {1,2,4,8}\n", element_sz);
-            // memcpy(outbuf, inbuf, size);
-        }
+    // bytes past the last whole element aren't preprocessed, but still
+    // have to get to the codec
+    size_t tail = nelements * sz;
+    if (nshuffles < preprocessors.size() && tail < size) {
+        memcpy(outbuf + tail, inbuf + tail, size - tail);
+    }
+
+    if (shuf) {
+        const uint8_t* src = nshuffles < preprocessors.size() ? scratch : inbuf;
+        _shuffle(shuf, src, size, sz, shuf_out, scratch + size, false);
     }
 }
 
@@ -193,11 +430,29 @@ void undo_preprocessors(const std::vector<int64_t>& preprocessors,
     // printf("size=%lu, sz=%lu, element_sz=%d\n", size, sz, element_sz);
     // printf("size=%lu, element_sz=%lu, nelements=%lld\n", size, sz, element_sz, nelements);
 
+    int64_t shuf = 0;
+    size_t nshuffles = 0;
+    for (auto preproc : preprocessors) {
+        if (_is_shuffle(preproc)) { shuf = preproc; nshuffles++; }
+    }
+    if (shuf) {
+        uint8_t* scratch = _shuffle_scratch(size);
+        if (nshuffles == preprocessors.size()) { // nothing else to undo
+            uint8_t* dest = outbuf == inbuf ? scratch : outbuf;
+            _shuffle(shuf, inbuf, size, sz, dest, scratch + size, true);
+            if (dest != outbuf) { memcpy(outbuf, dest, size); }
+            return;
+        }
+        // the rest can undo their preprocessing from here into outbuf
+        _shuffle(shuf, inbuf, size, sz, scratch, scratch + size, true);
+        inbuf = scratch;
+    }
 
     for (auto preproc : preprocessors) {
         // printf("undoing preproc: %lld with nelements=%lld, element_sz=%d\n", preproc, nelements, sz);
         // continue;
 
+        if (_is_shuffle(preproc)) { continue; }
         if (preproc == 0) {
             printf("WARNING: ignoring unrecognized preprocessor number '0'\n");
             continue;
@@ -248,8 +503,7 @@ void undo_preprocessors(const std::vector<int64_t>& preprocessors,
             // printf("about to run double delta decoding using offset %d...\n", (int)offset);
             if (inbuf != outbuf) {
                 // printf("inbuf != outbuf!\n");
-                // decode_doubledelta_rowmajor_8b((int8_t*)inbuf, size, outbuf, offset);
-                decode_delta_rowmajor_8b((int8_t*)inbuf, nelements, outbuf, offset);
+                decode_doubledelta_rowmajor_8b((int8_t*)inbuf, nelements, outbuf, offset);
                 // printf("ran dbl delta decoding without crashing!\n");
             } else {
                 // printf("inbuf == outbuf! WTF\n");
@@ -299,59 +553,95 @@ void undo_preprocessors(const std::vector<int64_t>& preprocessors,
             }
             continue;
         }
-#else
-        if ((preproc > 4)) { // TODO better err message saying need sprintz
-            printf("WARNING: ignoring unrecognized preprocessor number '%lld'\n", preproc);
-            continue;
-        }
 #endif
 
-        memcpy(outbuf, inbuf, offset * sz);
-
-#define UNDO_DELTA_FOR_OFFSET(OFFSET) \
-        if (sz <= 1) { \
-            auto in = (uint8_t*)inbuf; \
-            auto out = (uint8_t*)outbuf; \
-            for (int i = OFFSET; i < nelements; i++) { \
-                out[i] = in[i] + out[i-OFFSET]; \
-            } \
-        } else if (sz == 2) { \
-            auto in = (uint16_t*)inbuf; \
-            auto out = (uint16_t*)outbuf; \
-            for (int i = OFFSET; i < nelements; i++) { \
-                out[i] = in[i] + out[i-OFFSET]; \
-            } \
-        } else if (sz == 4) { \
-            auto in = (uint32_t*)inbuf; \
-            auto out = (uint32_t*)outbuf; \
-            for (int i = OFFSET; i < nelements; i++) { \
-                out[i] = in[i] + out[i-OFFSET]; \
-            } \
-        } else if (sz == 8) { \
-            auto in = (uint64_t*)inbuf; \
-            auto out = (uint64_t*)outbuf; \
-            for (int i = OFFSET; i < nelements; i++) { \
-                out[i] = in[i] + out[i-OFFSET]; \
-            } \
-        } else { \
-            printf("WARNING: ignoring invalid element size '%d'; must be in {1,2,4,8}\n", element_sz); \
+        if (offset < 0) { // we warned about this when applying it
+            if (inbuf != outbuf) { memcpy(outbuf, inbuf, size); }
+            continue;
         }
+        _decode_delta(inbuf, nelements, outbuf, offset % kDoubleDeltaThreshold,
+            offset >= kDoubleDeltaThreshold, sz);
+    }
 
-        // compiler doesn't know that offset is only going to be one of these
-        // 4 values, and so produces 2-3x slower code if we don't this
-        switch (offset) {
-        case 1:
-            UNDO_DELTA_FOR_OFFSET(1); break;
-        case 2:
-            UNDO_DELTA_FOR_OFFSET(2); break;
-        case 3:
-            UNDO_DELTA_FOR_OFFSET(3); break;
-        case 4:
-            UNDO_DELTA_FOR_OFFSET(4); break;
-        default:
-            break; // we checked that offset was in {1,..,4} above
-        }
+    size_t tail = nelements * sz;
+    if (inbuf != outbuf && tail < size) {
+        memcpy(outbuf + tail, inbuf + tail, size - tail);
+    }
+}
+
+// -F: instead of preprocessing a whole chunk and then compressing it (or
+// decompressing a whole chunk and then undoing the preprocessing), which
+// for big chunks means an extra trip through DRAM each way, preprocessing
+// and the codec take turns on tiles small enough to stay in L2. Each tile
+// gets preprocessed on its own, as if it were its own chunk, so the
+// compressed data differs from what you'd get without -F.
+typedef struct tile_ctx {
+    lzbench_params_t *params;
+    const uint8_t* src; // compression: the raw chunk
+    uint8_t* dest; // decompression: where the raw chunk goes
+} tile_ctx_t;
+
+static void _apply_to_tile(char *tile, size_t offset, size_t size, void* ctx) {
+    auto t = (tile_ctx_t*)ctx;
+    apply_preprocessors(t->params->preprocessors, t->src + offset, size,
+        t->params->data_info.element_sz, (uint8_t*)tile);
+}
 
-#undef UNDO_DELTA_FOR_OFFSET
+static void _undo_tile(char *tile, size_t offset, size_t size, void* ctx) {
+    auto t = (tile_ctx_t*)ctx;
+    undo_preprocessors(t->params->preprocessors, (uint8_t*)tile, size,
+        t->params->data_info.element_sz, t->dest + offset);
+}
+
+static bool _can_tile(lzbench_params_t *params, compress_func f) {
+#ifndef BENCH_REMOVE_ZSTD
+    return params->tile_size > 0 && params->preprocessors.size() > 0 &&
+        (f == lzbench_zstd_compress || f == lzbench_zstd_decompress);
+#else
+    return false;
+#endif
+}
+
+int64_t compress_preprocessed(lzbench_params_t *params, compress_func compress,
+    const uint8_t* inbuf, size_t size, uint8_t* tmpbuf, uint8_t* outbuf,
+    size_t outsize, size_t param1, size_t param2, char* workmem)
+{
+#ifndef BENCH_REMOVE_ZSTD
+    if (_can_tile(params, compress)) {
+        tile_ctx_t ctx = {params, inbuf, NULL};
+        return lzbench_zstd_tiled_compress((char*)tmpbuf, size, (char*)outbuf,
+            outsize, param1, param2, workmem, params->tile_size,
+            _apply_to_tile, &ctx);
+    }
+#endif
+    const uint8_t* inptr = inbuf;
+    if (params->preprocessors.size() > 0) {
+        apply_preprocessors(params->preprocessors, inbuf, size,
+            params->data_info.element_sz, tmpbuf);
+        inptr = (const uint8_t*)tmpbuf;
+    }
+    return compress((char*)inptr, size, (char*)outbuf, outsize, param1,
+        param2, workmem);
+}
+
+int64_t decompress_preprocessed(lzbench_params_t *params,
+    compress_func decompress, const uint8_t* inbuf, size_t insize,
+    uint8_t* outbuf, size_t outsize, uint8_t* tmpbuf, size_t param1,
+    size_t param2, char* workmem)
+{
+#ifndef BENCH_REMOVE_ZSTD
+    if (_can_tile(params, decompress)) {
+        tile_ctx_t ctx = {params, NULL, outbuf};
+        return lzbench_zstd_tiled_decompress((char*)inbuf, insize,
+            (char*)tmpbuf, outsize, param1, param2, workmem, params->tile_size,
+            _undo_tile, &ctx);
+    }
+#endif
+    int64_t dlen = decompress((char*)inbuf, insize, (char*)outbuf, outsize,
+        param1, param2, workmem);
+    if (dlen > 0) { // else it's an error code, not a size
+        undo_preprocessors(params->preprocessors, outbuf, dlen,
+            params->data_info.element_sz);
     }
+    return dlen;
 }
@@ -9,9 +9,23 @@
 #include <stdint.h>
 #include <vector>
 
+#include "lzbench.h"
+
 void apply_preprocessors(const std::vector<int64_t>& preprocessors,
     const uint8_t* inbuf, size_t size, int element_sz, uint8_t* outbuf);
 void undo_preprocessors(const std::vector<int64_t>& preprocessors,
     uint8_t* inbuf, size_t size, int element_sz, uint8_t* outbuf=nullptr);
 
+// compresses one chunk after applying params->preprocessors to it, using
+// tmpbuf (at least size bytes) for the preprocessed data; with -F, codecs
+// that can compress a tile at a time get each tile while it's still in cache
+int64_t compress_preprocessed(lzbench_params_t *params, compress_func compress,
+    const uint8_t* inbuf, size_t size, uint8_t* tmpbuf, uint8_t* outbuf,
+    size_t outsize, size_t param1, size_t param2, char* workmem);
+// the inverse; tmpbuf (at least outsize bytes) is only needed with -F
+int64_t decompress_preprocessed(lzbench_params_t *params,
+    compress_func decompress, const uint8_t* inbuf, size_t insize,
+    uint8_t* outbuf, size_t outsize, uint8_t* tmpbuf, size_t param1,
+    size_t param2, char* workmem);
+
 #endif
@@ -3,6 +3,9 @@
 #define QUERY_HPP
 
 #include "query_common.h"
+#include "query_bucket.hpp"
+#include "query_corr.hpp"
+#include "query_histogram.hpp"
 #include "query_mean.hpp"
 #include "query_minmax.hpp"
 #include "query_reduce_row.hpp"
@@ -65,28 +68,103 @@
 // }
 
 template<class DataT>
-QueryResult corr(const QueryParams& q, const DataInfo& di,
-    const DataT* buff)
+void _frobnicate(const QueryParams& q, const DataInfo& di, const DataT* buff,
+    QueryResult& ret) {
+    printf("actually running frobnicate; query_type=%d!\n", (int)q.type);
+}
+
+// buff is likely to be a byte* regardless of what it holds, so pick the
+// real data type based on the element size
+template<int ElemSz, class DataT>
+static inline void sliding_query(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
+    using RealDataType = typename ElemSizeTraits<ElemSz>::DataT;
+    if (q.type == QUERY_MEAN) {
+        sliding_mean(q, di, (const RealDataType*)buff, ret);
+        return;
+    }
+    sliding_min_or_max<ElemSz>(q, di, buff, ret);
+}
 
+template<int ElemSz, class DataT>
+static inline void cov_or_corr(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
+    using RealDataType = typename ElemSizeTraits<ElemSz>::DataT;
+    if (q.type == QUERY_COV) {
+        cov(q, di, (const RealDataType*)buff, ret);
+        return;
+    }
+    corr(q, di, (const RealDataType*)buff, ret);
 }
 
+template<int ElemSz, class DataT>
+static inline void bucket_query(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
+    using RealDataType = typename ElemSizeTraits<ElemSz>::DataT;
+    bucket_min_max_mean(q, di, (const RealDataType*)buff, ret);
+}
 
-template<class DataT>
-QueryResult _frobnicate(const QueryParams& q, const DataInfo& di, const DataT* buff) {
-    printf("actually running frobnicate; query_type=%d!\n", (int)q.type);
-    return QueryResult{};
+template<int ElemSz, class DataT>
+static inline void histogram_query(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
+    using RealDataType = typename ElemSizeTraits<ElemSz>::DataT;
+    histogram(q, di, (const RealDataType*)buff, ret);
 }
 
+// writes into ret, reusing whatever storage it already has; callers that
+// run queries repeatedly should hold onto one QueryResult per query so that
+// steady-state queries don't allocate
 template<class DataT>
-QueryResult run_query(const QueryParams& q, const DataInfo& di, const DataT* buff) {
-
+void run_query(const QueryParams& q, const DataInfo& di, const DataT* buff,
+    QueryResult& ret)
+{
     // printf("actually running run_query; query_type=%d!\n", (int)q.type);
 
+    // pairwise stats between columns, within windows or over whole buffer
+    if (q.type == QUERY_COV || q.type == QUERY_CORR) {
+        switch (di.element_sz) {
+        case 1: cov_or_corr<1>(q, di, buff, ret); return;
+        case 2: cov_or_corr<2>(q, di, buff, ret); return;
+        default:
+            printf("Invalid element size %d!\n", (int)di.element_sz); exit(1);
+        }
+    }
+
+    // mean, min, and max within each non-overlapping bucket of rows
+    if (q.type == QUERY_BUCKET) {
+        switch (di.element_sz) {
+        case 1: bucket_query<1>(q, di, buff, ret); return;
+        case 2: bucket_query<2>(q, di, buff, ret); return;
+        default:
+            printf("Invalid element size %d!\n", (int)di.element_sz); exit(1);
+        }
+    }
+
+    // distribution of each column within each non-overlapping window
+    if (q.type == QUERY_HISTOGRAM) {
+        switch (di.element_sz) {
+        case 1: histogram_query<1>(q, di, buff, ret); return;
+        case 2: histogram_query<2>(q, di, buff, ret); return;
+        default:
+            printf("Invalid element size %d!\n", (int)di.element_sz); exit(1);
+        }
+    }
+
+    // mean / min / max within each window of q.window_nrows rows if a
+    // window was given (-w); otherwise just reduce the whole buffer
+    bool sliding = q.window_nrows > 0 && (q.type == QUERY_MEAN ||
+        q.type == QUERY_MIN || q.type == QUERY_MAX);
+
     // QueryResult ret;
     switch (di.element_sz) {
-    case 1: return reduce_contiguous<1>(q, di, buff);
-    case 2: return reduce_contiguous<2>(q, di, buff);
+    case 1: return sliding ? sliding_query<1>(q, di, buff, ret) :
+        reduce_contiguous<1>(q, di, buff, ret);
+    case 2: return sliding ? sliding_query<2>(q, di, buff, ret) :
+        reduce_contiguous<2>(q, di, buff, ret);
     // case 1: return frobnicate(q, di, buff);
     // case 2: return frobnicate(q, di, buff);
     default:
@@ -96,8 +174,6 @@ QueryResult run_query(const QueryParams& q, const DataInfo& di, const DataT* buf
     // switch (q.type) {
     //     // case QUERY_MEAN: ret = sliding_mean(q, di, buff); break;
     //     case QUERY_MEAN: ret = reduce_contiguous(q, di, buff); break;
-    //     // XXX "sliding" min and max actually just write out min/max seen
-    //     // so far, which is a weird thing to do
     //     case QUERY_MIN: ret = reduce_contiguous(q, di, buff); break;
     //     case QUERY_MAX: ret = reduce_contiguous(q, di, buff); break;
     //     // case QUERY_L2: ret = sliding_l2(q, di, buff); break;
@@ -120,7 +196,16 @@ QueryResult run_query(const QueryParams& q, const DataInfo& di, const DataT* buf
     //     printf("Unsupported reduction %d!\n", (int)q.reduction);
     //     exit(1);
     // }
-    return QueryResult{}; // can't happen, in theory
+}
+
+// allocates a fresh result on every call; fine for one-off queries
+template<class DataT>
+QueryResult run_query(const QueryParams& q, const DataInfo& di,
+    const DataT* buff)
+{
+    QueryResult ret;
+    run_query(q, di, buff, ret);
+    return ret;
 }
 
 #endif // QUERY_HPP
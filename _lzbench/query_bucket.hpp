@@ -0,0 +1,137 @@
+
+#ifndef QUERY_BUCKET_HPP
+#define QUERY_BUCKET_HPP
+
+#include "immintrin.h"
+#include <algorithm> // min
+#include <vector>
+
+#include "query_common.h"
+#include "query_corr.hpp" // load_widen_epu32
+
+// min, max, and mean of each (selected) column within each bucket of
+// q.window_nrows consecutive rows (or the whole buffer), for downsampling;
+// unlike the sliding queries, buckets don't overlap, so the output is
+// window_nrows times smaller than the input, and a trailing partial bucket
+// gets its own entry. Returns each bucket's nstats mins followed by its
+// nstats maxs in the vals vector for DataT, its nstats means in vals_f64,
+// and its starting row in idxs.
+//
+// Accumulates in 32-bit lanes, 8 cols at a time; this is lossless for
+// mins and maxs, and sums get moved into 64-bit totals before they can
+// overflow. Only contiguous rowmajor cols are widened as whole vectors;
+// anything else is gathered one element at a time.
+template<class DataT>
+void bucket_min_max_mean(const QueryParams& q, const DataInfo& di,
+    const DataT* buff, QueryResult& ret)
+{
+    static const uint32_t kMaxRowsPerFlush = 1 << 16;
+
+    auto& ret_vals = QueryResultValsRef<DataT>{}(ret);
+    int64_t nrows = di.nrows;
+    int64_t bucket_nrows = q.window_nrows > 0 ? q.window_nrows : nrows;
+    if (bucket_nrows < 1 || nrows < 1) {
+        ret_vals.clear();
+        ret.vals_f64.clear();
+        ret.idxs.clear();
+        return;
+    }
+    int64_t nbuckets = (nrows + bucket_nrows - 1) / bucket_nrows;
+
+    thread_local std::vector<uint16_t> which_dims;
+    which_dims.assign(q.which_cols.begin(), q.which_cols.end());
+    if (which_dims.size() == 0) {
+        for (uint16_t j = 0; j < di.ncols; j++) { which_dims.push_back(j); }
+    }
+    uint32_t nstats = (uint32_t)which_dims.size();
+
+    bool rowmajor = di.storage_order == ROWMAJOR;
+    uint32_t row_stride = rowmajor ? di.ncols : 1;
+    uint32_t col_stride = rowmajor ? 1 : di.nrows;
+    bool is_contiguous = rowmajor;
+    for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+        is_contiguous = is_contiguous && (which_dims[j_idx] == j_idx);
+    }
+    uint32_t nvec_stats = is_contiguous ? (nstats & ~7) : 0;
+
+    // one lane per stat, padded to whole vectors
+    uint32_t padded_nstats = (nstats + 7) & ~7;
+    thread_local std::vector<uint32_t> mins, maxs, sums;
+    thread_local std::vector<uint64_t> totals;
+    mins.resize(padded_nstats);
+    maxs.resize(padded_nstats);
+    sums.resize(padded_nstats);
+    totals.resize(padded_nstats);
+
+    ret_vals.resize(nbuckets * 2 * nstats);
+    ret.vals_f64.resize(nbuckets * nstats);
+    ret.idxs.resize(nbuckets);
+
+    for (int64_t b = 0; b < nbuckets; b++) {
+        int64_t start_row = b * bucket_nrows;
+        int64_t end_row = std::min(start_row + bucket_nrows, nrows);
+        std::fill(mins.begin(), mins.end(), (uint32_t)-1);
+        std::fill(maxs.begin(), maxs.end(), 0);
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(totals.begin(), totals.end(), 0);
+
+        for (int64_t flush_start = start_row; flush_start < end_row;
+            flush_start += kMaxRowsPerFlush)
+        {
+            int64_t flush_end = std::min(
+                flush_start + (int64_t)kMaxRowsPerFlush, end_row);
+            for (uint32_t j = 0; j < nvec_stats; j += 8) {
+                __m256i vmins = _mm256_set1_epi32(-1);
+                __m256i vmaxs = _mm256_setzero_si256();
+                __m256i vsums = _mm256_setzero_si256();
+                const DataT* ptr = buff + flush_start * row_stride + j;
+                for (int64_t i = flush_start; i < flush_end; i++) {
+                    __m256i x = load_widen_epu32(ptr);
+                    vmins = _mm256_min_epu32(vmins, x);
+                    vmaxs = _mm256_max_epu32(vmaxs, x);
+                    vsums = _mm256_add_epi32(vsums, x);
+                    ptr += row_stride;
+                }
+                __m256i* mins_ptr = (__m256i*)(mins.data() + j);
+                __m256i* maxs_ptr = (__m256i*)(maxs.data() + j);
+                _mm256_storeu_si256(mins_ptr,
+                    _mm256_min_epu32(_mm256_loadu_si256(mins_ptr), vmins));
+                _mm256_storeu_si256(maxs_ptr,
+                    _mm256_max_epu32(_mm256_loadu_si256(maxs_ptr), vmaxs));
+                _mm256_storeu_si256((__m256i*)(sums.data() + j), vsums);
+            }
+            for (uint32_t j_idx = nvec_stats; j_idx < nstats; j_idx++) {
+                const DataT* ptr = buff + flush_start * row_stride +
+                    which_dims[j_idx] * col_stride;
+                uint32_t min_val = mins[j_idx];
+                uint32_t max_val = maxs[j_idx];
+                uint32_t sum = 0;
+                for (int64_t i = flush_start; i < flush_end; i++) {
+                    uint32_t x = *ptr;
+                    min_val = min(min_val, x);
+                    max_val = max(max_val, x);
+                    sum += x;
+                    ptr += row_stride;
+                }
+                mins[j_idx] = min_val;
+                maxs[j_idx] = max_val;
+                sums[j_idx] = sum;
+            }
+            for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+                totals[j_idx] += sums[j_idx];
+            }
+        }
+
+        DataT* out = ret_vals.data() + b * 2 * nstats;
+        double* out_means = ret.vals_f64.data() + b * nstats;
+        double inv_nrows = 1. / (end_row - start_row);
+        for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+            out[j_idx] = (DataT)mins[j_idx];
+            out[nstats + j_idx] = (DataT)maxs[j_idx];
+            out_means[j_idx] = totals[j_idx] * inv_nrows;
+        }
+        ret.idxs[b] = start_row;
+    }
+}
+
+#endif // QUERY_BUCKET_HPP
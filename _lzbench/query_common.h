@@ -7,7 +7,8 @@
 
 enum query_type_e { QUERY_NONE = 0, QUERY_MEAN = 1, QUERY_MIN = 2,
     QUERY_MAX = 3, QUERY_L2 = 4, QUERY_DOT = 5, QUERY_NORM = 6,
-    QUERY_SUM = 7 };
+    QUERY_SUM = 7, QUERY_COV = 8, QUERY_CORR = 9, QUERY_BUCKET = 10,
+    QUERY_HISTOGRAM = 11 };
 enum query_reduction_e { REDUCE_NONE = 0, REDUCE_THRESH = 1, REDUCE_TOP_K = 2};
 enum storage_order_e { ROWMAJOR = 0, COLMAJOR = 1};
 
@@ -73,6 +74,7 @@ typedef struct QueryResult {
     std::vector<int16_t> vals_i16;
     std::vector<uint16_t> vals_u16;
     std::vector<int32_t> vals_i32;
+    std::vector<double> vals_f64;
 } QueryResult;
 
 typedef struct DataInfo {
@@ -0,0 +1,241 @@
+
+#ifndef QUERY_CORR_HPP
+#define QUERY_CORR_HPP
+
+#include "immintrin.h"
+#include <algorithm> // min
+#include <limits>
+#include <math.h>
+#include <utility> // swap
+#include <vector>
+
+#include "query_common.h"
+
+// prods[j, k] +/-= sum over rows of x[j] * x[k], for k >= j (and a few
+// k < j, which are never read). Each row of xs must be zero-padded to
+// padded_n, a multiple of 4, and prods needs padded_n entries per row.
+// Doing several rows at once keeps each accumulator in a register.
+template<bool Subtract>
+static inline void accumulate_outer_products(const uint32_t* xs,
+    uint32_t nrows, uint32_t n, uint32_t padded_n, uint64_t* prods)
+{
+    for (uint32_t j = 0; j < n; j++) {
+        uint64_t* prods_row = prods + j * padded_n;
+        for (uint32_t k = j & ~3; k < n; k += 4) {
+            __m256i accum = _mm256_loadu_si256((const __m256i*)(prods_row + k));
+            const uint32_t* x = xs;
+            for (uint32_t i = 0; i < nrows; i++) {
+                __m256i xj = _mm256_set1_epi64x(x[j]);
+                __m256i xk = _mm256_cvtepu32_epi64(
+                    _mm_loadu_si128((const __m128i*)(x + k)));
+                __m256i xjxk = _mm256_mul_epu32(xj, xk);
+                accum = Subtract ? _mm256_sub_epi64(accum, xjxk) :
+                    _mm256_add_epi64(accum, xjxk);
+                x += padded_n;
+            }
+            _mm256_storeu_si256((__m256i*)(prods_row + k), accum);
+        }
+    }
+}
+
+// 8 consecutive elements, zero-extended to 32 bits
+static inline __m256i load_widen_epu32(const uint8_t* p) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+}
+static inline __m256i load_widen_epu32(const uint16_t* p) {
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p));
+}
+
+// covariance and pearson correlation between each pair of (selected)
+// columns within the most recent nrows rows. Keeps exact integer sums of
+// each column and of each pairwise product, so there's no catastrophic
+// cancellation when computing the centered moments, and sliding the
+// window never accumulates error; the only rounding is in the final
+// division. Consecutive elements of a row are col_stride apart, so
+// colmajor data works without copying.
+template<class DataT>
+class OnlineCovRowmajor {
+public:
+    OnlineCovRowmajor(uint32_t nrows, uint32_t ncols,
+        const std::vector<uint16_t>& which_dims, uint32_t col_stride=1):
+        _which_dims(which_dims), _nrows(nrows), _ncols(ncols),
+        _col_stride(col_stride)
+    {
+        if (_which_dims.size() == 0) {
+            for (uint16_t j = 0; j < _ncols; j++) {
+                _which_dims.push_back(j);
+            }
+        }
+        // if we're using every col of rowmajor data, can widen whole vectors
+        _is_contiguous = col_stride == 1;
+        for (uint32_t j_idx = 0; j_idx < nstats(); j_idx++) {
+            _is_contiguous = _is_contiguous && (_which_dims[j_idx] == j_idx);
+        }
+        reset();
+    }
+
+    void init(const DataT* window_start, uint32_t row_stride) {
+        reset();
+        for (uint32_t i = 0; i < _nrows; i += kBlockNumRows) {
+            uint32_t nrows = std::min(kBlockNumRows, _nrows - i);
+            _accumulate<false>(window_start + i * row_stride, nrows, row_stride);
+        }
+    }
+
+    void update(const DataT* old_window_row, const DataT* new_window_row) {
+        _accumulate<true>(old_window_row, 1, 0);
+        _accumulate<false>(new_window_row, 1, 0);
+    }
+
+    // nstats x nstats matrices, rowmajor; covariance uses nrows - 1 in
+    // the denominator, as numpy does
+    void write_cov(double* out) const {
+        double denominator = (double)_nrows * (_nrows - 1);
+        for (uint32_t j = 0; j < nstats(); j++) {
+            for (uint32_t k = j; k < nstats(); k++) {
+                double cov = (double)_comoment(j, k) / denominator;
+                out[j * nstats() + k] = cov;
+                out[k * nstats() + j] = cov;
+            }
+        }
+    }
+    void write_corr(double* out) const {
+        for (uint32_t j = 0; j < nstats(); j++) {
+            __int128 var_j = _comoment(j, j);
+            for (uint32_t k = j; k < nstats(); k++) {
+                __int128 var_k = _comoment(k, k);
+                // NaN if either column is constant, as in numpy; checked
+                // explicitly, since 0/0 isn't guaranteed to give NaN under
+                // -ffast-math
+                double corr = std::numeric_limits<double>::quiet_NaN();
+                if (var_j != 0 && var_k != 0) {
+                    corr = (double)_comoment(j, k) /
+                        sqrt((double)var_j * (double)var_k);
+                }
+                out[j * nstats() + k] = corr;
+                out[k * nstats() + j] = corr;
+            }
+        }
+    }
+
+    // each row of _xs gets an extra col of 1s after the selected cols, so
+    // that the sum of each col shows up in the products
+    void reset() {
+        _padded_nstats = (nstats() + 1 + 3) & ~3;
+        _xs.assign(kBlockNumRows * _padded_nstats, 0);
+        for (uint32_t i = 0; i < kBlockNumRows; i++) {
+            _xs[i * _padded_nstats + nstats()] = 1;
+        }
+        _prods.assign((nstats() + 1) * _padded_nstats, 0);
+    }
+
+    uint32_t nrows() const { return _nrows; }
+    uint16_t ncols() const { return _ncols; }
+    uint32_t nstats() const { return (uint32_t)_which_dims.size(); }
+
+private:
+    static const uint32_t kBlockNumRows = 8;
+
+    template<bool Subtract>
+    void _accumulate(const DataT* rows, uint32_t nrows, uint32_t row_stride) {
+        for (uint32_t i = 0; i < nrows; i++) {
+            const DataT* row = rows + i * row_stride;
+            uint32_t* x = _xs.data() + i * _padded_nstats;
+            uint32_t j_idx = 0;
+            if (_is_contiguous) {
+                for ( ; j_idx + 8 <= nstats(); j_idx += 8) {
+                    _mm256_storeu_si256((__m256i*)(x + j_idx),
+                        load_widen_epu32(row + j_idx));
+                }
+            }
+            for ( ; j_idx < nstats(); j_idx++) {
+                x[j_idx] = row[_which_dims[j_idx] * _col_stride];
+            }
+        }
+        accumulate_outer_products<Subtract>(
+            _xs.data(), nrows, nstats() + 1, _padded_nstats, _prods.data());
+    }
+
+    // n * sum(x_j * x_k) - sum(x_j) * sum(x_k); this is n^2 times the
+    // biased covariance, but computed exactly
+    __int128 _comoment(uint32_t j, uint32_t k) const {
+        if (k < j) { std::swap(j, k); }
+        unsigned __int128 n = _nrows;
+        unsigned __int128 sum_j = _prods[j * _padded_nstats + nstats()];
+        unsigned __int128 sum_k = _prods[k * _padded_nstats + nstats()];
+        return (__int128)(n * _prods[j * _padded_nstats + k] - sum_j * sum_k);
+    }
+
+    std::vector<uint16_t> _which_dims;
+    std::vector<uint32_t> _xs;      // selected cols of rows, widened
+    std::vector<uint64_t> _prods;   // upper triangle of sum of x x^T
+    uint32_t _nrows;
+    uint16_t _ncols;
+    uint32_t _col_stride;
+    uint32_t _padded_nstats;
+    bool _is_contiguous;
+};
+
+// covariance or correlation matrix of the selected columns within each
+// window of q.window_nrows rows (or the whole buffer), for windows
+// starting every q.window_stride rows; stride defaults to the window
+// length, so windows don't overlap. Returns one nstats x nstats matrix
+// per window in vals_f64, and the starting row of each window in idxs.
+template<class DataT, bool IsCorr>
+void sliding_cov_or_corr(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
+    int64_t window_nrows = q.window_nrows > 0 ? q.window_nrows : di.nrows;
+    int64_t stride = q.window_stride > 0 ? q.window_stride : window_nrows;
+
+    int64_t nrows = di.nrows;
+    if (window_nrows < 1 || nrows < window_nrows) {
+        ret.vals_f64.clear();
+        ret.idxs.clear();
+        return;
+    }
+    int64_t nwindows = (nrows - window_nrows) / stride + 1;
+
+    bool rowmajor = di.storage_order == ROWMAJOR;
+    uint32_t row_stride = rowmajor ? di.ncols : 1;
+    uint32_t col_stride = rowmajor ? 1 : di.nrows;
+    OnlineCovRowmajor<DataT> stat(window_nrows, di.ncols, q.which_cols,
+        col_stride);
+    auto matrix_sz = stat.nstats() * stat.nstats();
+    ret.vals_f64.resize(nwindows * matrix_sz);
+    ret.idxs.resize(nwindows);
+
+    for (int64_t w = 0; w < nwindows; w++) {
+        int64_t start_row = w * stride;
+        if (w == 0 || stride >= window_nrows) {
+            // windows don't overlap, so just start over
+            stat.init(buff + start_row * row_stride, row_stride);
+        } else {
+            for (int64_t row = start_row - stride; row < start_row; row++) {
+                stat.update(buff + row * row_stride,
+                    buff + (row + window_nrows) * row_stride);
+            }
+        }
+        double* out = ret.vals_f64.data() + w * matrix_sz;
+        if (IsCorr) {
+            stat.write_corr(out);
+        } else {
+            stat.write_cov(out);
+        }
+        ret.idxs[w] = start_row;
+    }
+}
+
+template<class DataT>
+void cov(const QueryParams& q, const DataInfo& di, const DataT* buff,
+    QueryResult& ret) {
+    sliding_cov_or_corr<DataT, false>(q, di, buff, ret);
+}
+
+template<class DataT>
+void corr(const QueryParams& q, const DataInfo& di, const DataT* buff,
+    QueryResult& ret) {
+    sliding_cov_or_corr<DataT, true>(q, di, buff, ret);
+}
+
+#endif // QUERY_CORR_HPP
@@ -0,0 +1,140 @@
+
+#ifndef QUERY_HISTOGRAM_HPP
+#define QUERY_HISTOGRAM_HPP
+
+#include "immintrin.h"
+#include <algorithm> // min
+#include <vector>
+
+#include "query_common.h"
+#include "query_corr.hpp" // load_widen_epu32
+
+// 8b values each get their own bin. 16b values get log-linear bins, as in
+// HDR histograms: values below 32 get their own bin, and each larger power
+// of two is split into 32 equal bins, so a bin is never wider than 1/32 of
+// its smallest value. These are the same bins the sprintz histogram query
+// uses, so the two can be compared or merged.
+template<class DataT> struct HistogramBins {};
+template<> struct HistogramBins<uint8_t> {
+    static const uint32_t nbins = 256;
+    static uint32_t bin(uint8_t x) { return x; }
+    static __m256i bins(__m256i x) { return x; }
+};
+template<> struct HistogramBins<uint16_t> {
+    static const uint32_t nbins = 384;
+    static uint32_t bin(uint16_t x) {
+        if (x < 32) { return x; }
+        int log2_x = 31 - __builtin_clz(x);
+        return ((log2_x - 4) << 5) | ((x >> (log2_x - 5)) & 31);
+    }
+    // 8 values in 32-bit lanes; the float conversion does the log2, and
+    // shifting out all but the top 5 mantissa bits leaves
+    // (127 + log2(x)) << 5 | mantissa
+    static __m256i bins(__m256i x) {
+        __m256i fbits = _mm256_castps_si256(_mm256_cvtepi32_ps(x));
+        __m256i log_bins = _mm256_sub_epi32(_mm256_srli_epi32(fbits, 23 - 5),
+            _mm256_set1_epi32((127 + 4) << 5));
+        __m256i is_small = _mm256_cmpgt_epi32(_mm256_set1_epi32(32), x);
+        return _mm256_blendv_epi8(log_bins, x, is_small);
+    }
+};
+
+// adds each row to the histograms of its cols; with all the cols of
+// rowmajor data, the address of each element is known at compile time
+// when NCols is, which roughly doubles the speed for 8b data
+template<class DataT, int NCols>
+static void _histogram_rows_contiguous(const DataT* rows, int64_t nrows,
+    uint32_t ncols, int32_t* counts)
+{
+    using Bins = HistogramBins<DataT>;
+    const uint32_t nbins = Bins::nbins;
+    ncols = NCols > 0 ? NCols : ncols;
+    // 8 cols at a time; only worth it when there's work to do per bin
+    uint32_t nvec_cols = sizeof(DataT) > 1 ? (ncols & ~7) : 0;
+    for (int64_t i = 0; i < nrows; i++) {
+        const DataT* row = rows + i * ncols;
+        uint32_t j = 0;
+        for ( ; j < nvec_cols; j += 8) {
+            uint32_t bins[8];
+            _mm256_storeu_si256((__m256i*)bins,
+                Bins::bins(load_widen_epu32(row + j)));
+            for (uint32_t k = 0; k < 8; k++) {
+                counts[(j + k) * nbins + bins[k]]++;
+            }
+        }
+        for ( ; j < ncols; j++) {
+            counts[j * nbins + Bins::bin(row[j])]++;
+        }
+    }
+}
+
+// histogram of each (selected) column within each non-overlapping window of
+// q.window_nrows rows (or the whole buffer); a trailing partial window gets
+// its own histogram. Returns nstats * nbins counts per window in vals_i32,
+// laid out as [window][stat][bin], and the starting row of each window in
+// idxs. Histograms of different windows or chunks can just be added.
+template<class DataT>
+void histogram(const QueryParams& q, const DataInfo& di, const DataT* buff,
+    QueryResult& ret)
+{
+    const uint32_t nbins = HistogramBins<DataT>::nbins;
+
+    int64_t nrows = di.nrows;
+    int64_t window_nrows = q.window_nrows > 0 ? q.window_nrows : nrows;
+    if (window_nrows < 1 || nrows < 1) {
+        ret.vals_i32.clear();
+        ret.idxs.clear();
+        return;
+    }
+    int64_t nwindows = (nrows + window_nrows - 1) / window_nrows;
+
+    thread_local std::vector<uint16_t> which_dims;
+    which_dims.assign(q.which_cols.begin(), q.which_cols.end());
+    if (which_dims.size() == 0) {
+        for (uint16_t j = 0; j < di.ncols; j++) { which_dims.push_back(j); }
+    }
+    uint32_t nstats = (uint32_t)which_dims.size();
+
+    bool rowmajor = di.storage_order == ROWMAJOR;
+    uint32_t row_stride = rowmajor ? di.ncols : 1;
+    uint32_t col_stride = rowmajor ? 1 : di.nrows;
+    bool is_contiguous = rowmajor && nstats == di.ncols;
+    for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+        is_contiguous = is_contiguous && (which_dims[j_idx] == j_idx);
+    }
+
+    ret.vals_i32.assign(nwindows * nstats * nbins, 0);
+    ret.idxs.resize(nwindows);
+
+    for (int64_t w = 0; w < nwindows; w++) {
+        int64_t start_row = w * window_nrows;
+        int64_t end_row = std::min(start_row + window_nrows, nrows);
+        int32_t* counts = ret.vals_i32.data() + w * nstats * nbins;
+        ret.idxs[w] = start_row;
+        if (is_contiguous) {
+            const DataT* rows = buff + start_row * row_stride;
+            int64_t window_len = end_row - start_row;
+            // bake in common numbers of columns so the inner loops unroll
+            #define CASE(NCOLS) case NCOLS:                             \
+                _histogram_rows_contiguous<DataT, NCOLS>(               \
+                    rows, window_len, nstats, counts); break;
+            switch (nstats) {
+                CASE(1); CASE(2); CASE(3); CASE(4); CASE(8); CASE(16); CASE(32);
+                default:
+                    _histogram_rows_contiguous<DataT, 0>(
+                        rows, window_len, nstats, counts);
+            }
+            #undef CASE
+            continue;
+        }
+        for (int64_t i = start_row; i < end_row; i++) {
+            const DataT* row = buff + i * row_stride;
+            for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+                DataT x = row[which_dims[j_idx] * col_stride];
+                counts[j_idx * nbins + HistogramBins<DataT>::bin(x)]++;
+            }
+        }
+    }
+}
+
+#endif // QUERY_HISTOGRAM_HPP
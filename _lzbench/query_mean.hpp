@@ -2,108 +2,202 @@
 #ifndef QUERY_MEAN_HPP
 #define QUERY_MEAN_HPP
 
+#include "immintrin.h"
+#include <string.h> // memcpy
+#include <vector>
+
 #include "query_common.h"
 
-// template<class DataT, bool IsDense>
-template<class DataT>
+// AVX2 ops that sum rows of DataT into accumulators wide enough that
+// the window sum can't overflow; (new - old) wraps around, but the sum
+// of the window itself always fits, so the wrapped arithmetic is exact
+template<class DataT> struct WideningSumOps {};
+template<> struct WideningSumOps<uint8_t> {
+    using AccumulatorT = uint32_t;
+    static const uint32_t vector_sz_elems = 8;
+    static __m256i load(const uint8_t* p) {
+        return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p));
+    }
+    static __m256i add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+    static __m256i sub(__m256i x, __m256i y) { return _mm256_sub_epi32(x, y); }
+    // 4 sums, zero-extended to 64 bits
+    static __m256i load_sums4(const uint32_t* p) {
+        return _mm256_cvtepu32_epi64(_mm_loadu_si128((const __m128i*)p));
+    }
+    // low 4 i32s, saturated down to uint8s
+    static void store4(uint8_t* out, __m128i x) {
+        x = _mm_packus_epi16(_mm_packus_epi32(x, x), x);
+        int32_t packed = _mm_cvtsi128_si32(x);
+        memcpy(out, &packed, sizeof(packed));
+    }
+};
+template<> struct WideningSumOps<uint16_t> {
+    using AccumulatorT = uint64_t; // uint32_t overflows after 64k rows
+    static const uint32_t vector_sz_elems = 4;
+    static __m256i load(const uint16_t* p) {
+        return _mm256_cvtepu16_epi64(_mm_loadl_epi64((const __m128i*)p));
+    }
+    static __m256i add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+    static __m256i sub(__m256i x, __m256i y) { return _mm256_sub_epi64(x, y); }
+    static __m256i load_sums4(const uint64_t* p) {
+        return _mm256_loadu_si256((const __m256i*)p);
+    }
+    static void store4(uint16_t* out, __m128i x) {
+        int64_t packed = _mm_cvtsi128_si64(_mm_packus_epi32(x, x));
+        memcpy(out, &packed, sizeof(packed));
+    }
+};
+
+// mean of the most recent nrows rows. IsDense means all the columns are
+// used, in which case the updates are vectorized across columns; otherwise
+// only the columns in which_dims are used. If NCols > 0, it must equal
+// ncols, and the loops all get fixed trip counts.
+template<class DataT, bool IsDense=true, int NCols=0>
 class OnlineMeanRowmajor {
 public:
-    using dist_t = typename DataTypeTraits<DataT>::AccumulatorT;
-    // static const bool is_dense = IsDense;
+    using Ops = WideningSumOps<DataT>;
+    using dist_t = typename Ops::AccumulatorT;
+    static const bool is_dense = IsDense;
 
     OnlineMeanRowmajor(uint32_t nrows, uint32_t ncols):
-        _nrows(nrows), _ncols(ncols), _is_dense(true)
+        _nrows(nrows), _ncols(ncols)
     {
         reset();
     }
 
     OnlineMeanRowmajor(uint32_t nrows, uint32_t ncols,
         const std::vector<uint16_t>& which_dims):
-        _nrows(nrows), _ncols(ncols), _which_dims(which_dims),
-        _is_dense(which_dims.size() == 0)
+        _which_dims(which_dims), _nrows(nrows), _ncols(ncols)
     {
-        // if (IsDense) {
-        //     printf("ERROR: can't specify subset of dims for Dense OnlineMean!");
-        //     exit(1);
-        // }
+        if (IsDense && which_dims.size() > 0) {
+            printf("ERROR: can't specify subset of dims for dense OnlineMean!\n");
+            exit(1);
+        }
         reset();
     }
 
     void init(const DataT* window_start) {
-        if (_is_dense) {
-            for (uint32_t i = 0; i < _nrows; i++) {
-                for (uint32_t j = 0; j < _ncols; j++) {
-                    _sums[j] += window_start[i * _ncols + j];
-                }
-            }
-        } else {
-            for (uint32_t i = 0; i < _nrows; i++) {
-                for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
-                    auto j = _which_dims[j_idx];
-                    _sums[j_idx] += window_start[i * _ncols + j];
-                }
-            }
+        reset();
+        for (uint32_t i = 0; i < _nrows; i++) {
+            _add_row(window_start + i * ncols());
         }
     }
 
     void update(const DataT* old_window_row, const DataT* new_window_row) {
-        if (_is_dense) {
-            for (uint32_t j = 0; j < _ncols; j++) {
-                _sums[j] += (new_window_row[j] - old_window_row[j]);
-            }
-        } else {
+        if (!IsDense) {
             for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
                 auto j = _which_dims[j_idx];
-                _sums[j_idx] += (new_window_row[j] - old_window_row[j]);
+                _sums[j_idx] += (dist_t)new_window_row[j] -
+                    (dist_t)old_window_row[j];
             }
+            return;
+        }
+        uint32_t j = 0;
+        for ( ; j + Ops::vector_sz_elems <= ncols(); j += Ops::vector_sz_elems) {
+            __m256i* sums_ptr = (__m256i*)(_sums.data() + j);
+            __m256i diffs = Ops::sub(
+                Ops::load(new_window_row + j), Ops::load(old_window_row + j));
+            _mm256_storeu_si256(sums_ptr,
+                Ops::add(_mm256_loadu_si256(sums_ptr), diffs));
+        }
+        for ( ; j < ncols(); j++) {
+            _sums[j] += (dist_t)new_window_row[j] - (dist_t)old_window_row[j];
         }
     }
 
+    // integer division is way slower than everything else we do per
+    // element, so multiply by 1/nrows instead; adding .5 first keeps
+    // the quotient at least .5/nrows away from an integer, which is far
+    // more than the rounding error since sums are < 2^52
     void write_stats(DataT* out) const {
-        for (uint32_t j = 0; j < _sums.size(); j++) {
-            out[j] = _sums[j] / _nrows;
+        // OR-ing in the exponent of 2^52 gives the double 2^52 + x
+        const __m256d magic = _mm256_set1_pd(4503599627370496.);
+        const __m256d half = _mm256_set1_pd(.5);
+        const __m256d inv_nrows = _mm256_set1_pd(_inv_nrows);
+        // only vectorize over the sums that update() wrote via SIMD; reading
+        // scalar writes back with vector loads stalls store forwarding
+        uint32_t nvectorized = IsDense ?
+            ncols() - (ncols() % Ops::vector_sz_elems) : 0;
+        uint32_t j = 0;
+        for ( ; j + 4 <= nvectorized; j += 4) {
+            __m256i sums = Ops::load_sums4(_sums.data() + j);
+            __m256d sums_pd = _mm256_sub_pd(_mm256_castsi256_pd(
+                _mm256_or_si256(sums, _mm256_castpd_si256(magic))), magic);
+            __m256d quotients = _mm256_mul_pd(
+                _mm256_add_pd(sums_pd, half), inv_nrows);
+            Ops::store4(out + j, _mm256_cvttpd_epi32(quotients));
+        }
+        for ( ; j < nstats(); j++) {
+            out[j] = (DataT)((_sums[j] + .5) * _inv_nrows);
         }
     }
 
     void reset() {
-        if (_sums.size() == 0) {
-            auto sums_size = _is_dense ? _ncols : _which_dims.size();
-            for (size_t i = 0; i < sums_size; i++) {
-                _sums.push_back(0);
-            }
-        } else {
-            for (size_t i = 0; i < _sums.size(); i++) {
-                _sums[i] = 0;
-            }
-        }
+        _sums.assign(nstats(), 0);
+        _inv_nrows = 1. / _nrows;
     }
 
-    uint32_t nrows() const { return _nrows(); }
-    uint16_t ncols() const { return _ncols(); }
+    uint32_t nrows() const { return _nrows; }
+    uint16_t ncols() const { return NCols > 0 ? NCols : _ncols; }
+    uint32_t nstats() const {
+        return IsDense ? ncols() : (uint32_t)_which_dims.size();
+    }
 
 private:
+    void _add_row(const DataT* row) {
+        if (!IsDense) {
+            for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
+                _sums[j_idx] += row[_which_dims[j_idx]];
+            }
+            return;
+        }
+        uint32_t j = 0;
+        for ( ; j + Ops::vector_sz_elems <= ncols(); j += Ops::vector_sz_elems) {
+            __m256i* sums_ptr = (__m256i*)(_sums.data() + j);
+            _mm256_storeu_si256(sums_ptr,
+                Ops::add(_mm256_loadu_si256(sums_ptr), Ops::load(row + j)));
+        }
+        for ( ; j < ncols(); j++) {
+            _sums[j] += row[j];
+        }
+    }
+
     std::vector<uint16_t> _which_dims;
     std::vector<dist_t> _sums;
+    double _inv_nrows;
     uint32_t _nrows;
     uint16_t _ncols;
-    bool _is_dense;
 };
 
-template<class DataT>
-QueryResult sliding_mean(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
-    // -> std::vector<typename DataTypeTraits<DataT>::AccumulatorT>
+template<class DataT, bool IsDense, int NCols>
+void _sliding_mean_rowmajor(const QueryParams& q, const DataInfo& di,
+    const DataT* buff, uint32_t window_nrows, DataT* ret_ptr)
 {
-    // using StatT = typename DataTypeTraits<DataT>::AccumulatorT;
-
+    OnlineMeanRowmajor<DataT, IsDense, NCols> stat(
+        window_nrows, di.ncols, q.which_cols);
+    auto ret_ncols = stat.nstats();
+    stat.init(buff);
+    stat.write_stats(ret_ptr);
+    for (size_t row = window_nrows; row < di.nrows; row++) {
+        auto old_row = row - window_nrows;
+        auto old_ptr = buff + di.ncols * old_row;
+        auto new_ptr = buff + di.ncols * row;
+        auto ret_row_ptr = ret_ptr + (old_row + 1) * ret_ncols;
+        stat.update(old_ptr, new_ptr);
+        stat.write_stats(ret_row_ptr);
+    }
+}
 
+template<class DataT>
+void sliding_mean(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
     auto window_nrows = q.window_nrows > 0 ? q.window_nrows : di.nrows;
     // printf("actually running sliding mean! window nrows, ncols, stride "
     //     " = %lld, %lld, %lld\n", window_nrows, q.window_ncols, q.window_stride);
 
     // figure out how long data is, and how many window positions we have
     auto nrows = di.nrows;
-    int64_t last_window_start_row = nrows - window_nrows;
     int64_t nwindows = nrows - window_nrows + 1;
 
     // auto ret_size = nrows * di.ncols;
@@ -112,26 +206,30 @@ QueryResult sliding_mean(const QueryParams& q,
     auto ret_ncols = sparse ? sparse_ncols : di.ncols;
     auto ret_size = nwindows * ret_ncols;
 
-    QueryResult ret;
     auto& ret_vals = QueryResultValsRef<DataT>{}(ret);
-    ret_vals.resize(ret_size);
 
-    if (nwindows < 1) { return ret; }
+    if (nwindows < 1) { ret_vals.clear(); return; }
+    ret_vals.resize(ret_size);
 
     if (di.storage_order == ROWMAJOR) {
-        OnlineMeanRowmajor<DataT> stat(window_nrows, di.ncols, q.which_cols);
-        stat.init(buff);
         auto ret_ptr = ret_vals.data();
-        stat.write_stats(ret_ptr);
-        for (size_t row = window_nrows; row < last_window_start_row; row++) {
-            auto old_row = row - window_nrows;
-            auto old_ptr = buff + di.ncols * old_row;
-            auto new_ptr = buff + di.ncols * row;
-            auto ret_row_ptr = ret_ptr + (old_row + 1) * ret_ncols;
-            stat.update(old_ptr, new_ptr);
-            stat.write_stats(ret_row_ptr);
+        if (sparse) {
+            _sliding_mean_rowmajor<DataT, false, 0>(
+                q, di, buff, window_nrows, ret_ptr);
+            return;
+        }
+        // bake in common numbers of columns so the inner loops unroll
+        #define CASE(NCOLS) case NCOLS:                                 \
+            _sliding_mean_rowmajor<DataT, true, NCOLS>(                 \
+                q, di, buff, window_nrows, ret_ptr); break;
+        switch (di.ncols) {
+            CASE(1); CASE(2); CASE(3); CASE(4); CASE(8); CASE(16); CASE(32);
+            default:
+                _sliding_mean_rowmajor<DataT, true, 0>(
+                    q, di, buff, window_nrows, ret_ptr);
         }
-        return ret;
+        #undef CASE
+        return;
     }
 
     // column-major; treat each col as 1D rowmajor, and also write out results
@@ -143,19 +241,18 @@ QueryResult sliding_mean(const QueryParams& q,
         }
     }
     for (int j_idx = 0; j_idx < which_cols.size(); j_idx++) {
-        OnlineMeanRowmajor<DataT> stat(window_nrows, 1);
-        auto buff_ptr = buff + di.nrows;
-        auto ret_ptr = ret_vals.data() + di.nrows; // write to ret in colmajor order
+        OnlineMeanRowmajor<DataT, true, 1> stat(window_nrows, 1);
+        auto buff_ptr = buff + which_cols[j_idx] * di.nrows;
+        auto ret_ptr = ret_vals.data() + j_idx * nwindows; // write to ret in colmajor order
         stat.init(buff_ptr);
         stat.write_stats(ret_ptr);
-        for (size_t row = window_nrows; row < last_window_start_row; row++) {
+        for (size_t row = window_nrows; row < nrows; row++) {
             auto old_row = row - window_nrows;
             auto ret_row_ptr = ret_ptr + (old_row + 1);
             stat.update(buff_ptr + old_row, buff_ptr + row);
             stat.write_stats(ret_row_ptr);
         }
     }
-    return ret;
 }
 
 
@@ -4,101 +4,209 @@
 #include "eigen/Core"
 
 #include "immintrin.h"
+#include <limits>
+#include <string.h> // memcpy
 #include <type_traits>
 
 #include "query_common.h"
+#include "query_mean.hpp"
 
 #include <iostream> // TODO rm
 
+// AVX2 min / max so that window updates are vectorized across columns
+template<class DataT, int OpE> struct SimdBinaryOp {};
+template<> struct SimdBinaryOp<uint8_t, OpE::MIN> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_min_epu8(x, y); }
+};
+template<> struct SimdBinaryOp<uint8_t, OpE::MAX> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_max_epu8(x, y); }
+};
+template<> struct SimdBinaryOp<int8_t, OpE::MIN> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_min_epi8(x, y); }
+};
+template<> struct SimdBinaryOp<int8_t, OpE::MAX> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_max_epi8(x, y); }
+};
+template<> struct SimdBinaryOp<uint16_t, OpE::MIN> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_min_epu16(x, y); }
+};
+template<> struct SimdBinaryOp<uint16_t, OpE::MAX> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_max_epu16(x, y); }
+};
+template<> struct SimdBinaryOp<int16_t, OpE::MIN> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_min_epi16(x, y); }
+};
+template<> struct SimdBinaryOp<int16_t, OpE::MAX> {
+    static __m256i apply(__m256i x, __m256i y) { return _mm256_max_epi16(x, y); }
+};
+
+// value that leaves everything unchanged when combined with it
+template<class DataT, int OpE> struct BinaryOpIdentity {};
+template<class DataT> struct BinaryOpIdentity<DataT, OpE::MIN> {
+    static DataT value() { return std::numeric_limits<DataT>::max(); }
+};
+template<class DataT> struct BinaryOpIdentity<DataT, OpE::MAX> {
+    static DataT value() { return std::numeric_limits<DataT>::lowest(); }
+};
+
+// out[j] = op(x[j], y[j]); out can alias x or y
 template<class DataT, int OpE>
+static inline void binary_op_rows(const DataT* x, const DataT* y, DataT* out,
+    uint32_t n)
+{
+    static const uint32_t vector_sz_elems = 32 / sizeof(DataT);
+    using Op = BinaryOp<DataT, OpE, DataT>;
+    uint32_t j = 0;
+    for ( ; j + vector_sz_elems <= n; j += vector_sz_elems) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(x + j));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(y + j));
+        _mm256_storeu_si256((__m256i*)(out + j),
+            SimdBinaryOp<DataT, OpE>::apply(a, b));
+    }
+    for ( ; j < n; j++) {
+        out[j] = Op{}(x[j], y[j]);
+    }
+}
+
+// min / max over the most recent nrows rows. Uses the two-stack form of
+// van Herk / Gil-Werman: the older rows in the window (the "front") are
+// stored as suffix extrema, and the newer rows (the "back") are folded into
+// one running extremum. When the front runs out, the back rows get turned
+// into suffix extrema in place. Each row is touched ~3 times total, so
+// updates are amortized O(1) per element, and every op is elementwise
+// across a whole row. IsDense and NCols are as in OnlineMeanRowmajor.
+template<class DataT, int OpE, bool IsDense=true, int NCols=0>
 class OnlineBinaryOpRowmajor {
 public:
-    using dist_t = typename DataTypeTraits<DataT>::AccumulatorT;
-    using Op = BinaryOp<DataT, OpE, DataT>;
+    static const bool is_dense = IsDense;
 
     OnlineBinaryOpRowmajor(uint32_t nrows, uint32_t ncols):
-        _nrows(nrows), _ncols(ncols), _is_dense(true)
+        _nrows(nrows), _ncols(ncols)
     {
         reset();
     }
 
     OnlineBinaryOpRowmajor(uint32_t nrows, uint32_t ncols,
         const std::vector<uint16_t>& which_dims):
-        _nrows(nrows), _ncols(ncols), _which_dims(which_dims),
-        _is_dense(which_dims.size() == 0)
+        _which_dims(which_dims), _nrows(nrows), _ncols(ncols)
     {
-        // if (IsDense) {
-        //     printf("ERROR: can't specify subset of dims for Dense OnlineMean!");
-        //     exit(1);
-        // }
+        if (IsDense && which_dims.size() > 0) {
+            printf("ERROR: can't specify subset of dims for dense OnlineBinaryOp!\n");
+            exit(1);
+        }
         reset();
     }
 
     void init(const DataT* window_start) {
-        if (_is_dense) {
-            for (uint32_t i = 0; i < _nrows; i++) {
-                for (uint32_t j = 0; j < _ncols; j++) {
-                    _stats[j] = Op{}(_stats[j], window_start[i * _ncols + j]);
-                }
-            }
-        } else {
-            for (uint32_t i = 0; i < _nrows; i++) {
-                for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
-                    auto j = _which_dims[j_idx];
-                    _stats[j_idx] =
-                        Op{}(_stats[j_idx], window_start[i * _ncols + j]);
-                }
-            }
+        reset();
+        for (uint32_t i = 0; i < _nrows; i++) {
+            _push(window_start + i * ncols());
         }
     }
 
     void update(const DataT* old_window_row, const DataT* new_window_row) {
-        if (_is_dense) {
-            for (uint32_t j = 0; j < _ncols; j++) {
-                _stats[j] = Op{}(_stats[j], new_window_row[j]);
-            }
-        } else {
-            for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
-                auto j = _which_dims[j_idx];
-                _stats[j_idx] = Op{}(_stats[j_idx], new_window_row[j]);
-            }
-        }
+        _pop();
+        _push(new_window_row);
     }
 
     void write_stats(DataT* out) const {
-        for (uint32_t j = 0; j < _stats.size(); j++) {
-            out[j] = _stats[j];
+        const DataT* front = _rows.data() + _head * nstats();
+        if (_nfront == 0) {
+            memcpy(out, _back.data(), nstats() * sizeof(DataT));
+        } else if (_nback == 0) {
+            memcpy(out, front, nstats() * sizeof(DataT));
+        } else {
+            binary_op_rows<DataT, OpE>(front, _back.data(), out, nstats());
         }
     }
 
     void reset() {
-        if (_stats.size() == 0) {
-            auto sums_size = _is_dense ? _ncols : _which_dims.size();
-            for (size_t i = 0; i < sums_size; i++) {
-                _stats.push_back(0);
-            }
-        } else {
-            for (size_t i = 0; i < _stats.size(); i++) {
-                _stats[i] = 0;
+        _rows.resize(_nrows * nstats());
+        _back.assign(nstats(), BinaryOpIdentity<DataT, OpE>::value());
+        _row_tmp.resize(IsDense ? 0 : nstats());
+        _head = 0;
+        _nfront = 0;
+        _nback = 0;
+    }
+
+    uint32_t nrows() const { return _nrows; }
+    uint16_t ncols() const { return NCols > 0 ? NCols : _ncols; }
+    uint32_t nstats() const {
+        return IsDense ? ncols() : (uint32_t)_which_dims.size();
+    }
+
+private:
+    void _push(const DataT* row) {
+        if (!IsDense) {
+            for (uint32_t j_idx = 0; j_idx < _which_dims.size(); j_idx++) {
+                _row_tmp[j_idx] = row[_which_dims[j_idx]];
             }
+            row = _row_tmp.data();
         }
+        auto slot = _wrap(_head + _nfront + _nback);
+        memcpy(_rows.data() + slot * nstats(), row, nstats() * sizeof(DataT));
+        binary_op_rows<DataT, OpE>(_back.data(), row, _back.data(), nstats());
+        _nback++;
     }
 
-    uint32_t nrows() const { return _nrows(); }
-    uint16_t ncols() const { return _ncols(); }
+    void _pop() {
+        if (_nfront == 0) { _flip(); }
+        _head = _wrap(_head + 1);
+        _nfront--;
+    }
 
-private:
+    // turn the back rows into suffix extrema, newest to oldest
+    void _flip() {
+        for (int64_t k = (int64_t)_nback - 2; k >= 0; k--) {
+            auto slot = _wrap(_head + (uint32_t)k);
+            auto next = _wrap(slot + 1);
+            DataT* row = _rows.data() + slot * nstats();
+            binary_op_rows<DataT, OpE>(
+                row, _rows.data() + next * nstats(), row, nstats());
+        }
+        _nfront = _nback;
+        _nback = 0;
+        _back.assign(nstats(), BinaryOpIdentity<DataT, OpE>::value());
+    }
+
+    // ring buffer idx; cheaper than % since idx is always < 2 * _nrows
+    uint32_t _wrap(uint32_t idx) const {
+        return idx >= _nrows ? idx - _nrows : idx;
+    }
 
     std::vector<uint16_t> _which_dims;
-    std::vector<dist_t> _stats;
+    std::vector<DataT> _rows;       // ring buffer of rows in the window
+    std::vector<DataT> _back;       // extremum of rows in back of window
+    std::vector<DataT> _row_tmp;    // selected cols of row, if sparse
     uint32_t _nrows;
     uint16_t _ncols;
-    bool _is_dense;
+    uint32_t _head;                 // ring buffer idx of oldest row
+    uint32_t _nfront;
+    uint32_t _nback;
 };
 
+template<class DataT, int OpE, bool IsDense, int NCols>
+void _sliding_binary_op_rowmajor(const QueryParams& q, const DataInfo& di,
+    const DataT* buff, uint32_t window_nrows, DataT* ret_ptr)
+{
+    OnlineBinaryOpRowmajor<DataT, OpE, IsDense, NCols> stat(
+        window_nrows, di.ncols, q.which_cols);
+    auto ret_ncols = stat.nstats();
+    stat.init(buff);
+    stat.write_stats(ret_ptr);
+    for (size_t row = window_nrows; row < di.nrows; row++) {
+        auto old_row = row - window_nrows;
+        auto old_ptr = buff + di.ncols * old_row;
+        auto new_ptr = buff + di.ncols * row;
+        auto ret_row_ptr = ret_ptr + (old_row + 1) * ret_ncols;
+        stat.update(old_ptr, new_ptr);
+        stat.write_stats(ret_row_ptr);
+    }
+}
+
 template<class DataT, int OpE>
-QueryResult sliding_binary_op(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_binary_op(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     auto window_nrows = q.window_nrows > 0 ? q.window_nrows : di.nrows;
     // printf("actually running sliding max! window nrows, ncols, stride "
@@ -106,7 +214,6 @@ QueryResult sliding_binary_op(const QueryParams& q,
 
     // figure out how long data is, and how many window positions we have
     auto nrows = di.nrows;
-    int64_t last_window_start_row = nrows - window_nrows;
     int64_t nwindows = nrows - window_nrows + 1;
 
     // auto ret_size = nrows * di.ncols;
@@ -115,26 +222,30 @@ QueryResult sliding_binary_op(const QueryParams& q,
     auto ret_ncols = sparse ? sparse_ncols : di.ncols;
     auto ret_size = nwindows * ret_ncols;
 
-    QueryResult ret;
     auto& ret_vals = QueryResultValsRef<DataT>{}(ret);
-    ret_vals.resize(ret_size);
 
-    if (nwindows < 1) { return ret; }
+    if (nwindows < 1) { ret_vals.clear(); return; }
+    ret_vals.resize(ret_size);
 
     if (di.storage_order == ROWMAJOR) {
-        OnlineBinaryOpRowmajor<DataT, OpE> stat(window_nrows, di.ncols, q.which_cols);
-        stat.init(buff);
         auto ret_ptr = ret_vals.data();
-        stat.write_stats(ret_ptr);
-        for (size_t row = window_nrows; row < last_window_start_row; row++) {
-            auto old_row = row - window_nrows;
-            auto old_ptr = buff + di.ncols * old_row;
-            auto new_ptr = buff + di.ncols * row;
-            auto ret_row_ptr = ret_ptr + (old_row + 1) * ret_ncols;
-            stat.update(old_ptr, new_ptr);
-            stat.write_stats(ret_row_ptr);
+        if (sparse) {
+            _sliding_binary_op_rowmajor<DataT, OpE, false, 0>(
+                q, di, buff, window_nrows, ret_ptr);
+            return;
         }
-        return ret;
+        // bake in common numbers of columns so the inner loops unroll
+        #define CASE(NCOLS) case NCOLS:                                 \
+            _sliding_binary_op_rowmajor<DataT, OpE, true, NCOLS>(       \
+                q, di, buff, window_nrows, ret_ptr); break;
+        switch (di.ncols) {
+            CASE(1); CASE(2); CASE(3); CASE(4); CASE(8); CASE(16); CASE(32);
+            default:
+                _sliding_binary_op_rowmajor<DataT, OpE, true, 0>(
+                    q, di, buff, window_nrows, ret_ptr);
+        }
+        #undef CASE
+        return;
     }
 
     // column-major; treat each col as 1D rowmajor, and also write out results
@@ -146,37 +257,48 @@ QueryResult sliding_binary_op(const QueryParams& q,
         }
     }
     for (int j_idx = 0; j_idx < which_cols.size(); j_idx++) {
-        OnlineBinaryOpRowmajor<DataT, OpE> stat(window_nrows, 1);
-        auto buff_ptr = buff + di.nrows;
-        auto ret_ptr = ret_vals.data() + di.nrows; // write to ret in colmajor order
+        OnlineBinaryOpRowmajor<DataT, OpE, true, 1> stat(window_nrows, 1);
+        auto buff_ptr = buff + which_cols[j_idx] * di.nrows;
+        auto ret_ptr = ret_vals.data() + j_idx * nwindows; // write to ret in colmajor order
         stat.init(buff_ptr);
         stat.write_stats(ret_ptr);
-        for (size_t row = window_nrows; row < last_window_start_row; row++) {
+        for (size_t row = window_nrows; row < nrows; row++) {
             auto old_row = row - window_nrows;
             auto ret_row_ptr = ret_ptr + (old_row + 1);
             stat.update(buff_ptr + old_row, buff_ptr + row);
             stat.write_stats(ret_row_ptr);
         }
     }
-    return ret;
 }
 
-// XXX these don't actually do a sliding window---just a (slow) reduction; also,
-// they cause segfaults sometimes...
-
 template<class DataT>
-QueryResult sliding_min(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_min(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     // printf("running sliding min query!\n");
-    return sliding_binary_op<DataT, OpE::MIN>(q, di, buff);
+    sliding_binary_op<DataT, OpE::MIN>(q, di, buff, ret);
 }
 template<class DataT>
-QueryResult sliding_max(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_max(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     // printf("running sliding max query!\n");
-    return sliding_binary_op<DataT, OpE::MAX>(q, di, buff);
+    sliding_binary_op<DataT, OpE::MAX>(q, di, buff, ret);
+}
+
+// buff is likely to be a byte* regardless of what it holds, so pick the
+// real data type based on the element size
+template<int ElemSz, class DataT>
+static inline void sliding_min_or_max(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
+{
+    using RealDataType = typename ElemSizeTraits<ElemSz>::DataT;
+    const RealDataType* data_ptr = (const RealDataType*)buff;
+    if (q.type == QUERY_MIN) {
+        sliding_min(q, di, data_ptr, ret);
+        return;
+    }
+    sliding_max(q, di, data_ptr, ret);
 }
 
 
@@ -199,27 +321,24 @@ void reduce_sum_avx2_rowmajor_ax0(const DataT* buff, int64_t nrows,
     static const int vector_sz_bytes = 32;
     static const int vector_sz_elems = vector_sz_bytes / elem_sz;
     static const int out_stripes_per_in_stripe = 4 / elem_sz;
+    static const int out_vector_sz_elems = vector_sz_bytes / 4;
 
-    int nstripes_in = div_round_up(ncols, vector_sz_elems);
+    // only full vectors within each row get summed via SIMD; reading past
+    // the end of the row could read past the end of the buffer
+    int nstripes_in = ncols / vector_sz_elems;
     int nstripes_out = nstripes_in * out_stripes_per_in_stripe;
-    // int final_stripe_offset = ncols - vector_sz_elems;
-    // int last_stripe_idx = nstripes - 1;
+    int64_t nsimd_cols = nstripes_in * vector_sz_elems;
 
-    __m256i sums[nstripes_out];
+    __m256i sums[nstripes_out + 1];
     for (size_t v = 0; v < nstripes_out; v++) {
         sums[v] = _mm256_setzero_si256();
     }
 
-    // SIMD sum until the last few rows; we leave enough rows at the end
-    // so that this loop can read past the row end
-    int padding_nrows = div_round_up(ncols, vector_sz_elems);
-    size_t i = 0;
-    const DataT* read_ptr = buff;
-    for ( ; i < nrows - padding_nrows; i++) {
+    for (size_t i = 0; i < nrows; i++) {
         auto row_start_ptr = buff + i * ncols;
         for (size_t v = 0; v < nstripes_in; v++) {
             auto load_addr = row_start_ptr + v * vector_sz_elems;
-            __m256i x = _mm256_load_si256((const __m256i*)load_addr);
+            __m256i x = _mm256_loadu_si256((const __m256i*)load_addr);
             auto x_low = _mm256_extracti128_si256(x, 0);
             auto x_high = _mm256_extracti128_si256(x, 1);
             auto out_idx = v * out_stripes_per_in_stripe;
@@ -227,14 +346,14 @@ void reduce_sum_avx2_rowmajor_ax0(const DataT* buff, int64_t nrows,
                 __m256i x0, x1, x2, x3;
                 if (std::is_signed<DataT>::value) {     // int8
                     x0 = _mm256_cvtepi8_epi32(x_low);
-                    x1 = _mm256_cvtepi8_epi32(_mm_slli_si128(x_low, 8));
+                    x1 = _mm256_cvtepi8_epi32(_mm_srli_si128(x_low, 8));
                     x2 = _mm256_cvtepi8_epi32(x_high);
-                    x3 = _mm256_cvtepi8_epi32(_mm_slli_si128(x_high, 8));
+                    x3 = _mm256_cvtepi8_epi32(_mm_srli_si128(x_high, 8));
                 } else {                                // uint8
                     x0 = _mm256_cvtepu8_epi32(x_low);
-                    x1 = _mm256_cvtepu8_epi32(_mm_slli_si128(x_low, 8));
+                    x1 = _mm256_cvtepu8_epi32(_mm_srli_si128(x_low, 8));
                     x2 = _mm256_cvtepu8_epi32(x_high);
-                    x3 = _mm256_cvtepu8_epi32(_mm_slli_si128(x_high, 8));
+                    x3 = _mm256_cvtepu8_epi32(_mm_srli_si128(x_high, 8));
                 }
 
                 sums[out_idx + 0] = _mm256_add_epi32(sums[out_idx + 0], x0);
@@ -259,24 +378,18 @@ void reduce_sum_avx2_rowmajor_ax0(const DataT* buff, int64_t nrows,
         }
     }
 
-    // dump simd vecs to normal arrays so we can write to them serially
-    DataT sums_ar[nstripes_out * vector_sz_elems];
+    // stripes of sums are in the same order as the cols, so just dump them
     for (size_t v = 0; v < nstripes_out; v++) {
-        auto write_addr = &sums_ar[v * vector_sz_elems];
-        _mm256_store_si256((__m256i*)write_addr, sums[v]);
+        _mm256_storeu_si256((__m256i*)(out + v * out_vector_sz_elems), sums[v]);
     }
 
-    // add in sums from tail rows we didn't operate on via SIMD stuff
-    const DataT* tail_start_ptr = buff + ncols * i;
-    for (; i < nrows; i++) {
-        for (size_t j = 0; j < ncols; j++) {
-            sums_ar[j] += buff[i * ncols] + j;
+    // sum the trailing cols that didn't fill a whole vector
+    for (int64_t j = nsimd_cols; j < ncols; j++) {
+        int32_t sum = 0;
+        for (size_t i = 0; i < nrows; i++) {
+            sum += buff[i * ncols + j];
         }
-    }
-    // copy sums to output; didn't just write to output directly since
-    // dumping the SIMD vects would write past the end
-    for (size_t j = 0; j < ncols; j++) {
-        out[j] = sums_ar[j];
+        out[j] = sum;
     }
 }
 
@@ -293,8 +406,8 @@ void reduce_sum_avx2_rowmajor_ax0(const DataT* buff, int64_t nrows,
 
 template<int ElemSz, class DataT>
 // static inline QueryResult poopinize(const QueryParams& q,
-static inline QueryResult reduce_contiguous(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+static inline void reduce_contiguous(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     // // fprintf(stderr, "running reduce_contiguous\n");
     // printf("******* running reduce_contiguous using query type %d\n", q.type);
@@ -319,15 +432,13 @@ static inline QueryResult reduce_contiguous(const QueryParams& q,
     // std::cout << "RUN THIS CODE YOU RETARDED COMPILER" << std::endl;
     // exit(1);
 
-    QueryResult ret;
     auto& ret_vals = QueryResultValsRef<RealDataType>{}(ret);
     auto& ret_vals_i32 = ret.vals_i32;
 
     bool use_i32_output = q.type != QUERY_MIN and q.type != QUERY_MAX;
 
-    // ret_vals.resize(di.ncols);
-    ret_vals.reserve(di.ncols);
-    if (use_i32_output) { ret_vals_i32.reserve(di.ncols); }
+    ret_vals.resize(di.ncols);
+    if (use_i32_output) { ret_vals_i32.resize(di.ncols); }
     // ret.idxs.push_back(1);
     // ret.vals_u8.push_back(1);
 
@@ -350,7 +461,6 @@ static inline QueryResult reduce_contiguous(const QueryParams& q,
     //
     if (di.storage_order == ROWMAJOR) {
         RowmajorMat mat(data_ptr, di.nrows, di.ncols);
-        RowVector tmp(di.ncols);
 
         // printf("*** using rowmajor storage order\n");
 
@@ -360,13 +470,13 @@ static inline QueryResult reduce_contiguous(const QueryParams& q,
         // have to implement these reductions ourselves
         switch (q.type) {
         case QUERY_MEAN:
-            // printf("running rowmajor query_mean!\n");
-            reduce_sum_avx2_rowmajor_ax0(mat.data(), di.nrows, di.ncols, ret_buff_i32);
-            // for (size_t j = 0; j < di.ncols; j++) {
-            //     ret_buff_i32[j] /= di.nrows;
-            // }
+            // one window spanning the whole buffer; this accumulates in
+            // wide enough ints that it can't overflow
+            sliding_mean(q, di, data_ptr, ret);
+            return;
         case QUERY_SUM:
             reduce_sum_avx2_rowmajor_ax0(mat.data(), di.nrows, di.ncols, ret_buff_i32);
+            break;
         case QUERY_MIN:
             ret_vec = mat.row(0);
             for (size_t i = 1; i < di.nrows; i++) {
@@ -410,7 +520,6 @@ static inline QueryResult reduce_contiguous(const QueryParams& q,
                 (int)q.type); exit(1);
         }
     }
-    return ret;
 }
 
 #endif // QUERY_MIN_MAX_HPP
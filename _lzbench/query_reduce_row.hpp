@@ -152,8 +152,8 @@ private:
 };
 
 template<class DataT, int OpE>
-QueryResult sliding_window_reduction(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_window_reduction(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     using dist_t = typename DataTypeTraits<DataT>::AccumulatorT;
     auto window_nrows = q.window_nrows > 0 ? q.window_nrows : di.nrows;
@@ -170,12 +170,10 @@ QueryResult sliding_window_reduction(const QueryParams& q,
     auto ret_ncols = 1; // scalar reduction
     auto ret_size = nwindows * ret_ncols;
 
-    QueryResult ret;
     auto& ret_vals = QueryResultValsRef<dist_t>{}(ret);
+    if (nwindows < 1) { ret_vals.clear(); return; }
     ret_vals.resize(ret_size);
 
-    if (nwindows < 1) { return ret; }
-
     auto& query_data = QueryDataValsRef<DataT>{}(q);
 
     if (di.storage_order == ROWMAJOR) {
@@ -191,7 +189,7 @@ QueryResult sliding_window_reduction(const QueryParams& q,
             stat.update(window_ptr);
             stat.write_stats(ret_row_ptr);
         }
-        return ret;
+        return;
     }
 
     // column-major; treat each col as 1D rowmajor, and also write out results
@@ -223,22 +221,21 @@ QueryResult sliding_window_reduction(const QueryParams& q,
             ret_vals[row] += tmp;
         }
     }
-    return ret;
 }
 
 template<class DataT>
-QueryResult sliding_l2(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_l2(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     // printf("running sliding l2 query!\n");
-    return sliding_window_reduction<DataT, OpE::SQUARE_DIFF>(q, di, buff);
+    sliding_window_reduction<DataT, OpE::SQUARE_DIFF>(q, di, buff, ret);
 }
 template<class DataT>
-QueryResult sliding_dot(const QueryParams& q,
-    const DataInfo& di, const DataT* buff)
+void sliding_dot(const QueryParams& q,
+    const DataInfo& di, const DataT* buff, QueryResult& ret)
 {
     // printf("running sliding dot prod query!\n");
-    return sliding_window_reduction<DataT, OpE::PRODUCT>(q, di, buff);
+    sliding_window_reduction<DataT, OpE::PRODUCT>(q, di, buff, ret);
 }
 
 #endif // QUERY_REDUCE_ROW_HPP
@@ -0,0 +1,100 @@
+//
+// stopping_rule.cpp
+// Run-until-stable timing for the compression and decompression loops (-A)
+//
+
+#include "stopping_rule.h"
+
+#include <algorithm>
+#include <random>
+
+#include "lzbench.h" // timetype_e
+
+static const size_t kMinSteadySamples = 5;
+static const int kNumResamples = 200;
+
+StoppingRule::StoppingRule(int target_pct, int max_secs, int timetype):
+    target(target_pct / 100.), max_nanos((uint64_t)max_secs * 1000000000ULL),
+    timetype(timetype), next_check(kMinSteadySamples), nwarmup(0), rel_ci(-1)
+{}
+
+bool StoppingRule::add(uint64_t nanos, uint64_t total_nanos) {
+    samples.push_back(nanos);
+    bool out_of_time = total_nanos >= max_nanos;
+    // recomputing after every sample would be quadratic, so only do it
+    // each time there are 1/8 more
+    if (samples.size() >= next_check || out_of_time) {
+        update();
+        next_check = samples.size() + std::max((size_t)1, samples.size() / 8);
+    }
+    bool stable = samples.size() - nwarmup >= kMinSteadySamples &&
+        rel_ci >= 0 && rel_ci <= target;
+    return stable || out_of_time;
+}
+
+std::vector<uint64_t> StoppingRule::steady_samples() const {
+    return std::vector<uint64_t>(samples.begin() + nwarmup, samples.end());
+}
+
+static double _statistic(std::vector<double>& vals, int timetype) {
+    switch (timetype) {
+        case AVERAGE: {
+            double sum = 0;
+            for (auto x : vals) { sum += x; }
+            return sum / vals.size();
+        }
+        case MEDIAN: {
+            size_t n = vals.size();
+            std::nth_element(vals.begin(), vals.begin() + n / 2, vals.end());
+            double hi = vals[n / 2];
+            if (n % 2) { return hi; }
+            return (*std::max_element(vals.begin(), vals.begin() + n / 2) + hi) / 2;
+        }
+        default: // FASTEST
+            return *std::min_element(vals.begin(), vals.end());
+    }
+}
+
+void StoppingRule::update() {
+    size_t n = samples.size();
+
+    // MSER: drop the first d samples, for the d in the first half that
+    // minimizes the sum of squared deviations of the rest over the square
+    // of how many are left (i.e., their variance over how many are left);
+    // suffix sums make trying every d linear
+    std::vector<double> suffix_sum(n + 1, 0), suffix_sumsq(n + 1, 0);
+    for (size_t i = n; i > 0; i--) {
+        double x = (double)samples[i - 1];
+        suffix_sum[i - 1] = suffix_sum[i] + x;
+        suffix_sumsq[i - 1] = suffix_sumsq[i] + x * x;
+    }
+    double best_score = -1;
+    nwarmup = 0;
+    for (size_t d = 0; d <= n / 2 && n - d >= kMinSteadySamples; d++) {
+        double m = (double)(n - d);
+        double mean = suffix_sum[d] / m;
+        double var = std::max(0., suffix_sumsq[d] / m - mean * mean);
+        double score = var / m;
+        if (best_score < 0 || score < best_score) {
+            best_score = score;
+            nwarmup = d;
+        }
+    }
+
+    // percentile bootstrap of the statistic over the steady-state samples;
+    // the seed is fixed so that the same samples always stop the same way
+    size_t nsteady = n - nwarmup;
+    if (nsteady < 2) { rel_ci = -1; return; }
+    std::vector<double> steady(samples.begin() + nwarmup, samples.end());
+    std::vector<double> resample(nsteady), stats(kNumResamples);
+    double point = _statistic(steady, timetype);
+    std::mt19937 rng(12345);
+    for (int r = 0; r < kNumResamples; r++) {
+        for (auto& x : resample) { x = (double)samples[nwarmup + rng() % nsteady]; }
+        stats[r] = _statistic(resample, timetype);
+    }
+    std::sort(stats.begin(), stats.end());
+    double lo = stats[(size_t)(.025 * (kNumResamples - 1))];
+    double hi = stats[(size_t)(.975 * (kNumResamples - 1))];
+    rel_ci = point > 0 ? (hi - lo) / (2 * point) : -1;
+}
@@ -0,0 +1,44 @@
+//
+// stopping_rule.h
+// Run-until-stable timing for the compression and decompression loops (-A)
+//
+
+#ifndef _stopping_rule_h
+#define _stopping_rule_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// decides when a timing loop has taken enough samples: once the 95%
+// confidence interval of the statistic being reported (fastest, average,
+// or median; a timetype_e) is within target_pct percent of it, or once
+// max_secs have gone by. Warm-up samples are found by MSER (the truncation
+// point that minimizes the standard error of what's left) and left out of
+// both the interval and the samples that get reported.
+class StoppingRule {
+public:
+    StoppingRule(int target_pct, int max_secs, int timetype);
+
+    // adds one iteration's time; returns true once there are enough
+    bool add(uint64_t nanos, uint64_t total_nanos);
+
+    // the samples after the warm-up
+    std::vector<uint64_t> steady_samples() const;
+    // half the width of the confidence interval, relative to the statistic
+    double ci() const { return rel_ci; }
+    size_t warmup() const { return nwarmup; }
+
+private:
+    void update();
+
+    double target;
+    uint64_t max_nanos;
+    int timetype;
+    std::vector<uint64_t> samples;
+    size_t next_check;
+    size_t nwarmup;
+    double rel_ci;
+};
+
+#endif
@@ -551,6 +551,81 @@ UTIL_STATIC void free_data_buffer(void* ptr) {
     }
 }
 
+/* Data buffers from mmap rather than malloc (-M), so that they can use
+ * transparent huge pages or be backed by the input file itself; these must
+ * be freed with unmap_data_buffer, passing the same size. */
+#if !defined(_WIN32)
+#define UTIL_HAS_MMAP
+#include <sys/mman.h>
+
+UTIL_STATIC size_t _page_round_up(size_t size) {
+    size_t page_sz = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page_sz - 1) & ~(page_sz - 1);
+}
+
+/* Like alloc_data_buffer, but asks for huge pages before touching them, so
+ * that big buffers take far fewer TLB entries. */
+UTIL_STATIC uint8_t* alloc_huge_data_buffer(size_t size) {
+    void* buf = mmap(NULL, _page_round_up(size), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) { return NULL; }
+#ifdef MADV_HUGEPAGE
+    madvise(buf, _page_round_up(size), MADV_HUGEPAGE);
+#endif
+    volatile char zero = 0;
+    for (size_t i = 0; i < size; i += MIN_PAGE_SIZE) {
+        static_cast<volatile char*>(buf)[i] = zero;
+    }
+    return reinterpret_cast<uint8_t*>(buf);
+}
+
+/* Maps size bytes of the file, starting at offset, followed by pad_size
+ * bytes of zeros that codecs can overread into. The pages are private
+ * copy-on-write, so the buffer can be written like any other, and are
+ * read in up front so that page faults don't end up in the timings.
+ * The offset doesn't need to be page aligned; the returned pointer has the
+ * same alignment as the offset. */
+UTIL_STATIC uint8_t* map_file_data_buffer(FILE* f, size_t offset,
+    size_t size, size_t pad_size)
+{
+    size_t page_sz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t skip = offset & (page_sz - 1);
+    size_t total_sz = _page_round_up(skip + size + pad_size);
+
+    // reserve the whole range as zeros, then put the file over the start
+    char* base = (char*)mmap(NULL, total_sz, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) { return NULL; }
+    if (size > 0) {
+        int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        void* mapped = mmap(base, skip + size, PROT_READ | PROT_WRITE, flags,
+            fileno(f), (off_t)(offset - skip));
+        if (mapped == MAP_FAILED) {
+            munmap(base, total_sz);
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(base, skip + size, MADV_HUGEPAGE);
+#endif
+        // the rest of the last file page holds whatever follows in the
+        // file, not zeros
+        size_t file_end = skip + size;
+        memset(base + file_end, 0, _page_round_up(file_end) - file_end);
+    }
+    return reinterpret_cast<uint8_t*>(base + skip);
+}
+
+/* size is the size passed when allocating (size + pad_size for files) */
+UTIL_STATIC void unmap_data_buffer(uint8_t* ptr, size_t size) {
+    size_t page_sz = (size_t)sysconf(_SC_PAGESIZE);
+    size_t skip = ((size_t)ptr) & (page_sz - 1);
+    munmap(ptr - skip, _page_round_up(skip + size));
+}
+#endif
+
 UTIL_STATIC bool strings_equal(const char* s0, const char* s1) {
     std::string a(s0);
     std::string b(s1);
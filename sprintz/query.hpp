@@ -13,15 +13,129 @@
 
 #include "traits.hpp"
 #include "util.h" // DIV_ROUND_UP
+#include <math.h> // sqrt
+#include <string.h> // memset
+#include <limits>
+#include <new> // bad_alloc
 #include <vector>
 
-enum Operation { REDUCE_MIN, REDUCE_MAX, REDUCE_SUM };
+enum Operation { REDUCE_MIN, REDUCE_MAX, REDUCE_SUM, REDUCE_CORR,
+    REDUCE_BUCKETS, REDUCE_HISTOGRAM };
 
 typedef struct QueryParams {
     Operation op;
     bool materialize; /// whether to materialize the decompressed data
+    std::vector<uint16_t> which_cols; /// columns to decode; empty -> all
+    uint32_t window_nrows; /// rows per window (or bucket); 0 -> all rows
+    double max_err; /// widest bounds interval a bounds query may return
 } QueryParams;
 
+// where the min, max, and mean of one column within one window must lie;
+// lo == hi once the answer is exact
+typedef struct ColumnBounds {
+    int64_t min_lo, min_hi;
+    int64_t max_lo, max_hi;
+    double mean_lo, mean_hi;
+} ColumnBounds;
+
+// min, max, and mean of one column within one bucket of rows
+typedef struct BucketStats {
+    int64_t min, max;
+    double mean;
+} BucketStats;
+
+static inline double max_bounds_width(const std::vector<ColumnBounds>& bounds) {
+    double width = 0;
+    for (const auto& b : bounds) {
+        width = fmax(width, (double)(b.min_hi - b.min_lo));
+        width = fmax(width, (double)(b.max_hi - b.max_lo));
+        width = fmax(width, b.mean_hi - b.mean_lo);
+    }
+    return width;
+}
+
+// ------------------------------------------------ histograms
+
+// 8b values each get their own bin. 16b values get log-linear bins, as in
+// HDR histograms: values below 32 get their own bin, and each larger power
+// of two is split into 32 equal bins, so a bin is never wider than 1/32 of
+// its smallest value.
+template<typename DataT> struct histogram_traits {};
+template<> struct histogram_traits<uint8_t> {
+    static const uint32_t nbins = 256;
+};
+template<> struct histogram_traits<uint16_t> {
+    static const uint32_t nbins = 384;
+};
+
+static inline uint32_t histogram_bin(uint8_t x) { return x; }
+static inline uint32_t histogram_bin(uint16_t x) {
+    if (x < 32) { return x; }
+    int log2_x = 31 - __builtin_clz(x);
+    return ((log2_x - 4) << 5) | ((x >> (log2_x - 5)) & 31);
+}
+
+// smallest and largest values that land in a bin
+template<typename DataT>
+static inline uint32_t histogram_bin_min(uint32_t bin) {
+    if (sizeof(DataT) == 1 || bin < 32) { return bin; }
+    return (32 | (bin & 31)) << ((bin >> 5) - 1);
+}
+template<typename DataT>
+static inline uint32_t histogram_bin_max(uint32_t bin) {
+    if (sizeof(DataT) == 1 || bin < 32) { return bin; }
+    return histogram_bin_min<DataT>(bin) + (1 << ((bin >> 5) - 1)) - 1;
+}
+
+// value below which fraction q of the counted values lie; exact for 8b
+// data, and the midpoint of the right bin for 16b data, so off by at
+// most 1/64 of the true value. Returns -1 if nothing was counted.
+template<typename DataT>
+static inline double histogram_quantile(const uint32_t* counts, double q) {
+    const uint32_t nbins = histogram_traits<DataT>::nbins;
+    uint64_t total = 0;
+    for (uint32_t b = 0; b < nbins; b++) { total += counts[b]; }
+    if (total == 0) { return -1; }
+    uint64_t rank = (uint64_t)ceil(q * total);
+    rank = rank > 0 ? rank : 1;
+    uint64_t cumsum = 0;
+    uint32_t b = 0;
+    for ( ; b < nbins - 1; b++) {
+        cumsum += counts[b];
+        if (cumsum >= rank) { break; }
+    }
+    return (histogram_bin_min<DataT>(b) + histogram_bin_max<DataT>(b)) / 2.;
+}
+
+// histograms from different chunks, threads, or windows just add up
+static inline void merge_histograms(const uint32_t* counts, size_t len,
+    uint64_t* totals)
+{
+    for (size_t i = 0; i < len; i++) { totals[i] += counts[i]; }
+}
+
+// figures out which stripes and vectors contain at least one of the columns
+// in which_cols, so decoders can skip the rest; with no cols given, every
+// stripe and vector is needed. Arrays need nvectors * (vector_sz / stripe_sz)
+// and nvectors entries, respectively
+static inline void mark_needed_stripes(const uint16_t* which_cols,
+    uint16_t nwhich_cols, uint16_t ndims, uint8_t stripe_sz,
+    uint8_t vector_sz, uint8_t* stripe_needed, uint8_t* vector_needed)
+{
+    uint32_t nvectors = DIV_ROUND_UP(ndims, vector_sz);
+    uint32_t nstripes = nvectors * (vector_sz / stripe_sz);
+    bool all_cols = (which_cols == nullptr) || (nwhich_cols == 0);
+    memset(stripe_needed, all_cols, nstripes);
+    memset(vector_needed, all_cols, nvectors);
+    if (all_cols) { return; }
+    for (uint16_t i = 0; i < nwhich_cols; i++) {
+        uint16_t col = which_cols[i];
+        if (col >= ndims) { continue; } // no such column; nothing to decode
+        stripe_needed[col / stripe_sz] = 1;
+        vector_needed[col / vector_sz] = 1;
+    }
+}
+
 // template<class vec_t> struct VecBox {};
 // template<> struct VecBox<__m256i> {
 //     using data_type = __m256i;
@@ -163,6 +277,30 @@ static inline void accumulate(
 //     static const int elems_per_vec = vec_sz / scalar_sz;                      \
 //     static_assert(vec_sz % scalar_sz == 0, "Invalid scalar-vector pairing!");
 
+// operator new only guarantees 16B alignment before C++17, so vectors of
+// __m256i (or structs holding them) need this to avoid faulting on the
+// aligned loads and stores the compiler emits for them
+template<class T>
+struct AlignedAllocator {
+    using value_type = T;
+    AlignedAllocator() {}
+    template<class U> AlignedAllocator(const AlignedAllocator<U>&) {}
+    T* allocate(size_t n) {
+        void* ptr = _mm_malloc(n * sizeof(T), MAX(alignof(T), (size_t)32));
+        if (ptr == nullptr) { throw std::bad_alloc(); }
+        return (T*)ptr;
+    }
+    void deallocate(T* ptr, size_t n) { _mm_free(ptr); }
+};
+template<class T, class U>
+bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return true;
+}
+template<class T, class U>
+bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+    return false;
+}
+
 template<typename DataT>
 class NoopQuery {
 public:
@@ -181,7 +319,7 @@ public:
     using vec_t = typename scalar_traits<DataT>::vector_type;
 //    using state_t = std::vector<vec_t>;
     using packet_t = typename scalar_traits<DataT>::packet_type;
-    using state_t = std::vector<packet_t>;
+    using state_t = std::vector<packet_t, AlignedAllocator<packet_t> >;
     static const int scalar_sz = scalar_traits<DataT>::size;
     static const int vec_sz = vector_traits<vec_t>::size;
     static const int elems_per_vec = vec_sz / scalar_sz;
@@ -207,7 +345,7 @@ public:
     using vec_t = typename scalar_traits<DataT>::vector_type;
     using accumulator_t = int32_t; // XXX handle other types
     using packet_t = typename scalar_traits<accumulator_t>::packet_type;
-    using state_t = std::vector<packet_t>;
+    using state_t = std::vector<packet_t, AlignedAllocator<packet_t> >;
 //    static const int scalar_sz = MAX(sizeof(DataT), 4);  // at least 32b accum
     static const int accum_sz = sizeof(accumulator_t);  // at least 32b accum
     static const int vec_sz = vector_traits<vec_t>::size;
@@ -233,6 +371,480 @@ private:
     state_t state;
 };
 
+// prods[j, k] += sum over rows of x[j] * x[k], for k >= j (and a few
+// k < j, which are never read); rows of xs are zero-padded to padded_n,
+// a multiple of 4
+static inline void add_outer_products(const uint32_t* xs, uint32_t nrows,
+    uint32_t n, uint32_t padded_n, uint64_t* prods)
+{
+    for (uint32_t j = 0; j < n; j++) {
+        uint64_t* prods_row = prods + j * padded_n;
+        for (uint32_t k = j & ~3; k < n; k += 4) {
+            __m256i accum = _mm256_loadu_si256((const __m256i*)(prods_row + k));
+            const uint32_t* x = xs;
+            for (uint32_t i = 0; i < nrows; i++) {
+                __m256i xj = _mm256_set1_epi64x(x[j]);
+                __m256i xk = _mm256_cvtepu32_epi64(
+                    _mm_loadu_si128((const __m128i*)(x + k)));
+                accum = _mm256_add_epi64(accum, _mm256_mul_epu32(xj, xk));
+                x += padded_n;
+            }
+            _mm256_storeu_si256((__m256i*)(prods_row + k), accum);
+        }
+    }
+}
+
+// pearson correlation between each pair of columns in which_cols (or all
+// columns), over each window of window_nrows rows, or over all the rows if
+// window_nrows is 0. Decoders hand us each row of a block one vector at a
+// time, highest vector first, so we buffer the block and fold it in once
+// the lowest needed vector of the last row shows up. Sums and products
+// are exact integers, so there's no cancellation when centering; runs
+// are folded in with a single multiply-add instead of row by row.
+template<typename DataT>
+class CorrQuery {
+public:
+    using vec_t = typename scalar_traits<DataT>::vector_type;
+    static const int scalar_sz = scalar_traits<DataT>::size;
+    static const int vec_sz = vector_traits<vec_t>::size;
+    static const int elems_per_vec = vec_sz / scalar_sz;
+    static const uint32_t block_sz = 8;
+
+    CorrQuery(int64_t ndims, const std::vector<uint16_t>& which_cols,
+              uint32_t window_nrows=0):
+        padded_ndims(DIV_ROUND_UP(ndims, elems_per_vec) * elems_per_vec),
+        window_nrows(window_nrows),
+        block_row(0),
+        last_vstripe(0),
+        nrows_in_window(0)
+    {
+        for (auto col : which_cols) {
+            if (col < ndims) { cols.push_back(col); }
+        }
+        if (which_cols.size() == 0) {
+            for (uint16_t j = 0; j < ndims; j++) { cols.push_back(j); }
+        }
+        // vectors are handed to us in descending order, so the lowest
+        // one containing a needed col comes last
+        last_vstripe = (uint32_t)(ndims / elems_per_vec);
+        for (auto col : cols) {
+            last_vstripe = MIN(last_vstripe, (uint32_t)(col / elems_per_vec));
+        }
+        // extra col of 1s after the selected cols, so that the sum of
+        // each col shows up in the products
+        padded_nstats = (nstats() + 1 + 3) & ~3;
+        block.resize(block_sz * padded_ndims);
+        xs.resize(block_sz * padded_nstats);
+        for (uint32_t i = 0; i < block_sz; i++) {
+            xs[i * padded_nstats + nstats()] = 1;
+        }
+        prods.resize((nstats() + 1) * padded_nstats);
+    }
+
+    void operator()(uint32_t vstripe, const vec_t& prev_vals,
+        const vec_t& vals, uint32_t nrepeats=1)
+    {
+        if (nrepeats != 1) { // run of copies of the previous row
+            DataT* row = block.data() + (block_sz - 1) * padded_ndims;
+            _mm256_storeu_si256((__m256i*)(row + vstripe * elems_per_vec),
+                prev_vals);
+            if (vstripe == last_vstripe) { add_rows(row, 1, nrepeats); }
+            return;
+        }
+        DataT* row = block.data() + block_row * padded_ndims;
+        _mm256_storeu_si256((__m256i*)(row + vstripe * elems_per_vec), vals);
+        block_row = block_row == block_sz - 1 ? 0 : block_row + 1;
+        if (block_row == 0 && vstripe == last_vstripe) {
+            add_rows(block.data(), block_sz, 1);
+        }
+    }
+
+    // one nstats x nstats rowmajor matrix per complete window, or just one
+    // matrix if there's no window; NaN for constant columns, as in numpy
+    std::vector<double> result() {
+        std::vector<double> ret(corrs);
+        if (window_nrows == 0) { append_corr(ret); }
+        return ret;
+    }
+
+    uint32_t nstats() const { return (uint32_t)cols.size(); }
+
+private:
+    // either nrows distinct rows, or one row repeated count times; window
+    // boundaries can fall anywhere in either
+    void add_rows(const DataT* rows, uint32_t nrows, uint32_t count) {
+        uint64_t remaining = nrows == 1 ? count : nrows;
+        while (remaining > 0) {
+            uint64_t n = remaining;
+            if (window_nrows > 0) {
+                n = MIN(n, window_nrows - nrows_in_window);
+            }
+            if (nrows == 1) {
+                add_repeated_row(rows, n);
+            } else {
+                add_distinct_rows(rows, (uint32_t)n);
+                rows += n * padded_ndims;
+            }
+            remaining -= n;
+            nrows_in_window += n;
+            if (window_nrows > 0 && nrows_in_window == window_nrows) {
+                append_corr(corrs);
+                memset(prods.data(), 0, prods.size() * sizeof(prods[0]));
+                nrows_in_window = 0;
+            }
+        }
+    }
+    void add_distinct_rows(const DataT* rows, uint32_t nrows) {
+        for (uint32_t i = 0; i < nrows; i++) {
+            const DataT* row = rows + i * padded_ndims;
+            uint32_t* x = xs.data() + i * padded_nstats;
+            for (uint32_t j_idx = 0; j_idx < nstats(); j_idx++) {
+                x[j_idx] = row[cols[j_idx]];
+            }
+        }
+        add_outer_products(xs.data(), nrows, nstats() + 1, padded_nstats,
+            prods.data());
+    }
+    void add_repeated_row(const DataT* row, uint64_t count) {
+        uint32_t* x = xs.data();
+        for (uint32_t j_idx = 0; j_idx < nstats(); j_idx++) {
+            x[j_idx] = row[cols[j_idx]];
+        }
+        for (uint32_t j = 0; j <= nstats(); j++) {
+            uint64_t x_j_count = x[j] * count;
+            for (uint32_t k = j; k <= nstats(); k++) {
+                prods[j * padded_nstats + k] += x_j_count * x[k];
+            }
+        }
+    }
+
+    // n * sum(x_j * x_k) - sum(x_j) * sum(x_k), computed exactly
+    __int128 comoment(uint32_t j, uint32_t k) const {
+        unsigned __int128 n = nrows_in_window;
+        unsigned __int128 sum_j = prods[j * padded_nstats + nstats()];
+        unsigned __int128 sum_k = prods[k * padded_nstats + nstats()];
+        return (__int128)(n * prods[j * padded_nstats + k] - sum_j * sum_k);
+    }
+    void append_corr(std::vector<double>& out) const {
+        size_t offset = out.size();
+        out.resize(offset + nstats() * nstats());
+        double* corr = out.data() + offset;
+        for (uint32_t j = 0; j < nstats(); j++) {
+            __int128 var_j = comoment(j, j);
+            for (uint32_t k = j; k < nstats(); k++) {
+                __int128 var_k = comoment(k, k);
+                // checked explicitly, since 0/0 isn't guaranteed to give
+                // NaN under -ffast-math
+                double val = std::numeric_limits<double>::quiet_NaN();
+                if (var_j != 0 && var_k != 0) {
+                    val = (double)comoment(j, k) /
+                        sqrt((double)var_j * (double)var_k);
+                }
+                corr[j * nstats() + k] = val;
+                corr[k * nstats() + j] = val;
+            }
+        }
+    }
+
+    std::vector<uint16_t> cols;
+    std::vector<DataT> block;       // current block of decoded rows
+    std::vector<uint32_t> xs;       // selected cols of rows, widened
+    std::vector<uint64_t> prods;    // upper triangle of sum of x x^T
+    std::vector<double> corrs;      // matrices for finished windows
+    uint32_t padded_ndims;
+    uint32_t padded_nstats;
+    uint32_t window_nrows;
+    uint32_t block_row;
+    uint32_t last_vstripe;
+    uint64_t nrows_in_window;
+};
+
+// min, max, and mean of each column in which_cols (or all columns) within
+// each bucket of window_nrows consecutive rows, or over all the rows if
+// window_nrows is 0; a trailing partial bucket gets its own entry. Each
+// bucket is reduced as soon as its last row is decoded, so nothing bigger
+// than one row per vector is ever materialized. Each vector keeps its own
+// row count, since decoders hand us a whole block of one vector before
+// moving on to the next. Sums are kept in 32-bit lanes and moved into
+// 64-bit totals before they can overflow.
+template<typename DataT>
+class BucketQuery {
+public:
+    using vec_t = typename scalar_traits<DataT>::vector_type;
+    static const int scalar_sz = scalar_traits<DataT>::size;
+    static const int vec_sz = vector_traits<vec_t>::size;
+    static const int elems_per_vec = vec_sz / scalar_sz;
+    static const int nsum_vecs = scalar_sz == 1 ? 4 : 2;
+    static const uint32_t kMaxRowsPerFlush = 1 << 16;
+
+    BucketQuery(int64_t ndims, const std::vector<uint16_t>& which_cols,
+                uint32_t window_nrows=0):
+        window_nrows(window_nrows)
+    {
+        for (auto col : which_cols) {
+            if (col < ndims) { cols.push_back(col); }
+        }
+        if (which_cols.size() == 0) {
+            for (uint16_t j = 0; j < ndims; j++) { cols.push_back(j); }
+        }
+        uint32_t nvectors = DIV_ROUND_UP(ndims, elems_per_vec);
+        states.resize(nvectors);
+        stats_in_vector.resize(nvectors);
+        sums.resize(nvectors * elems_per_vec);
+        for (uint32_t j_idx = 0; j_idx < nstats(); j_idx++) {
+            stats_in_vector[cols[j_idx] / elems_per_vec].push_back(j_idx);
+        }
+        for (uint32_t v = 0; v < nvectors; v++) { reset_window(v); }
+    }
+
+    void operator()(uint32_t vstripe, const vec_t& prev_vals,
+        const vec_t& vals, uint32_t nrepeats=1)
+    {
+        VectorState& state = states[vstripe];
+        uint64_t remaining = nrepeats;
+        while (remaining > 0) {
+            uint64_t n = remaining;
+            if (window_nrows > 0) {
+                n = MIN(n, window_nrows - state.nrows_in_window);
+            }
+            add_rows(vstripe, vals, n);
+            remaining -= n;
+            state.nrows_in_window += n;
+            if (window_nrows > 0 && state.nrows_in_window == window_nrows) {
+                append_window(vstripe);
+            }
+        }
+    }
+
+    // nstats entries per bucket; ends the current bucket, so call it once
+    const std::vector<BucketStats>& result() {
+        for (uint32_t v = 0; v < states.size(); v++) {
+            if (states[v].nrows_in_window > 0) { append_window(v); }
+        }
+        return buckets;
+    }
+
+    uint32_t nstats() const { return (uint32_t)cols.size(); }
+
+private:
+    typedef struct VectorState {
+        vec_t mins, maxs;
+        __m256i sums[nsum_vecs];
+        uint64_t nrows_in_window;
+        uint32_t nrows_since_flush;
+        uint32_t nwindows;
+    } VectorState;
+
+    void add_rows(uint32_t v, const vec_t& vals, uint64_t n) {
+        VectorState& state = states[v];
+        if (scalar_sz == 1) {
+            state.mins = _mm256_min_epu8(state.mins, vals);
+            state.maxs = _mm256_max_epu8(state.maxs, vals);
+        } else {
+            state.mins = _mm256_min_epu16(state.mins, vals);
+            state.maxs = _mm256_max_epu16(state.maxs, vals);
+        }
+        if (n == 1 && state.nrows_since_flush < kMaxRowsPerFlush) {
+            __m128i low = _mm256_castsi256_si128(vals);
+            __m128i high = _mm256_extracti128_si256(vals, 1);
+            __m256i widened[nsum_vecs];
+            if (scalar_sz == 1) {
+                widened[0] = _mm256_cvtepu8_epi32(low);
+                widened[1] = _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8));
+                widened[2 % nsum_vecs] = _mm256_cvtepu8_epi32(high);
+                widened[3 % nsum_vecs] = _mm256_cvtepu8_epi32(
+                    _mm_srli_si128(high, 8));
+            } else {
+                widened[0] = _mm256_cvtepu16_epi32(low);
+                widened[1] = _mm256_cvtepu16_epi32(high);
+            }
+            for (int i = 0; i < nsum_vecs; i++) {
+                state.sums[i] = _mm256_add_epi32(state.sums[i], widened[i]);
+            }
+            state.nrows_since_flush++;
+            return;
+        }
+        // runs are rare, so just add them to the 64-bit sums directly
+        flush_sums(v);
+        DataT vals_ar[elems_per_vec];
+        _mm256_storeu_si256((__m256i*)vals_ar, vals);
+        uint64_t* vsums = sums.data() + v * elems_per_vec;
+        for (int i = 0; i < elems_per_vec; i++) {
+            vsums[i] += vals_ar[i] * n;
+        }
+    }
+    void flush_sums(uint32_t v) {
+        VectorState& state = states[v];
+        uint64_t* vsums = sums.data() + v * elems_per_vec;
+        for (int i = 0; i < nsum_vecs; i++) {
+            uint32_t sums_ar[8];
+            _mm256_storeu_si256((__m256i*)sums_ar, state.sums[i]);
+            for (int k = 0; k < 8; k++) { vsums[8 * i + k] += sums_ar[k]; }
+            state.sums[i] = _mm256_setzero_si256();
+        }
+        state.nrows_since_flush = 0;
+    }
+    void append_window(uint32_t v) {
+        VectorState& state = states[v];
+        flush_sums(v);
+        DataT mins_ar[elems_per_vec];
+        DataT maxs_ar[elems_per_vec];
+        _mm256_storeu_si256((__m256i*)mins_ar, state.mins);
+        _mm256_storeu_si256((__m256i*)maxs_ar, state.maxs);
+        size_t offset = state.nwindows * nstats();
+        buckets.resize(MAX(buckets.size(), offset + nstats()));
+        for (auto j_idx : stats_in_vector[v]) {
+            uint32_t lane = cols[j_idx] % elems_per_vec;
+            double mean = (double)sums[v * elems_per_vec + lane] /
+                state.nrows_in_window;
+            buckets[offset + j_idx] = BucketStats{
+                mins_ar[lane], maxs_ar[lane], mean};
+        }
+        state.nwindows++;
+        reset_window(v);
+    }
+    void reset_window(uint32_t v) {
+        VectorState& state = states[v];
+        state.mins = _mm256_set1_epi8(-1);
+        state.maxs = _mm256_setzero_si256();
+        for (int i = 0; i < nsum_vecs; i++) {
+            state.sums[i] = _mm256_setzero_si256();
+        }
+        state.nrows_in_window = 0;
+        state.nrows_since_flush = 0;
+        memset(sums.data() + v * elems_per_vec, 0,
+            elems_per_vec * sizeof(sums[0]));
+    }
+
+    std::vector<uint16_t> cols;
+    std::vector<VectorState, AlignedAllocator<VectorState> > states;
+    std::vector<std::vector<uint32_t> > stats_in_vector;
+    std::vector<uint64_t> sums;         // flushed sums of each col
+    std::vector<BucketStats> buckets;   // finished buckets
+    uint32_t window_nrows;
+};
+
+// histogram of each column in which_cols (or all columns) within each
+// window of window_nrows rows, or over all the rows if window_nrows is 0;
+// see histogram_traits for the bins. Counts are laid out as
+// [window][stat][bin]. Bins are computed for a whole vector at once, and
+// runs just add their length to each bin, so rle blocks cost one update
+// per column no matter how long they are.
+template<typename DataT>
+class HistogramQuery {
+public:
+    using vec_t = typename scalar_traits<DataT>::vector_type;
+    static const int scalar_sz = scalar_traits<DataT>::size;
+    static const int vec_sz = vector_traits<vec_t>::size;
+    static const int elems_per_vec = vec_sz / scalar_sz;
+    static const uint32_t nbins = histogram_traits<DataT>::nbins;
+
+    HistogramQuery(int64_t ndims, const std::vector<uint16_t>& which_cols,
+                   uint32_t window_nrows=0):
+        window_nrows(window_nrows)
+    {
+        for (auto col : which_cols) {
+            if (col < ndims) { cols.push_back(col); }
+        }
+        if (which_cols.size() == 0) {
+            for (uint16_t j = 0; j < ndims; j++) { cols.push_back(j); }
+        }
+        // flat list of (lane, offset of histogram) for each vector's stats
+        uint32_t nvectors = DIV_ROUND_UP(ndims, elems_per_vec);
+        states.resize(nvectors);
+        for (uint32_t v = 0; v < nvectors; v++) {
+            states[v].stats_start = (uint32_t)stat_lanes.size();
+            for (uint32_t j_idx = 0; j_idx < nstats(); j_idx++) {
+                if (cols[j_idx] / elems_per_vec != v) { continue; }
+                stat_lanes.push_back(cols[j_idx] % elems_per_vec);
+                stat_offsets.push_back(j_idx * nbins);
+            }
+            states[v].stats_end = (uint32_t)stat_lanes.size();
+        }
+    }
+
+    void operator()(uint32_t vstripe, const vec_t& prev_vals,
+        const vec_t& vals, uint32_t nrepeats=1)
+    {
+        VectorState& state = states[vstripe];
+        uint16_t bins[elems_per_vec];
+        store_bins(vals, bins);
+        uint64_t remaining = nrepeats;
+        while (remaining > 0) {
+            uint64_t n = remaining;
+            if (window_nrows > 0) {
+                n = MIN(n, window_nrows - state.nrows_in_window);
+            }
+            size_t window_offset = state.nwindows * nstats() * nbins;
+            if (state.nrows_in_window == 0) {
+                counts.resize(MAX(counts.size(),
+                    window_offset + nstats() * nbins));
+            }
+            uint32_t* window_counts = counts.data() + window_offset;
+            for (uint32_t k = state.stats_start; k < state.stats_end; k++) {
+                window_counts[stat_offsets[k] + bins[stat_lanes[k]]] +=
+                    (uint32_t)n;
+            }
+            remaining -= n;
+            state.nrows_in_window += n;
+            if (window_nrows > 0 && state.nrows_in_window == window_nrows) {
+                state.nwindows++;
+                state.nrows_in_window = 0;
+            }
+        }
+    }
+
+    // nstats * nbins counts per window, including any trailing partial one
+    const std::vector<uint32_t>& result() const { return counts; }
+
+    uint32_t nstats() const { return (uint32_t)cols.size(); }
+
+private:
+    typedef struct VectorState {
+        uint64_t nrows_in_window;
+        uint32_t nwindows;
+        uint32_t stats_start, stats_end; // range in stat_lanes/offsets
+    } VectorState;
+
+    static void store_bins(const __m256i& vals, uint16_t* bins) {
+        if (scalar_sz == 1) { // values are their own bins
+            __m128i low = _mm256_castsi256_si128(vals);
+            __m128i high = _mm256_extracti128_si256(vals, 1);
+            _mm256_storeu_si256((__m256i*)bins, _mm256_cvtepu8_epi16(low));
+            _mm256_storeu_si256((__m256i*)(bins + 16),
+                _mm256_cvtepu8_epi16(high));
+            return;
+        }
+        // the float conversion does the log2; shifting out all but the
+        // top 5 mantissa bits leaves (127 + log2(x)) << 5 | mantissa
+        const __m256i offset = _mm256_set1_epi32((127 + 4) << 5);
+        const __m256i small = _mm256_set1_epi32(32);
+        __m256i halves[2] = {
+            _mm256_cvtepu16_epi32(_mm256_castsi256_si128(vals)),
+            _mm256_cvtepu16_epi32(_mm256_extracti128_si256(vals, 1))
+        };
+        for (int i = 0; i < 2; i++) {
+            __m256i x = halves[i];
+            __m256i fbits = _mm256_castps_si256(_mm256_cvtepi32_ps(x));
+            __m256i log_bins = _mm256_sub_epi32(
+                _mm256_srli_epi32(fbits, 23 - 5), offset);
+            __m256i is_small = _mm256_cmpgt_epi32(small, x);
+            halves[i] = _mm256_blendv_epi8(log_bins, x, is_small);
+        }
+        // packus interleaves the 128-bit lanes, so undo that
+        __m256i packed = _mm256_packus_epi32(halves[0], halves[1]);
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)bins, packed);
+    }
+
+    std::vector<uint16_t> cols;
+    std::vector<VectorState> states;
+    std::vector<uint32_t> stat_lanes;
+    std::vector<uint32_t> stat_offsets;
+    std::vector<uint32_t> counts;
+    uint32_t window_nrows;
+};
+
 #undef _INSERT_VECTOR_TYPEDEFS_AND_CONSTS
 
 // } // namespace query
@@ -14,9 +14,11 @@
 #include "util.h"  // for DIV_ROUND_UP
 
 
+// static so that the delta and xff versions don't get merged by the linker
 template<bool Materialize, class IntT, class UintT>
-int64_t call_appropriate_query_func(const IntT* src, UintT* dest,
-    uint16_t ndims, uint32_t ngroups, uint16_t remaining_len, QueryParams qp)
+static int64_t call_appropriate_query_func(const IntT* src, UintT* dest,
+    uint16_t ndims, uint32_t ngroups, uint16_t remaining_len,
+    const QueryParams& qp)
 {
     // ensure that the compiler doesn't optimize everything away
     #define DUMMY_READ_QUERY_RESULT(q)                              \
@@ -30,27 +32,54 @@ int64_t call_appropriate_query_func(const IntT* src, UintT* dest,
             }                                                       \
         } while (0)
 
-    MaxQuery<UintT> qMax(ndims);
-    SumQuery<UintT> qSum(ndims);
-    NoopQuery<UintT> qNoop(ndims);
+    // only decode the columns the query touches (if specified)
+    const uint16_t* which_cols = qp.which_cols.data();
+    uint16_t nwhich_cols = (uint16_t)qp.which_cols.size();
     int64_t ret = -1;
     switch (qp.op) {
     case (REDUCE_MIN): break; // TODO
-    case (REDUCE_MAX):
+    case (REDUCE_MAX): {
+        MaxQuery<UintT> qMax(ndims);
         ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
-            remaining_len, qMax);
+            remaining_len, qMax, which_cols, nwhich_cols);
         DUMMY_READ_QUERY_RESULT(qMax);
         break;
-    case (REDUCE_SUM):
+    }
+    case (REDUCE_SUM): {
+        SumQuery<UintT> qSum(ndims);
         ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
-            remaining_len, qSum);
+            remaining_len, qSum, which_cols, nwhich_cols);
         DUMMY_READ_QUERY_RESULT(qSum);
         break;
-    default:
+    }
+    case (REDUCE_CORR): {
+        CorrQuery<UintT> qCorr(ndims, qp.which_cols, qp.window_nrows);
         ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
-            remaining_len, qNoop);
+            remaining_len, qCorr, which_cols, nwhich_cols);
+        DUMMY_READ_QUERY_RESULT(qCorr);
         break;
     }
+    case (REDUCE_BUCKETS): {
+        BucketQuery<UintT> qBuckets(ndims, qp.which_cols, qp.window_nrows);
+        ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
+            remaining_len, qBuckets, which_cols, nwhich_cols);
+        DUMMY_READ_QUERY_RESULT(qBuckets);
+        break;
+    }
+    case (REDUCE_HISTOGRAM): {
+        HistogramQuery<UintT> qHist(ndims, qp.which_cols, qp.window_nrows);
+        ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
+            remaining_len, qHist, which_cols, nwhich_cols);
+        DUMMY_READ_QUERY_RESULT(qHist);
+        break;
+    }
+    default: {
+        NoopQuery<UintT> qNoop(ndims);
+        ret = query_rowmajor_delta_rle<Materialize>(src, dest, ndims, ngroups,
+            remaining_len, qNoop, which_cols, nwhich_cols);
+        break;
+    }
+    }
 
     #undef DUMMY_READ_QUERY_RESULT
 
@@ -89,3 +118,95 @@ int64_t query_rowmajor_delta_rle_16b(const int16_t* src, uint16_t* dest,
             remaining_len, qp);
     }
 }
+
+// header-only bounds first; these only become exact if they're too loose,
+// since tightening them means decoding everything before them too
+template<class IntT, class UintT>
+static int64_t bounds_query(const IntT* src, UintT* dest,
+    const QueryParams& qp, std::vector<ColumnBounds>& bounds)
+{
+    uint16_t ndims;
+    uint32_t ngroups;
+    uint16_t remaining_len;
+    src += read_metadata_rle(src, &ndims, &ngroups, &remaining_len);
+    int64_t ret = approx_query_rowmajor_delta_rle<IntT, UintT>(src, ndims,
+        ngroups, remaining_len, qp.which_cols, qp.window_nrows, bounds);
+    if (max_bounds_width(bounds) <= qp.max_err) { return ret; }
+
+    BucketQuery<UintT> q(ndims, qp.which_cols, qp.window_nrows);
+    ret = query_rowmajor_delta_rle<false>(src, dest, ndims, ngroups,
+        remaining_len, q, qp.which_cols.data(), (uint16_t)qp.which_cols.size());
+    const auto& buckets = q.result();
+    bounds.resize(buckets.size());
+    for (size_t i = 0; i < buckets.size(); i++) {
+        const auto& b = buckets[i];
+        bounds[i] = ColumnBounds{b.min, b.min, b.max, b.max, b.mean, b.mean};
+    }
+    return ret;
+}
+
+int64_t bounds_query_rowmajor_delta_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qp, std::vector<ColumnBounds>& bounds)
+{
+    return bounds_query(src, dest, qp, bounds);
+}
+int64_t bounds_query_rowmajor_delta_rle_16b(const int16_t* src, uint16_t* dest,
+    const QueryParams& qp, std::vector<ColumnBounds>& bounds)
+{
+    return bounds_query(src, dest, qp, bounds);
+}
+
+// runs a query that needs its results handed back, not just computed
+template<template<class> class QueryT, class IntT, class UintT, class ResultT>
+static int64_t query_with_result(const IntT* src, UintT* dest,
+    const QueryParams& qp, ResultT& result)
+{
+    uint16_t ndims;
+    uint32_t ngroups;
+    uint16_t remaining_len;
+    src += read_metadata_rle(src, &ndims, &ngroups, &remaining_len);
+    QueryT<UintT> q(ndims, qp.which_cols, qp.window_nrows);
+    const uint16_t* which_cols = qp.which_cols.data();
+    uint16_t nwhich_cols = (uint16_t)qp.which_cols.size();
+    int64_t ret;
+    if (qp.materialize) {
+        ret = query_rowmajor_delta_rle<true>(src, dest, ndims, ngroups,
+            remaining_len, q, which_cols, nwhich_cols);
+    } else {
+        ret = query_rowmajor_delta_rle<false>(src, dest, ndims, ngroups,
+            remaining_len, q, which_cols, nwhich_cols);
+    }
+    result = q.result();
+    return ret;
+}
+
+int64_t corr_query_rowmajor_delta_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qp, std::vector<double>& corrs)
+{
+    return query_with_result<CorrQuery>(src, dest, qp, corrs);
+}
+int64_t corr_query_rowmajor_delta_rle_16b(const int16_t* src, uint16_t* dest,
+    const QueryParams& qp, std::vector<double>& corrs)
+{
+    return query_with_result<CorrQuery>(src, dest, qp, corrs);
+}
+int64_t bucket_query_rowmajor_delta_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qp, std::vector<BucketStats>& buckets)
+{
+    return query_with_result<BucketQuery>(src, dest, qp, buckets);
+}
+int64_t bucket_query_rowmajor_delta_rle_16b(const int16_t* src, uint16_t* dest,
+    const QueryParams& qp, std::vector<BucketStats>& buckets)
+{
+    return query_with_result<BucketQuery>(src, dest, qp, buckets);
+}
+int64_t histogram_query_rowmajor_delta_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qp, std::vector<uint32_t>& counts)
+{
+    return query_with_result<HistogramQuery>(src, dest, qp, counts);
+}
+int64_t histogram_query_rowmajor_delta_rle_16b(const int16_t* src,
+    uint16_t* dest, const QueryParams& qp, std::vector<uint32_t>& counts)
+{
+    return query_with_result<HistogramQuery>(src, dest, qp, counts);
+}
@@ -14,6 +14,8 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <algorithm> // for fill
+
 #include "bitpack.h"
 #include "format.h"
 #include "util.h" // for memrep
@@ -33,7 +35,7 @@ static const int kDefaultGroupSzBlocks = 2;
 template<bool DoWrite=false, class int_t, class uint_t, class Func>
 SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
     uint_t* dest, uint16_t ndims, uint32_t ngroups, uint16_t remaining_len,
-    Func& func)
+    Func& func, const uint16_t* which_cols=nullptr, uint16_t nwhich_cols=0)
 {
     CHECK_INT_UINT_TYPES_VALID(int_t, uint_t);
     static const uint8_t elem_sz = sizeof(uint_t);
@@ -142,6 +144,17 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
     int_t* deltas = (int_t*)calloc(block_sz * padded_ndims, elem_sz);
     uint_t* prev_vals_ar = (uint_t*)calloc(padded_ndims, elem_sz);
 
+    // column projection; stripes and vectors that contain none of the
+    // queried columns are never unpacked, decoded, or stored. This is fine
+    // since predictor state is per column, so stale state in columns we
+    // never emit can't affect the columns we do
+    uint32_t nstripes_in_padded_ndims = nvectors * (vector_sz / stripe_sz);
+    uint8_t* stripe_needed = (uint8_t*)calloc(
+        nstripes_in_padded_ndims + nvectors, 1);
+    uint8_t* vector_needed = stripe_needed + nstripes_in_padded_ndims;
+    mark_needed_stripes(which_cols, nwhich_cols, ndims, stripe_sz, vector_sz,
+        stripe_needed, vector_needed);
+
     // ================================ main loop
 
     for (uint64_t g = 0; g < ngroups; g++) {
@@ -270,6 +283,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
                 if (g > 0 || b > 0) { // if not at very beginning of data
                     const uint_t* inptr = dest - ndims;
                     for (int32_t v = nvectors - 1; v >= 0; v--) {
+                        if (!vector_needed[v]) { continue; }
                         uint32_t vstripe_start = v * vector_sz;
                         __m256i prev_vals = _mm256_loadu_si256((const __m256i*)
                             (prev_vals_ar + vstripe_start));
@@ -283,6 +297,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
                     uint32_t num_zeros = ncopies * ndims;
                     __m256i prev_vals = _mm256_setzero_si256();
                     for (int32_t v = nvectors - 1; v >= 0; v--) {
+                        if (!vector_needed[v]) { continue; }
                         func(v, prev_vals, prev_vals, ncopies);
                     }
                     memset(dest, 0, num_zeros * elem_sz); // TODO mul by elem_sz is right ?
@@ -303,6 +318,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
             // ------------------------ unpack data for each stripe
             // for (uint32_t stripe = 0; stripe < nstripes; stripe++) {
             for (int stripe = nstripes - 1; stripe >= 0; stripe--) {
+                if (!stripe_needed[stripe]) { continue; }
                 uint32_t offset_bits = stripe_bitoffsets[stripe] & 0x07;
                 uint32_t offset_bytes = stripe_bitoffsets[stripe] >> 3;
 
@@ -335,6 +351,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
 
             // zigzag + delta decode
             for (int32_t v = nvectors - 1; v >= 0; v--) {
+                if (!vector_needed[v]) { continue; }
                 uint32_t vstripe_start = v * vector_sz;
                 __m256i prev_vals = _mm256_loadu_si256((const __m256i*)
                     (prev_vals_ar + vstripe_start));
@@ -384,6 +401,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
     free(data_masks);
     free(stripe_bitwidths);
     free(stripe_bitoffsets);
+    free(stripe_needed);
     free(deltas);
     free(prev_vals_ar);
 
@@ -409,6 +427,323 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle(const int_t* src,
     return dest + remaining_len - orig_dest;
 }
 
+// where each queried column's value can be, given only the bitwidths of the
+// deltas that led to it, along with the min, max, and sum of these bounds
+// over the current window. Bounds are unwrapped, so once they leave the
+// range of the data type, the value could have wrapped around to anything.
+// Besides exact rows, lo only ever goes down and hi only ever goes up, so
+// the min and max of each bound within a window are at its first or last
+// row; blocks only have to update the current bounds and the sums. Columns
+// are padded to a multiple of 8 so we can update 8 at a time.
+template<class uint_t>
+class DeltaBoundsState {
+public:
+    static const int32_t kMaxVal = (int32_t)((uint_t)-1);
+
+    explicit DeltaBoundsState(uint32_t nstats):
+        nstats(nstats),
+        padded_nstats(round_up_to_multiple(nstats, 8)),
+        lo(padded_nstats), hi(padded_nstats),
+        min_lo(padded_nstats), min_hi(padded_nstats),
+        max_lo(padded_nstats), max_hi(padded_nstats),
+        sum_lo(padded_nstats), sum_hi(padded_nstats)
+    {
+        reset_window();
+    }
+
+    // n rows whose deltas fit in nbits[j] bits after zigzag encoding, or
+    // are all zero if nbits is null. Such deltas are within
+    // [-2^(nbits-1), 2^(nbits-1) - 1], so the kth row is within
+    // [lo - k * 2^(nbits-1), hi + k * (2^(nbits-1) - 1)]. Columns that
+    // might wrap get the whole range for all n rows, which is looser than
+    // it has to be for the first few, but never wrong. Products with
+    // powers of two are shifts.
+    void add_rows(uint64_t n, const uint8_t* nbits, bool starts_window) {
+        if (!nbits) { add_constant_rows(n, starts_window); return; }
+        const __m256i zeros = _mm256_setzero_si256();
+        const __m256i ones = _mm256_set1_epi32(1);
+        const __m256i maxval = _mm256_set1_epi32(kMaxVal);
+        const __m256i vn = _mm256_set1_epi32((int32_t)n); // n <= block_sz
+        const __m256i vtri = _mm256_set1_epi32((int32_t)(n * (n + 1) / 2));
+        const __m256i n_maxval = _mm256_set1_epi32((int32_t)n * kMaxVal);
+        for (uint32_t j = 0; j < padded_nstats; j += 8) {
+            __m256i vnbits = _mm256_cvtepu8_epi32(
+                _mm_loadl_epi64((const __m128i*)(nbits + j)));
+            // k * 2^(nbits-1) and k * (2^(nbits-1) - 1), for k = n, tri
+            __m256i n_down = _mm256_srli_epi32(_mm256_sllv_epi32(vn, vnbits), 1);
+            __m256i tri_down = _mm256_srli_epi32(_mm256_sllv_epi32(vtri, vnbits), 1);
+            __m256i n_up = _mm256_max_epi32(_mm256_sub_epi32(n_down, vn), zeros);
+            __m256i tri_up = _mm256_max_epi32(_mm256_sub_epi32(tri_down, vtri), zeros);
+
+            __m256i vlo = _mm256_loadu_si256((const __m256i*)(lo.data() + j));
+            __m256i vhi = _mm256_loadu_si256((const __m256i*)(hi.data() + j));
+            __m256i end_lo = _mm256_sub_epi32(vlo, n_down);
+            __m256i end_hi = _mm256_add_epi32(vhi, n_up);
+            __m256i wraps = _mm256_or_si256(_mm256_cmpgt_epi32(zeros, end_lo),
+                _mm256_cmpgt_epi32(end_hi, maxval));
+            end_lo = _mm256_andnot_si256(wraps, end_lo);
+            end_hi = _mm256_blendv_epi8(end_hi, maxval, wraps);
+
+            if (starts_window) {
+                __m256i down = _mm256_srli_epi32(_mm256_sllv_epi32(ones, vnbits), 1);
+                __m256i up = _mm256_max_epi32(_mm256_sub_epi32(down, ones), zeros);
+                __m256i first_lo = _mm256_andnot_si256(wraps,
+                    _mm256_sub_epi32(vlo, down));
+                __m256i first_hi = _mm256_blendv_epi8(
+                    _mm256_add_epi32(vhi, up), maxval, wraps);
+                update_min_max(j, first_lo, first_hi);
+            }
+            // n <= 8, so these fit in 32 bits
+            __m256i sum_lo_delta = _mm256_sub_epi32(
+                _mm256_mullo_epi32(vn, vlo), tri_down);
+            __m256i sum_hi_delta = _mm256_add_epi32(
+                _mm256_mullo_epi32(vn, vhi), tri_up);
+            add_sum(sum_lo, j, _mm256_andnot_si256(wraps, sum_lo_delta));
+            add_sum(sum_hi, j, _mm256_blendv_epi8(sum_hi_delta, n_maxval, wraps));
+            _mm256_storeu_si256((__m256i*)(lo.data() + j), end_lo);
+            _mm256_storeu_si256((__m256i*)(hi.data() + j), end_hi);
+        }
+    }
+
+    // a row whose values we decoded exactly
+    void add_exact_row(const int32_t* vals) {
+        memcpy(lo.data(), vals, nstats * sizeof(vals[0]));
+        memcpy(hi.data(), vals, nstats * sizeof(vals[0]));
+        add_constant_rows(1, true);
+    }
+    int32_t value(uint32_t j) const { return lo[j]; } // only if exact
+
+    void append_window(uint64_t nrows, std::vector<ColumnBounds>& out) {
+        for (uint32_t j = 0; j < nstats; j++) {
+            out.push_back(ColumnBounds{MIN(min_lo[j], lo[j]), min_hi[j],
+                max_lo[j], MAX(max_hi[j], hi[j]),
+                (double)sum_lo[j] / nrows, (double)sum_hi[j] / nrows});
+        }
+        reset_window();
+    }
+
+private:
+    // n copies of the previous row; runs can be long, so the sums need
+    // 64-bit products
+    void add_constant_rows(uint64_t n, bool starts_window) {
+        const __m256i vn64 = _mm256_set1_epi64x(n);
+        for (uint32_t j = 0; j < padded_nstats; j += 8) {
+            __m256i vlo = _mm256_loadu_si256((const __m256i*)(lo.data() + j));
+            __m256i vhi = _mm256_loadu_si256((const __m256i*)(hi.data() + j));
+            if (starts_window) { update_min_max(j, vlo, vhi); }
+            add_sum(sum_lo, j, vlo, vn64);
+            add_sum(sum_hi, j, vhi, vn64);
+        }
+    }
+    void update_min_max(uint32_t j, __m256i row_lo, __m256i row_hi) {
+        __m256i* min_lo_ptr = (__m256i*)(min_lo.data() + j);
+        __m256i* min_hi_ptr = (__m256i*)(min_hi.data() + j);
+        __m256i* max_lo_ptr = (__m256i*)(max_lo.data() + j);
+        __m256i* max_hi_ptr = (__m256i*)(max_hi.data() + j);
+        _mm256_storeu_si256(min_lo_ptr, _mm256_min_epi32(
+            _mm256_loadu_si256(min_lo_ptr), row_lo));
+        _mm256_storeu_si256(min_hi_ptr, _mm256_min_epi32(
+            _mm256_loadu_si256(min_hi_ptr), row_hi));
+        _mm256_storeu_si256(max_lo_ptr, _mm256_max_epi32(
+            _mm256_loadu_si256(max_lo_ptr), row_lo));
+        _mm256_storeu_si256(max_hi_ptr, _mm256_max_epi32(
+            _mm256_loadu_si256(max_hi_ptr), row_hi));
+    }
+    void reset_window() {
+        std::fill(min_lo.begin(), min_lo.end(), kMaxVal);
+        std::fill(min_hi.begin(), min_hi.end(), kMaxVal);
+        std::fill(max_lo.begin(), max_lo.end(), 0);
+        std::fill(max_hi.begin(), max_hi.end(), 0);
+        std::fill(sum_lo.begin(), sum_lo.end(), 0);
+        std::fill(sum_hi.begin(), sum_hi.end(), 0);
+    }
+    // sums[j:j+8] += x
+    static void add_sum(std::vector<int64_t>& sums, uint32_t j, __m256i x) {
+        __m256i* ptr0 = (__m256i*)(sums.data() + j);
+        __m256i* ptr1 = (__m256i*)(sums.data() + j + 4);
+        __m256i x0 = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x));
+        __m256i x1 = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1));
+        _mm256_storeu_si256(ptr0, _mm256_add_epi64(_mm256_loadu_si256(ptr0), x0));
+        _mm256_storeu_si256(ptr1, _mm256_add_epi64(_mm256_loadu_si256(ptr1), x1));
+    }
+    // sums[j:j+8] += n * x, for x >= 0
+    static void add_sum(std::vector<int64_t>& sums, uint32_t j, __m256i x,
+        __m256i vn64)
+    {
+        __m256i* ptr0 = (__m256i*)(sums.data() + j);
+        __m256i* ptr1 = (__m256i*)(sums.data() + j + 4);
+        __m256i x0 = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(x));
+        __m256i x1 = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(x, 1));
+        _mm256_storeu_si256(ptr0, _mm256_add_epi64(_mm256_loadu_si256(ptr0),
+            _mm256_mul_epu32(x0, vn64)));
+        _mm256_storeu_si256(ptr1, _mm256_add_epi64(_mm256_loadu_si256(ptr1),
+            _mm256_mul_epu32(x1, vn64)));
+    }
+
+    uint32_t nstats;
+    uint32_t padded_nstats;
+    std::vector<int32_t> lo, hi;    // current row
+    std::vector<int32_t> min_lo, min_hi, max_lo, max_hi; // see above
+    std::vector<int64_t> sum_lo, sum_hi;
+};
+
+// bounds on the min, max, and mean of each column in which_cols (or all
+// columns) within each window of window_nrows rows (or all rows, if
+// window_nrows is 0), using almost nothing but the group headers and run
+// lengths. The format has no anchors besides the implicit zeros before the
+// first row, and the first deltas are as wide as the values themselves, so
+// we decode the queried columns of the first non-run block exactly; after
+// that, packed deltas are skipped without being read. Values drift by at
+// most half the range of each block's deltas per row, so the bounds get
+// looser the further we get into the buffer, and anything that could have
+// wrapped around is only bounded by the range of the type. Like the
+// pushdown queries, this ignores the trailing raw elements.
+template<class int_t, class uint_t>
+int64_t approx_query_rowmajor_delta_rle(const int_t* src, uint16_t ndims,
+    uint32_t ngroups, uint16_t remaining_len,
+    const std::vector<uint16_t>& which_cols, uint32_t window_nrows,
+    std::vector<ColumnBounds>& bounds)
+{
+    CHECK_INT_UINT_TYPES_VALID(int_t, uint_t);
+    static const uint8_t elem_sz = sizeof(uint_t);
+    static const uint8_t elem_sz_nbits = 8 * elem_sz;
+    static const uint8_t nbits_sz_bits = elem_sz == 1 ? 3 : 4; // XXX {8,16}b
+    static const uint8_t block_sz = 8;
+    static const uint8_t group_sz_blocks = kDefaultGroupSzBlocks;
+    static const int group_sz_per_dim = block_sz * group_sz_blocks;
+    static const uint8_t nbits_sz_mask = (1 << nbits_sz_bits) - 1;
+    static const uint64_t kHeaderUnpackMask = TILE_BYTE(nbits_sz_mask);
+    static const uint64_t kMaxNbitsBytes = TILE_BYTE(elem_sz_nbits - 1);
+    static const uint64_t kLowBitsBytes = TILE_BYTE(0x7f);
+    static const uint64_t kHighBitBytes = TILE_BYTE(0x80);
+    static const uint32_t min_data_size = 8 * block_sz * group_sz_blocks;
+
+    bounds.clear();
+    bool just_cpy = (ngroups == 0) && remaining_len < min_data_size;
+    if (just_cpy) { return remaining_len; }
+    if (ndims == 0) {
+        perror("ERROR: Received ndims of 0!");
+        return 0;
+    }
+
+    std::vector<uint16_t> cols;
+    for (auto col : which_cols) {
+        if (col < ndims) { cols.push_back(col); }
+    }
+    bool all_cols = which_cols.size() == 0;
+    if (all_cols) {
+        for (uint16_t j = 0; j < ndims; j++) { cols.push_back(j); }
+    }
+    uint32_t nstats = (uint32_t)cols.size();
+    uint32_t total_header_bytes = DIV_ROUND_UP(
+        ndims * nbits_sz_bits * group_sz_blocks, 8);
+
+    DeltaBoundsState<uint_t> state(nstats);
+    std::vector<uint8_t> dim_nbits(round_up_to_multiple(ndims, 8));
+    std::vector<uint8_t> col_nbits(round_up_to_multiple(nstats, 8));
+    const uint8_t* nbits = all_cols ? dim_nbits.data() : col_nbits.data();
+    uint64_t nrows_in_window = 0;
+    bool anchored = false;
+
+    // n rows, all with the current nbits (or none, if is_run); window
+    // boundaries can fall anywhere
+    auto add_rows = [&](uint64_t n, bool is_run) {
+        while (n > 0) {
+            uint64_t nrows = n;
+            if (window_nrows > 0) {
+                nrows = MIN(nrows, window_nrows - nrows_in_window);
+            }
+            state.add_rows(nrows, is_run ? nullptr : nbits,
+                nrows_in_window == 0);
+            n -= nrows;
+            nrows_in_window += nrows;
+            if (window_nrows > 0 && nrows_in_window == window_nrows) {
+                state.append_window(nrows_in_window, bounds);
+                nrows_in_window = 0;
+            }
+        }
+    };
+    // each row's deltas are packed back to back in column order, starting
+    // at a byte boundary
+    auto add_exact_rows = [&](const int8_t* packed, uint32_t in_row_nbytes) {
+        std::vector<uint32_t> dim_bitoffsets(ndims);
+        for (uint32_t j = 1; j < ndims; j++) {
+            dim_bitoffsets[j] = dim_bitoffsets[j - 1] + dim_nbits[j - 1];
+        }
+        std::vector<int32_t> vals(nstats);
+        for (uint32_t i = 0; i < block_sz; i++) {
+            const uint8_t* row = (const uint8_t*)(packed + i * in_row_nbytes);
+            for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+                uint32_t offset = dim_bitoffsets[cols[j_idx]];
+                uint32_t mask = (((uint32_t)1) << nbits[j_idx]) - 1;
+                uint32_t raw = *(const uint32_t*)(row + offset / 8);
+                uint_t zigzag = (uint_t)((raw >> (offset % 8)) & mask);
+                uint_t delta = (zigzag >> 1) ^ (uint_t)(-(zigzag & 1));
+                vals[j_idx] = (uint_t)(state.value(j_idx) + delta);
+            }
+            state.add_exact_row(vals.data());
+            nrows_in_window++;
+            if (window_nrows > 0 && nrows_in_window == window_nrows) {
+                state.append_window(nrows_in_window, bounds);
+                nrows_in_window = 0;
+            }
+        }
+    };
+
+    for (uint64_t g = 0; g < ngroups; g++) {
+        const uint8_t* header_src = (const uint8_t*)src;
+        const int8_t* src8 = ((const int8_t*)src) + total_header_bytes;
+
+        for (int b = 0; b < group_sz_blocks; b++) {
+            // unpack 8 dims' nbits at a time, mapping the stored 7 (or 15)
+            // to 8 (or 16) bits, and add them up to get the row width
+            uint32_t in_row_nbits = 0;
+            for (uint32_t j = 0; j < ndims; j += 8) {
+                uint32_t bit_offset = (b * ndims + j) * nbits_sz_bits;
+                uint64_t packed = (*(const uint64_t*)(
+                    header_src + bit_offset / 8)) >> (bit_offset % 8);
+                uint64_t dims_nbits = _pdep_u64(packed, kHeaderUnpackMask);
+                if (j + 8 > ndims) {
+                    dims_nbits &= (((uint64_t)1) << (8 * (ndims - j))) - 1;
+                }
+                uint64_t diffs = dims_nbits ^ kMaxNbitsBytes;
+                uint64_t nonzeros = ((diffs & kLowBitsBytes) + kLowBitsBytes) | diffs;
+                dims_nbits += (~nonzeros & kHighBitBytes) >> 7;
+                *(uint64_t*)(dim_nbits.data() + j) = dims_nbits;
+                in_row_nbits += (dims_nbits * TILE_BYTE(1)) >> 56;
+            }
+            if (in_row_nbits == 0) {
+                int8_t low_byte = *src8;
+                uint8_t high_byte = (uint8_t)*(src8 + 1);
+                high_byte = high_byte & (low_byte >> 7); // 0 if low msb == 0
+                uint16_t length = (low_byte & 0x7f) | (((uint16_t)high_byte) << 7);
+                add_rows(length * block_sz, true);
+                src8++;
+                src8 += (high_byte > 0); // if 0, wasn't used for run length
+                continue;
+            }
+            if (!all_cols) {
+                for (uint32_t j_idx = 0; j_idx < nstats; j_idx++) {
+                    col_nbits[j_idx] = dim_nbits[cols[j_idx]];
+                }
+            }
+            uint32_t in_row_nbytes = DIV_ROUND_UP(in_row_nbits, 8);
+            if (anchored) {
+                add_rows(block_sz, false);
+            } else {
+                add_exact_rows(src8, in_row_nbytes);
+                anchored = true;
+            }
+            src8 += block_sz * in_row_nbytes;
+        }
+        src = (const int_t*)src8;
+    }
+    if (nrows_in_window > 0) {
+        state.append_window(nrows_in_window, bounds);
+    }
+    return (int64_t)ngroups * group_sz_per_dim * ndims + remaining_len;
+}
+
 // template<typename QueryT>
 // SPRINTZ_FORCE_INLINE int64_t query_rowmajor_delta_rle_8b(const int8_t* src,
 //     uint8_t* dest, uint16_t ndims, uint32_t ngroups, uint16_t remaining_len,
@@ -92,4 +92,27 @@ int64_t query_rowmajor_xff_rle_8b(const int8_t* src, uint8_t* dest,
 int64_t query_rowmajor_xff_rle_16b(const int16_t* src, uint16_t* dest,
     const QueryParams& qparams);
 
+// correlation matrix of the columns in each complete window of
+// qparams.window_nrows rows (or over all rows), computed while decoding;
+// see CorrQuery for the layout
+int64_t corr_query_rowmajor_xff_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qparams, std::vector<double>& corrs);
+int64_t corr_query_rowmajor_xff_rle_16b(const int16_t* src, uint16_t* dest,
+    const QueryParams& qparams, std::vector<double>& corrs);
+
+// min, max, and mean of each column in each bucket of qparams.window_nrows
+// rows, computed while decoding; writes the decoded data to dest only if
+// qparams.materialize is set
+int64_t bucket_query_rowmajor_xff_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qparams, std::vector<BucketStats>& buckets);
+int64_t bucket_query_rowmajor_xff_rle_16b(const int16_t* src, uint16_t* dest,
+    const QueryParams& qparams, std::vector<BucketStats>& buckets);
+
+// histogram of each column in each window of qparams.window_nrows rows,
+// computed while decoding; see HistogramQuery for the layout and bins
+int64_t histogram_query_rowmajor_xff_rle_8b(const int8_t* src, uint8_t* dest,
+    const QueryParams& qparams, std::vector<uint32_t>& counts);
+int64_t histogram_query_rowmajor_xff_rle_16b(const int16_t* src,
+    uint16_t* dest, const QueryParams& qparams, std::vector<uint32_t>& counts);
+
 #endif
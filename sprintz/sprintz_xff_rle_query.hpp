@@ -31,7 +31,7 @@ template<bool DoWrite=true, class int_t=void, class uint_t=void,
     class Func=void>
 SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
     uint_t* dest, uint16_t ndims, uint32_t ngroups, uint16_t remaining_len,
-    Func& func)
+    Func& func, const uint16_t* which_cols=nullptr, uint16_t nwhich_cols=0)
 {
     CHECK_INT_UINT_TYPES_VALID(int_t, uint_t);
     static const uint8_t elem_sz = sizeof(uint_t);
@@ -153,6 +153,17 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
     if (debug) printf("padded ndims: %d\n", padded_ndims);
 
+    // column projection; stripes and vectors that contain none of the
+    // queried columns are never unpacked, decoded, or stored. This is fine
+    // since predictor state is per column, so stale state in columns we
+    // never emit can't affect the columns we do
+    uint32_t nstripes_in_padded_ndims = nvectors * (vector_sz / stripe_sz);
+    uint8_t* stripe_needed = (uint8_t*)calloc(
+        nstripes_in_padded_ndims + nvectors, 1);
+    uint8_t* vector_needed = stripe_needed + nstripes_in_padded_ndims;
+    mark_needed_stripes(which_cols, nwhich_cols, ndims, stripe_sz, vector_sz,
+        stripe_needed, vector_needed);
+
     // ================================ main loop
 
     // uint64_t ngroups = orig_len / group_sz; // if we get an fp error, it's this
@@ -302,6 +313,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
                     for (int32_t bb = 0; bb < length; bb++) {
                         for (int32_t v = nvectors - 1; v >= 0; v--) {
+                            if (!vector_needed[v]) { continue; }
                             uint32_t v_offset = v * vector_sz;
                             __m256i* prev_vals_ptr = (__m256i*)(prev_vals_ar + v_offset);
                             __m256i* prev_deltas_ptr = (__m256i*)(prev_deltas_ar + v_offset);
@@ -372,7 +384,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
                                     __m256i vpredictions = _mm256_mulhi_epi16(
                                         prev_deltas, filter_coeffs);
-                                    vpredictions = _mm256_slli_epi16(vpredictions, 2);
+                                    // vpredictions = _mm256_slli_epi16(vpredictions, 2);
 
                                     __m256i vdeltas = vpredictions; // since err of 0
                                     __m256i vals = _mm256_add_epi16(vdeltas, prev_vals);
@@ -412,6 +424,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
                     size_t num_zeros = ncopies * ndims;
                     __m256i prev_vals = _mm256_setzero_si256();
                     for (int32_t v = nvectors - 1; v >= 0; v--) {
+                        if (!vector_needed[v]) { continue; }
                         func(v, prev_vals, prev_vals, ncopies);
                     }
                     if (DoWrite) {
@@ -436,6 +449,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
             // ------------------------ unpack data for each stripe
             for (int stripe = nstripes - 1; stripe >= 0; stripe--) {
+                if (!stripe_needed[stripe]) { continue; }
                 uint32_t offset_bits = stripe_bitoffsets[stripe] & 0x07;
                 uint32_t offset_bytes = stripe_bitoffsets[stripe] >> 3;
 
@@ -468,6 +482,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
             // ------------------------ zigzag + xff decode
             for (int32_t v = nvectors - 1; v >= 0; v--) {
+                if (!vector_needed[v]) { continue; }
                 uint32_t v_offset = v * vector_sz;
                 __m256i* prev_vals_ptr = (__m256i*)(prev_vals_ar + v_offset);
                 __m256i* prev_deltas_ptr = (__m256i*)(prev_deltas_ar + v_offset);
@@ -569,7 +584,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
 
                         __m256i vpredictions = _mm256_mulhi_epi16(
                             prev_deltas, filter_coeffs);
-                        vpredictions = _mm256_slli_epi16(vpredictions, 2);
+                        // vpredictions = _mm256_slli_epi16(vpredictions, 2);
 
                         // zigzag decode
                         __m256i verrs = mm256_zigzag_decode_epi16(raw_verrs);
@@ -646,6 +661,7 @@ SPRINTZ_FORCE_INLINE int64_t query_rowmajor_xff_rle(const int_t* src,
     free(data_masks);
     free(stripe_bitwidths);
     free(stripe_bitoffsets);
+    free(stripe_needed);
     free(errs_ar);
     free(coeffs_ar_even);
 
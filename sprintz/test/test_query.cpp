@@ -6,9 +6,14 @@
 //  Copyright © 2018 D Blalock. All rights reserved.
 //
 
+#include "format.h" // read_metadata_rle
 #include "sprintz_delta.h"
 #include "sprintz_xff.h"
 
+#include <cmath> // std::abs
+#include <limits>
+#include <string.h> // memcmp
+
 #include "catch.hpp"
 #include "compress_testing.hpp"
 #include "testing_utils.hpp"
@@ -54,6 +59,410 @@ void test_query(QueryParams qp, CompF&& f_comp, DecompF&& f_decomp)
     }
 }
 
+// only checks the columns in qp.which_cols, since the decoder is free to
+// leave the other ones unwritten
+template<int ElemSz, class CompF, class DecompF>
+void test_query_projection(QueryParams qp, CompF&& f_comp, DecompF&& f_decomp)
+{
+    vector<uint32_t> sizes {1, 17, 64, 127, 136, 1000, 4096, 4096 + 17};
+    vector<uint16_t> ndims_list {1, 2, 3, 7, 8, 16, 17, 31, 32, 33, 40, 80};
+
+    using traits = elemsize_traits<ElemSz>;
+    using UVec = typename traits::uvec_t;
+    using IVec = typename traits::ivec_t;
+    auto sz = sizes[sizes.size() - 1]; // assumes last size is largest
+    IVec compressed(sz * 3/2 + 64);
+    uint16_t decomp_padding = 64;
+    UVec decompressed(sz + decomp_padding);
+
+    qp.materialize = true;
+    for (auto sz : sizes) {
+        CAPTURE(sz);
+        for (auto ndims : ndims_list) {
+            CAPTURE(ndims);
+            // random data, but with some constant stretches so that we
+            // also hit the rle codepath
+            UVec raw(sz);
+            srand(123);
+            raw.setRandom();
+            for (uint32_t i = ndims; i < sz; i++) {
+                if ((i / ndims / 8) % 3 == 0) { raw(i) = raw(i - ndims); }
+            }
+            qp.which_cols.clear();
+            qp.which_cols.push_back(ndims - 1);
+            if (ndims > 2) { qp.which_cols.push_back(ndims / 2); }
+            if (ndims > 32) { qp.which_cols.push_back(1); }
+
+            compressed.setZero();
+            decompressed.setZero();
+            f_comp(raw.data(), sz, compressed.data(), ndims);
+            f_decomp(compressed.data(), decompressed.data(), qp);
+
+            for (auto col : qp.which_cols) {
+                CAPTURE(col);
+                for (uint32_t i = col; i < sz; i += ndims) {
+                    CAPTURE(i);
+                    REQUIRE(decompressed(i) == raw(i));
+                }
+            }
+        }
+    }
+}
+
+// data shared by the windowed query tests below: random rows with constant
+// stretches to hit the rle codepath, compressed with f_comp. fill(raw, i,
+// ndims) may overwrite each value outside the stretches, in order. When
+// there are enough cols, only a few of them are queried. Rows in the
+// trailing partial group are never passed to the query, so the expected
+// values should only look at the first nrows_queried rows.
+template<int ElemSz>
+struct QueryTestData {
+    using traits = elemsize_traits<ElemSz>;
+    typename traits::uvec_t raw;
+    typename traits::ivec_t compressed;
+    typename traits::uvec_t decompressed;
+    uint16_t ndims;
+    uint32_t nrows_queried;
+    QueryParams qp;             // which_cols set; the rest is up to the test
+    vector<uint16_t> cols;      // qp.which_cols, or all cols if it's empty
+};
+
+template<int ElemSz, class CompF, class FillF, class TestF>
+void for_each_query_test_data(CompF&& f_comp, FillF&& fill, TestF&& f_test) {
+    vector<uint32_t> nrows_list {16, 64, 160, 1000};
+    vector<uint16_t> ndims_list {1, 2, 3, 8, 17, 33};
+
+    for (auto nrows : nrows_list) {
+        CAPTURE(nrows);
+        for (auto ndims : ndims_list) {
+            CAPTURE(ndims);
+            uint32_t sz = nrows * ndims;
+            QueryTestData<ElemSz> data;
+            data.ndims = ndims;
+            data.raw.resize(sz);
+            srand(123);
+            data.raw.setRandom();
+            for (uint32_t i = 0; i < sz; i++) {
+                if (i >= ndims && (i / ndims / 16) % 3 == 0) {
+                    data.raw(i) = data.raw(i - ndims);
+                } else {
+                    fill(data.raw, i, ndims);
+                }
+            }
+            data.compressed.resize(sz * 3/2 + 64);
+            data.decompressed.resize(sz + 64);
+            f_comp(data.raw.data(), sz, data.compressed.data(), ndims);
+
+            uint16_t _ndims;
+            uint32_t ngroups;
+            uint16_t remaining_len;
+            read_metadata_rle(data.compressed.data(), &_ndims, &ngroups,
+                &remaining_len);
+            data.nrows_queried = (sz - remaining_len) / ndims;
+
+            if (ndims > 8) { data.qp.which_cols = {(uint16_t)(ndims - 1), 0, 5}; }
+            data.cols = data.qp.which_cols;
+            for (uint16_t j = 0; data.qp.which_cols.size() == 0 && j < ndims; j++) {
+                data.cols.push_back(j);
+            }
+            f_test(data);
+        }
+    }
+}
+
+// checks each correlation matrix the query computes against a two-pass
+// computation on the raw data
+template<int ElemSz, class CompF, class QueryF>
+void test_corr_query(CompF&& f_comp, QueryF&& f_query, uint32_t window_nrows)
+{
+    using traits = elemsize_traits<ElemSz>;
+    using uint_t = typename traits::uint_t;
+    using UVec = typename traits::uvec_t;
+
+    // make the first col correlated with the last one
+    auto fill = [](UVec& raw, uint32_t i, uint16_t ndims) {
+        if (i % ndims == 0) { raw(i) = raw(i + ndims - 1) / 2; }
+    };
+    for_each_query_test_data<ElemSz>(f_comp, fill,
+        [&f_query, window_nrows](QueryTestData<ElemSz>& data)
+    {
+        QueryParams& qp = data.qp;
+        const auto& cols = data.cols;
+        uint16_t ndims = data.ndims;
+        qp.materialize = false;
+        qp.window_nrows = window_nrows;
+        vector<double> corrs;
+        f_query(data.compressed.data(), data.decompressed.data(), qp, corrs);
+
+        uint32_t nrows_queried = data.nrows_queried;
+        uint32_t window = window_nrows > 0 ? window_nrows : nrows_queried;
+        uint32_t nwindows = window > 0 ? nrows_queried / window : 0;
+        if (window_nrows == 0) { nwindows = 1; }
+        uint32_t d = (uint32_t)cols.size();
+        REQUIRE(corrs.size() == nwindows * d * d);
+
+        for (uint32_t w = 0; w < nwindows; w++) {
+            CAPTURE(w);
+            const uint_t* rows = data.raw.data() + w * window * ndims;
+            vector<double> means(d);
+            for (uint32_t j = 0; j < d; j++) {
+                for (uint32_t i = 0; i < window; i++) {
+                    means[j] += rows[i * ndims + cols[j]];
+                }
+                means[j] /= window;
+            }
+            for (uint32_t j = 0; j < d; j++) {
+                for (uint32_t k = 0; k < d; k++) {
+                    CAPTURE(j);
+                    CAPTURE(k);
+                    double cov = 0, var_j = 0, var_k = 0;
+                    for (uint32_t i = 0; i < window; i++) {
+                        double diff_j = rows[i * ndims + cols[j]] - means[j];
+                        double diff_k = rows[i * ndims + cols[k]] - means[k];
+                        cov += diff_j * diff_k;
+                        var_j += diff_j * diff_j;
+                        var_k += diff_k * diff_k;
+                    }
+                    double corr = corrs[(w * d + j) * d + k];
+                    if (var_j == 0 || var_k == 0) {
+                        // std::isnan can be folded to false under
+                        // -ffast-math, so compare the bits instead
+                        double nan = std::numeric_limits<double>::quiet_NaN();
+                        REQUIRE(memcmp(&corr, &nan, sizeof(nan)) == 0);
+                    } else {
+                        REQUIRE(corr == Approx(cov / sqrt(var_j * var_k)));
+                    }
+                }
+            }
+        }
+    });
+}
+
+// checks that the header-only bounds contain the true min, max, and mean of
+// each column in each window, and that they're exact when max_err is 0
+template<int ElemSz, class CompF, class QueryF>
+void test_bounds_query(CompF&& f_comp, QueryF&& f_query,
+    uint32_t window_nrows)
+{
+    using traits = elemsize_traits<ElemSz>;
+    using uint_t = typename traits::uint_t;
+    using UVec = typename traits::uvec_t;
+
+    // random walks from mid-range, so the deltas are narrow and the bounds
+    // take a while to hit the ends of the range
+    auto fill = [](UVec& raw, uint32_t i, uint16_t ndims) {
+        if (i < ndims) {
+            raw(i) = (uint_t)((((uint_t)-1) / 2) + (rand() % 8));
+        } else {
+            raw(i) = (uint_t)(raw(i - ndims) + (rand() % 3) - 1);
+        }
+    };
+    for_each_query_test_data<ElemSz>(f_comp, fill,
+        [&f_query, window_nrows](QueryTestData<ElemSz>& data)
+    {
+        QueryParams& qp = data.qp;
+        const auto& cols = data.cols;
+        uint16_t ndims = data.ndims;
+        qp.window_nrows = window_nrows;
+        uint32_t d = (uint32_t)cols.size();
+
+        uint32_t nrows_queried = data.nrows_queried;
+        uint32_t window = window_nrows > 0 ? window_nrows : nrows_queried;
+        uint32_t nwindows = window > 0 ? DIV_ROUND_UP(nrows_queried, window) : 0;
+
+        for (double max_err : {1e30, 0.}) {
+            CAPTURE(max_err);
+            qp.max_err = max_err;
+            vector<ColumnBounds> bounds;
+            f_query(data.compressed.data(), data.decompressed.data(), qp,
+                bounds);
+            REQUIRE(bounds.size() == nwindows * d);
+            REQUIRE(max_bounds_width(bounds) <= max_err);
+
+            for (uint32_t w = 0; w < nwindows; w++) {
+                CAPTURE(w);
+                uint32_t start_row = w * window;
+                uint32_t end_row = MIN(start_row + window, nrows_queried);
+                for (uint32_t j = 0; j < d; j++) {
+                    CAPTURE(j);
+                    int64_t min_val = data.raw(start_row * ndims + cols[j]);
+                    int64_t max_val = min_val;
+                    double sum = 0;
+                    for (uint32_t i = start_row; i < end_row; i++) {
+                        int64_t val = data.raw(i * ndims + cols[j]);
+                        min_val = MIN(min_val, val);
+                        max_val = MAX(max_val, val);
+                        sum += val;
+                    }
+                    double mean = sum / (end_row - start_row);
+                    auto b = bounds[w * d + j];
+                    REQUIRE(b.min_lo <= min_val);
+                    REQUIRE(min_val <= b.min_hi);
+                    REQUIRE(b.max_lo <= max_val);
+                    REQUIRE(max_val <= b.max_hi);
+                    // the mean bounds are computed in floating point,
+                    // so allow for rounding
+                    double mean_lo = b.mean_lo - 1e-9 * std::abs(b.mean_lo);
+                    double mean_hi = b.mean_hi + 1e-9 * std::abs(b.mean_hi);
+                    REQUIRE(mean_lo <= mean);
+                    REQUIRE(mean <= mean_hi);
+                    // the first window starts near the anchor, so the
+                    // bounds shouldn't have blown up yet
+                    if (w == 0 && window_nrows > 0) {
+                        int64_t width = b.max_hi - b.min_lo;
+                        REQUIRE(width < (uint_t)-1);
+                    }
+                }
+            }
+        }
+    });
+}
+
+// checks the min, max, and mean of each column in each bucket against the
+// raw data, with and without materializing the decoded rows
+template<int ElemSz, class CompF, class QueryF>
+void test_bucket_query(CompF&& f_comp, QueryF&& f_query,
+    uint32_t window_nrows)
+{
+    using traits = elemsize_traits<ElemSz>;
+    using UVec = typename traits::uvec_t;
+
+    auto fill = [](UVec& raw, uint32_t i, uint16_t ndims) {};
+    for_each_query_test_data<ElemSz>(f_comp, fill,
+        [&f_query, window_nrows](QueryTestData<ElemSz>& data)
+    {
+        QueryParams& qp = data.qp;
+        const auto& cols = data.cols;
+        uint16_t ndims = data.ndims;
+        qp.window_nrows = window_nrows;
+        uint32_t d = (uint32_t)cols.size();
+
+        uint32_t nrows_queried = data.nrows_queried;
+        uint32_t window = window_nrows > 0 ? window_nrows : nrows_queried;
+        uint32_t nbuckets = window > 0 ? DIV_ROUND_UP(nrows_queried, window) : 0;
+
+        for (bool materialize : {false, true}) {
+            CAPTURE(materialize);
+            qp.materialize = materialize;
+            vector<BucketStats> buckets;
+            f_query(data.compressed.data(), data.decompressed.data(), qp,
+                buckets);
+            REQUIRE(buckets.size() == nbuckets * d);
+            if (materialize && qp.which_cols.size() == 0) {
+                for (uint32_t i = 0; i < nrows_queried * ndims; i++) {
+                    CAPTURE(i);
+                    REQUIRE(data.decompressed(i) == data.raw(i));
+                }
+            }
+
+            for (uint32_t b = 0; b < nbuckets; b++) {
+                CAPTURE(b);
+                uint32_t start_row = b * window;
+                uint32_t end_row = MIN(start_row + window, nrows_queried);
+                for (uint32_t j = 0; j < d; j++) {
+                    CAPTURE(j);
+                    int64_t min_val = data.raw(start_row * ndims + cols[j]);
+                    int64_t max_val = min_val;
+                    double sum = 0;
+                    for (uint32_t i = start_row; i < end_row; i++) {
+                        int64_t val = data.raw(i * ndims + cols[j]);
+                        min_val = MIN(min_val, val);
+                        max_val = MAX(max_val, val);
+                        sum += val;
+                    }
+                    auto stats = buckets[b * d + j];
+                    REQUIRE(stats.min == min_val);
+                    REQUIRE(stats.max == max_val);
+                    REQUIRE(stats.mean == Approx(sum / (end_row - start_row)));
+                }
+            }
+        }
+    });
+}
+
+// checks the histogram of each column in each window against binning the
+// raw data one value at a time, that the windows add up to the histogram of
+// the whole chunk, and that quantiles are exact (8b) or within a bin (16b)
+template<int ElemSz, class CompF, class QueryF>
+void test_histogram_query(CompF&& f_comp, QueryF&& f_query,
+    uint32_t window_nrows)
+{
+    using traits = elemsize_traits<ElemSz>;
+    using uint_t = typename traits::uint_t;
+    using UVec = typename traits::uvec_t;
+    const uint32_t nbins = histogram_traits<uint_t>::nbins;
+
+    // some cols of small values so that the 16b bins below 32 get used
+    auto fill = [](UVec& raw, uint32_t i, uint16_t ndims) {
+        if ((i % ndims) % 3 == 1) { raw(i) = raw(i) % 40; }
+    };
+    for_each_query_test_data<ElemSz>(f_comp, fill,
+        [&f_query, window_nrows, nbins](QueryTestData<ElemSz>& data)
+    {
+        QueryParams& qp = data.qp;
+        const auto& cols = data.cols;
+        uint16_t ndims = data.ndims;
+        qp.materialize = false;
+        uint32_t d = (uint32_t)cols.size();
+
+        uint32_t nrows_queried = data.nrows_queried;
+        uint32_t window = window_nrows > 0 ? window_nrows : nrows_queried;
+        uint32_t nwindows = window > 0 ? DIV_ROUND_UP(nrows_queried, window) : 0;
+
+        qp.window_nrows = window_nrows;
+        vector<uint32_t> counts;
+        f_query(data.compressed.data(), data.decompressed.data(), qp, counts);
+        REQUIRE(counts.size() == nwindows * d * nbins);
+
+        vector<uint32_t> expected(counts.size());
+        for (uint32_t i = 0; i < nrows_queried; i++) {
+            uint32_t w = i / window;
+            for (uint32_t j = 0; j < d; j++) {
+                uint32_t bin = histogram_bin(data.raw(i * ndims + cols[j]));
+                expected[(w * d + j) * nbins + bin]++;
+            }
+        }
+        for (size_t i = 0; i < counts.size(); i++) {
+            CAPTURE(i);
+            REQUIRE(counts[i] == expected[i]);
+        }
+        if (nrows_queried == 0) { return; }
+
+        // per-window histograms merge into the whole-chunk histogram
+        vector<uint64_t> merged(d * nbins);
+        for (uint32_t w = 0; w < nwindows; w++) {
+            merge_histograms(counts.data() + w * d * nbins, d * nbins,
+                merged.data());
+        }
+        qp.window_nrows = 0;
+        vector<uint32_t> total_counts;
+        f_query(data.compressed.data(), data.decompressed.data(), qp,
+            total_counts);
+        REQUIRE(total_counts.size() == merged.size());
+        for (size_t i = 0; i < merged.size(); i++) {
+            CAPTURE(i);
+            REQUIRE(total_counts[i] == merged[i]);
+        }
+
+        for (uint32_t j = 0; j < d; j++) {
+            CAPTURE(j);
+            vector<uint_t> col_vals;
+            for (uint32_t i = 0; i < nrows_queried; i++) {
+                col_vals.push_back(data.raw(i * ndims + cols[j]));
+            }
+            std::sort(col_vals.begin(), col_vals.end());
+            for (double q : {0., .5, .99, 1.}) {
+                CAPTURE(q);
+                size_t rank = (size_t)ceil(q * col_vals.size());
+                double truth = col_vals[rank > 0 ? rank - 1 : 0];
+                double est = histogram_quantile<uint_t>(
+                    total_counts.data() + j * nbins, q);
+                REQUIRE(fabs(est - truth) <= truth / 64);
+            }
+        }
+    });
+}
+
 // ================================================================ Delta
 
 TEST_CASE("query rowmajor delta rle 8b", "[rowmajor][delta][rle][8b][query]") {
@@ -141,6 +550,112 @@ TEST_CASE("query delta reduce sum 16b", "[delta][8b][query]") {
     test_query<2>(qp, f_comp, query_rowmajor_delta_rle_16b);
 }
 
+TEST_CASE("query delta column projection 8b", "[delta][8b][query][projection]") {
+    printf("executing delta column projection query 8b test\n");
+    QueryParams qp;
+    qp.op = REDUCE_MAX;
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_8b(src, len, dest, ndims);
+    };
+    test_query_projection<1>(qp, f_comp, query_rowmajor_delta_rle_8b);
+}
+TEST_CASE("query delta column projection 16b", "[delta][16b][query][projection]") {
+    printf("executing delta column projection query 16b test\n");
+    QueryParams qp;
+    qp.op = REDUCE_SUM;
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_16b(src, len, dest, ndims);
+    };
+    test_query_projection<2>(qp, f_comp, query_rowmajor_delta_rle_16b);
+}
+TEST_CASE("query delta corr 8b", "[delta][8b][query][corr]") {
+    printf("executing delta corr query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_8b(src, len, dest, ndims);
+    };
+    test_corr_query<1>(f_comp, corr_query_rowmajor_delta_rle_8b, 0);
+    // windows that split blocks and runs
+    test_corr_query<1>(f_comp, corr_query_rowmajor_delta_rle_8b, 20);
+}
+TEST_CASE("query delta corr 16b", "[delta][16b][query][corr]") {
+    printf("executing delta corr query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_16b(src, len, dest, ndims);
+    };
+    test_corr_query<2>(f_comp, corr_query_rowmajor_delta_rle_16b, 0);
+    test_corr_query<2>(f_comp, corr_query_rowmajor_delta_rle_16b, 20);
+}
+TEST_CASE("query delta bounds 8b", "[delta][8b][query][bounds]") {
+    printf("executing delta bounds query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_8b(src, len, dest, ndims);
+    };
+    test_bounds_query<1>(f_comp, bounds_query_rowmajor_delta_rle_8b, 0);
+    test_bounds_query<1>(f_comp, bounds_query_rowmajor_delta_rle_8b, 20);
+}
+TEST_CASE("query delta bounds 16b", "[delta][16b][query][bounds]") {
+    printf("executing delta bounds query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_16b(src, len, dest, ndims);
+    };
+    test_bounds_query<2>(f_comp, bounds_query_rowmajor_delta_rle_16b, 0);
+    test_bounds_query<2>(f_comp, bounds_query_rowmajor_delta_rle_16b, 20);
+}
+TEST_CASE("histogram bins", "[query][histogram]") {
+    for (uint32_t x = 0; x < 256; x++) {
+        CAPTURE(x);
+        REQUIRE(histogram_bin((uint8_t)x) == x);
+    }
+    uint32_t prev_bin = 0;
+    for (uint32_t x = 0; x < 65536; x++) {
+        CAPTURE(x);
+        uint32_t bin = histogram_bin((uint16_t)x);
+        uint32_t bin_min = histogram_bin_min<uint16_t>(bin);
+        uint32_t bin_max = histogram_bin_max<uint16_t>(bin);
+        uint32_t bin_step = bin - prev_bin;
+        uint32_t bin_width = bin_max - bin_min;
+        REQUIRE(bin < histogram_traits<uint16_t>::nbins);
+        REQUIRE(bin_step <= 1);
+        REQUIRE(bin_min <= x);
+        REQUIRE(x <= bin_max);
+        REQUIRE(bin_width <= bin_min / 32);
+        prev_bin = bin;
+    }
+    REQUIRE(prev_bin == histogram_traits<uint16_t>::nbins - 1);
+}
+TEST_CASE("query delta buckets 8b", "[delta][8b][query][buckets]") {
+    printf("executing delta bucket query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_8b(src, len, dest, ndims);
+    };
+    test_bucket_query<1>(f_comp, bucket_query_rowmajor_delta_rle_8b, 0);
+    test_bucket_query<1>(f_comp, bucket_query_rowmajor_delta_rle_8b, 20);
+}
+TEST_CASE("query delta buckets 16b", "[delta][16b][query][buckets]") {
+    printf("executing delta bucket query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_16b(src, len, dest, ndims);
+    };
+    test_bucket_query<2>(f_comp, bucket_query_rowmajor_delta_rle_16b, 0);
+    test_bucket_query<2>(f_comp, bucket_query_rowmajor_delta_rle_16b, 20);
+}
+TEST_CASE("query delta histogram 8b", "[delta][8b][query][histogram]") {
+    printf("executing delta histogram query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_8b(src, len, dest, ndims);
+    };
+    test_histogram_query<1>(f_comp, histogram_query_rowmajor_delta_rle_8b, 0);
+    test_histogram_query<1>(f_comp, histogram_query_rowmajor_delta_rle_8b, 20);
+}
+TEST_CASE("query delta histogram 16b", "[delta][16b][query][histogram]") {
+    printf("executing delta histogram query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_delta_rle_16b(src, len, dest, ndims);
+    };
+    test_histogram_query<2>(f_comp, histogram_query_rowmajor_delta_rle_16b, 0);
+    test_histogram_query<2>(f_comp, histogram_query_rowmajor_delta_rle_16b, 20);
+}
+
 // ================================================================ XFF
 
 // TEST_CASE("xff rle rowmajor 8b query (with compression)",
@@ -204,29 +719,28 @@ TEST_CASE("query rowmajor xff rle 8b", "[rowmajor][xff][rle][8b][query]") {
 
 // XXX this started failing; unsure if it's supposed to
 //
-//TEST_CASE("query rowmajor xff rle 16b", "[rowmajor][xff][rle][16b][query]") {
-//    printf("executing rowmajor xff rle 16b query test\n");
-//    // TEST_CODEC_MANY_NDIMS_16b(compress_rowmajor_16b, decompress_rowmajor_16b);
-//
-//     uint16_t ndims = 3;
-//    auto ndims_list = ar::range(1, ndims + 1);
-////     auto ndims_list = ar::range(ndims, ndims + 1);
-////    auto ndims_list = ar::range(1, 129 + 1);
-//    for (auto _ndims : ndims_list) {
-//        auto ndims = (uint16_t)_ndims;
-//        printf("---- ndims = %d\n", ndims);
-//        CAPTURE(ndims);
-//        auto comp = [ndims](const uint16_t* src, size_t len, int16_t* dest) {
-//            return compress_rowmajor_xff_rle_16b(src, (uint32_t)len, dest, ndims);
-//        };
-//        auto decomp = [](int16_t* src, uint16_t* dest) {
-//            QueryParams qp;
-//            return query_rowmajor_xff_rle_16b(src, dest, qp);
-//        };
-//
-//        test_codec<2>(comp, decomp);
-//    }
-//}
+TEST_CASE("query rowmajor xff rle 16b", "[rowmajor][xff][rle][16b][query]") {
+    printf("executing rowmajor xff rle 16b query test\n");
+    uint16_t ndims = 3;
+    auto ndims_list = ar::range(1, ndims + 1);
+//     auto ndims_list = ar::range(ndims, ndims + 1);
+//    auto ndims_list = ar::range(1, 129 + 1);
+    for (auto _ndims : ndims_list) {
+        auto ndims = (uint16_t)_ndims;
+        printf("---- ndims = %d\n", ndims);
+        CAPTURE(ndims);
+        auto comp = [ndims](const uint16_t* src, size_t len, int16_t* dest) {
+            return compress_rowmajor_xff_rle_16b(src, (uint32_t)len, dest, ndims);
+        };
+        auto decomp = [](int16_t* src, uint16_t* dest) {
+            QueryParams qp;
+            qp.materialize = true;
+            return query_rowmajor_xff_rle_16b(src, dest, qp);
+        };
+
+        test_codec<2>(comp, decomp);
+    }
+}
 
 
 TEST_CASE("query xff noop 8b", "[xff][8b][query]") {
@@ -277,3 +791,60 @@ TEST_CASE("query xff reduce max 16b", "[xff][8b][query]") {
      test_query<2>(qp, f_comp, query_rowmajor_xff_rle_16b);
  }
 
+TEST_CASE("query xff column projection 8b", "[xff][8b][query][projection]") {
+    printf("executing xff column projection query 8b test\n");
+    QueryParams qp;
+    qp.op = REDUCE_SUM;
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_8b(src, len, dest, ndims);
+    };
+    test_query_projection<1>(qp, f_comp, query_rowmajor_xff_rle_8b);
+}
+TEST_CASE("query xff corr 8b", "[xff][8b][query][corr]") {
+    printf("executing xff corr query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_8b(src, len, dest, ndims);
+    };
+    test_corr_query<1>(f_comp, corr_query_rowmajor_xff_rle_8b, 0);
+    test_corr_query<1>(f_comp, corr_query_rowmajor_xff_rle_8b, 20);
+}
+TEST_CASE("query xff corr 16b", "[xff][16b][query][corr]") {
+    printf("executing xff corr query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_16b(src, len, dest, ndims);
+    };
+    test_corr_query<2>(f_comp, corr_query_rowmajor_xff_rle_16b, 0);
+    test_corr_query<2>(f_comp, corr_query_rowmajor_xff_rle_16b, 20);
+}
+TEST_CASE("query xff buckets 8b", "[xff][8b][query][buckets]") {
+    printf("executing xff bucket query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_8b(src, len, dest, ndims);
+    };
+    test_bucket_query<1>(f_comp, bucket_query_rowmajor_xff_rle_8b, 0);
+    test_bucket_query<1>(f_comp, bucket_query_rowmajor_xff_rle_8b, 20);
+}
+TEST_CASE("query xff buckets 16b", "[xff][16b][query][buckets]") {
+    printf("executing xff bucket query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_16b(src, len, dest, ndims);
+    };
+    test_bucket_query<2>(f_comp, bucket_query_rowmajor_xff_rle_16b, 0);
+    test_bucket_query<2>(f_comp, bucket_query_rowmajor_xff_rle_16b, 20);
+}
+TEST_CASE("query xff histogram 8b", "[xff][8b][query][histogram]") {
+    printf("executing xff histogram query 8b test\n");
+    auto f_comp = [](const uint8_t* src, uint32_t len, int8_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_8b(src, len, dest, ndims);
+    };
+    test_histogram_query<1>(f_comp, histogram_query_rowmajor_xff_rle_8b, 0);
+    test_histogram_query<1>(f_comp, histogram_query_rowmajor_xff_rle_8b, 20);
+}
+TEST_CASE("query xff histogram 16b", "[xff][16b][query][histogram]") {
+    printf("executing xff histogram query 16b test\n");
+    auto f_comp = [](const uint16_t* src, uint32_t len, int16_t* dest, uint16_t ndims) {
+        return compress_rowmajor_xff_rle_16b(src, len, dest, ndims);
+    };
+    test_histogram_query<2>(f_comp, histogram_query_rowmajor_xff_rle_16b, 0);
+    test_histogram_query<2>(f_comp, histogram_query_rowmajor_xff_rle_16b, 20);
+}